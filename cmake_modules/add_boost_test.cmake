@@ -1,9 +1,15 @@
 include(qdb_add_executable)
 
 function(add_boost_test_executable NAME COMPONENT)
+    set(SOURCES ${ARGN})
+
+    # the teamcity reporter is only there when building with the quasardb tree
+    if(TARGET teamcity_boost)
+        list(APPEND SOURCES $<TARGET_OBJECTS:teamcity_boost>)
+    endif()
+
     qdb_add_executable(${NAME}
-        ${ARGN}
-        $<TARGET_OBJECTS:teamcity_boost>
+        ${SOURCES}
     )
 
     target_link_libraries(${NAME}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_series.hpp"
+#include "itch_bars.hpp"
+#include "itch_executions.hpp"
+#include <fmt/format.h>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// the widths of --bars, in seconds, they must divide a day for the bars to be aligned on the start of the day
+inline std::vector<std::chrono::seconds> get_bar_widths(const config & cfg)
+{
+    std::vector<std::chrono::seconds> res;
+
+    for (const auto & width : split_list(cfg.bars))
+    {
+        const auto seconds = std::stoul(width);
+        if (!seconds || (86'400u % seconds)) throw std::runtime_error("the bar widths must divide a day");
+
+        res.emplace_back(seconds);
+    }
+
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+
+    if (res.empty()) throw std::runtime_error("please specify the bar widths");
+
+    return res;
+}
+
+// Writes the bars to <stock>_bars_<width>s tables with batch inserts, or to the --output file as csv:
+// stock, width (seconds), time (nanoseconds since the epoch), open, high, low, close, volume, vwap, trades
+// the rows are pushed every time the bars are drained, the batches are reused from one push to the next
+class bar_writer
+{
+public:
+    bar_writer(qdb_handle_t h, const config & cfg, const std::string & stock, const std::vector<std::chrono::seconds> & widths)
+        : _stock{stock}
+        , _widths{widths}
+    {
+        if (!cfg.output.empty())
+        {
+            _file = std::fopen(cfg.output.c_str(), "wb");
+            if (!_file) throw std::runtime_error("cannot open the output file");
+
+            fmt::format_to(_buffer, "stock,width,time,open,high,low,close,volume,vwap,trades\n");
+            return;
+        }
+
+        series_columns columns;
+
+        columns.add("open", qdb_ts_column_double);
+        columns.add("high", qdb_ts_column_double);
+        columns.add("low", qdb_ts_column_double);
+        columns.add("close", qdb_ts_column_double);
+        columns.add("volume", qdb_ts_column_int64);
+        columns.add("vwap", qdb_ts_column_double);
+        columns.add("trades", qdb_ts_column_int64);
+
+        _tables.reserve(widths.size());
+
+        for (const auto w : widths)
+        {
+            _tables.emplace_back(h, fmt::format("{}_bars_{}s", stock, w.count()), columns, 4'096u);
+        }
+    }
+
+    bar_writer(const bar_writer &) = delete;
+    bar_writer & operator=(const bar_writer &) = delete;
+
+    ~bar_writer()
+    {
+        if (_file) std::fclose(_file);
+    }
+
+    void write(size_t series, const itch::bar & b)
+    {
+        ++_rows;
+
+        if (_file)
+        {
+            fmt::format_to(_buffer, "{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{},{:.3f},{}\n", _stock, _widths[series].count(), b.start,
+                convert_from_fix(b.open), convert_from_fix(b.high), convert_from_fix(b.low), convert_from_fix(b.close), b.volume,
+                convert_from_fix(b.vwap()), b.trades);
+            return;
+        }
+
+        auto & t = _tables[series];
+
+        t.start_row(utils::timespec{utils::nanoseconds{b.start}});
+
+        t.set_double(convert_from_fix(b.open));
+        t.set_double(convert_from_fix(b.high));
+        t.set_double(convert_from_fix(b.low));
+        t.set_double(convert_from_fix(b.close));
+        t.set_int64(static_cast<std::int64_t>(b.volume));
+        t.set_double(convert_from_fix(b.vwap()));
+        t.set_int64(b.trades);
+    }
+
+    void flush()
+    {
+        if (_file)
+        {
+            std::fwrite(_buffer.data(), 1, _buffer.size(), _file);
+            std::fflush(_file);
+
+            _buffer.clear();
+            return;
+        }
+
+        for (auto & t : _tables)
+        {
+            t.push();
+        }
+    }
+
+    std::uint64_t rows() const noexcept
+    {
+        return _rows;
+    }
+
+private:
+    std::string _stock;
+    std::vector<std::chrono::seconds> _widths;
+
+    std::vector<series_batch> _tables;
+
+    std::FILE * _file{nullptr};
+    fmt::memory_buffer _buffer;
+
+    std::uint64_t _rows{0};
+};
+
+// the bars of every width of --bars from a single replay of the day
+// the engine logs the executions of a slice, they update every width at once
+template <typename Engine>
+void run_bars(qdb_handle_t h, const config & cfg)
+{
+    // the completed bars of a width kept before they are written, about an hour of one second bars
+    static constexpr size_t bar_capacity = 4'096u;
+
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+    const auto widths    = get_bar_widths(cfg);
+
+    Engine engine;
+    itch::execution_log executions;
+
+    engine.set_execution_log(&executions);
+
+    itch::bar_builder builder{widths, bar_capacity};
+    bar_writer writer{h, cfg, cfg.stock, widths};
+
+    const auto drain = [&builder, &writer]() {
+        builder.drain([&writer](size_t series, const itch::bar & b) { writer.write(series, b); });
+        writer.flush();
+    };
+
+    std::uint64_t trades = 0;
+
+    const auto replay = replay_day(h, cfg, cfg.stock, day_start, [&](const itch::order_batch & orders) {
+        const auto missed_orders = engine.run_orders(orders, 0, orders.size());
+
+        for (const auto & e : executions)
+        {
+            if (builder.add(e)) drain();
+        }
+
+        trades += executions.size();
+        executions.clear();
+
+        return missed_orders;
+    });
+
+    engine.set_execution_log(nullptr);
+
+    builder.close();
+    drain();
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "Bars for {} on {} \n", cfg.stock,
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())));
+    fmt::print(report_file, "Processed orders {:L} - missed orders {:L} - executions {:L} - bars {:L} ({} widths)\n", replay.orders,
+        replay.missed_orders, trades, writer.rows(), widths.size());
+
+    print_replay_timings(std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time), replay);
+}
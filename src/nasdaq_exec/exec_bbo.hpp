@@ -0,0 +1,71 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_series.hpp"
+#include "itch_bbo.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/stringify.hpp>
+#include <chrono>
+#include <ctime>
+#include <string>
+
+// writes the timeline to <stock>_bbo, one row per change
+inline void write_bbo_timeline(qdb_handle_t h, const std::string & stock, const itch::bbo_timeline & timeline)
+{
+    series_columns columns;
+
+    columns.add("bid", qdb_ts_column_double);
+    columns.add("bid_size", qdb_ts_column_int64);
+    columns.add("bid_orders", qdb_ts_column_int64);
+    columns.add("ask", qdb_ts_column_double);
+    columns.add("ask_size", qdb_ts_column_int64);
+    columns.add("ask_orders", qdb_ts_column_int64);
+
+    write_series(h, stock + "_bbo", columns, timeline.timestamps, [&timeline](series_batch & b, size_t i) {
+        b.set_double(convert_from_fix(timeline.bids[i]));
+        b.set_int64(timeline.bid_shares[i]);
+        b.set_int64(timeline.bid_orders[i]);
+        b.set_double(convert_from_fix(timeline.asks[i]));
+        b.set_int64(timeline.ask_shares[i]);
+        b.set_int64(timeline.ask_orders[i]);
+    });
+}
+
+// replays the whole day of the requested time and writes every change of the best bid and offer
+template <typename Engine>
+void run_bbo_series(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+
+    Engine engine;
+    itch::bbo_timeline timeline;
+
+    engine.set_bbo_timeline(&timeline);
+
+    const auto replay = replay_day(
+        h, cfg, cfg.stock, day_start, [&engine](const itch::order_batch & orders) { return engine.run_orders(orders, 0, orders.size()); });
+
+    engine.set_bbo_timeline(nullptr);
+
+    auto engine_end_time = std::chrono::high_resolution_clock::now();
+
+    write_bbo_timeline(h, cfg.stock, timeline);
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "BBO series for {} on {} \n", cfg.stock,
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())));
+    fmt::print(report_file, "Processed orders {:L} - missed orders {:L} - BBO changes {:L}\n", replay.orders, replay.missed_orders,
+        timeline.size());
+
+    const auto elapsed_run   = std::chrono::duration_cast<std::chrono::microseconds>(engine_end_time - total_start_time) - replay.waited;
+    const auto elapsed_write = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - engine_end_time);
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    print_replay_timings(total_elapsed, replay);
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "   Engine execution: {:>9L} us\n", elapsed_run.count());
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "       Series write: {:>9L} us\n", elapsed_write.count());
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_series.hpp"
+#include "itch_samples.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <tbb/parallel_for.h>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// writes the samples to <stock>_book, one row per sample and, for every level, four columns:
+// bid_<level>, bid_size_<level>, ask_<level>, ask_size_<level>, the best level being 0
+inline void write_book_samples(qdb_handle_t h, const std::string & stock, const itch::book_samples & samples)
+{
+    series_columns columns;
+
+    for (size_t level = 0; level < samples.levels(); ++level)
+    {
+        columns.add(fmt::format("bid_{}", level), qdb_ts_column_double);
+        columns.add(fmt::format("bid_size_{}", level), qdb_ts_column_int64);
+        columns.add(fmt::format("ask_{}", level), qdb_ts_column_double);
+        columns.add(fmt::format("ask_size_{}", level), qdb_ts_column_int64);
+    }
+
+    write_series(h, stock + "_book", columns, samples.timestamps, [&samples](series_batch & b, size_t i) {
+        for (size_t level = 0; level < samples.levels(); ++level)
+        {
+            const auto & bid = samples.buy_level(i, level);
+            const auto & ask = samples.sell_level(i, level);
+
+            b.set_double(convert_from_fix(bid.price));
+            b.set_int64(bid.shares);
+            b.set_double(convert_from_fix(ask.price));
+            b.set_int64(ask.shares);
+        }
+    });
+}
+
+struct book_series_result
+{
+    std::uint64_t orders{0};
+    std::uint64_t missed_orders{0};
+    std::uint64_t samples{0};
+    std::chrono::microseconds elapsed{0};
+};
+
+// replays the day once and samples the best levels on a grid aligned on the start of the day
+template <typename Engine>
+book_series_result build_book_series(qdb_handle_t h, const config & cfg, const std::string & stock, utils::timespec day_start)
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    book_series_result res;
+
+    const auto step = std::chrono::nanoseconds{std::chrono::milliseconds{cfg.sample_ms}};
+
+    Engine engine;
+    engine.set_depth(get_levels(cfg, default_sample_levels));
+    engine.track_bbo(true);
+
+    itch::book_samples samples{engine.depth()};
+
+    const auto replay = replay_day_on_grid(h, cfg, stock, day_start, engine, step, [&samples, &engine](utils::timespec t) {
+        samples.append(t, engine.buy_levels(), engine.sell_levels());
+    });
+
+    write_book_samples(h, stock, samples);
+
+    res.orders        = replay.orders;
+    res.missed_orders = replay.missed_orders;
+    res.samples       = samples.size();
+    res.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+
+    return res;
+}
+
+// samples the book of every stock on the day, in parallel
+template <typename Engine>
+void run_book_series(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+    const auto stocks    = split_list(cfg.stock);
+
+    std::vector<book_series_result> results(stocks.size());
+
+    tbb::parallel_for(size_t{0}, stocks.size(), [&](size_t i) { results[i] = build_book_series<Engine>(h, cfg, stocks[i], day_start); });
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "Book series for {} stocks on {}, {} levels every {} ms\n", stocks.size(),
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())), get_levels(cfg, default_sample_levels),
+        cfg.sample_ms);
+
+    for (size_t i = 0; i < stocks.size(); ++i)
+    {
+        const auto & r = results[i];
+        fmt::print(report_file, "{:>8} - orders {:>12L} - missed {:>8L} - samples {:>9L} - {:>9L} us\n", stocks[i], r.orders,
+            r.missed_orders, r.samples, r.elapsed.count());
+    }
+
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
+}
@@ -0,0 +1,362 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "itch_exec.hpp"
+#include "itch_participants.hpp"
+#include "itch_schema.hpp"
+#include "itch_snapshot.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/stringify.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// the book as requested: full, collapsed, or limited to the best levels
+struct book_view
+{
+    itch::order_book buying_book;
+    itch::order_book selling_book;
+
+    itch::collapsed_book collapsed_buying_book;
+    itch::collapsed_book collapsed_selling_book;
+};
+
+template <typename Engine>
+book_view build_book_view(const Engine & engine, const config & cfg)
+{
+    book_view res;
+
+    if (cfg.depth && cfg.collapsed)
+    {
+        res.collapsed_buying_book  = engine.collapse_levels(engine.buy_levels());
+        res.collapsed_selling_book = engine.collapse_levels(engine.sell_levels());
+    }
+    else if (cfg.depth)
+    {
+        res.buying_book  = engine.buy_book_top();
+        res.selling_book = engine.sell_book_top();
+    }
+    else
+    {
+        res.buying_book  = engine.buy_book();
+        res.selling_book = engine.sell_book();
+
+        if (cfg.collapsed)
+        {
+            res.collapsed_buying_book  = engine.collapse_book(res.buying_book);
+            res.collapsed_selling_book = engine.collapse_book(res.selling_book);
+        }
+    }
+
+    return res;
+}
+
+// Writes the books in the requested format, every book is rendered in a buffer reused from one book to the next.
+//
+// text is for humans, with colors and the locale. The other formats don't use the locale, prices are fixed point
+// with 3 decimals and times are nanoseconds since the epoch. The levels of each side are written best first:
+//
+//  - csv, one line per order or level: stock, time, side, price, shares and, for orders, reference
+//  - jsonl, one object per order or level with the same fields
+//  - binary, for every book: kind (u8, 0 for orders, 1 for levels), time (i64), sell count (u32), buy count (u32),
+//    then the sells and the buys as price (u32), shares (u32) and, for orders, reference (u64), little endian
+class book_writer
+{
+public:
+    explicit book_writer(const config & cfg)
+        : _format{cfg.output_format}
+        , _collapsed{cfg.collapsed}
+    {
+        if (cfg.output.empty()) return;
+
+        _file = std::fopen(cfg.output.c_str(), "wb");
+        if (!_file) throw std::runtime_error("cannot open the output file");
+    }
+
+    book_writer(const book_writer &) = delete;
+    book_writer & operator=(const book_writer &) = delete;
+
+    ~book_writer()
+    {
+        if (_file != stdout) std::fclose(_file);
+    }
+
+private:
+    // the price of a fixed point 1000 units, without going through a double and the locale
+    void append_price(std::uint32_t price)
+    {
+        fmt::format_to(_buffer, "{}.{:03}", price / 1000u, price % 1000u);
+    }
+
+    void append_bar(std::uint32_t current_value, std::uint32_t max_value)
+    {
+        static constexpr char bar[]        = "####################";
+        static constexpr size_t bar_length = sizeof(bar) - 1u;
+
+        size_t l = bar_length;
+
+        if (current_value < max_value)
+        {
+            l = static_cast<size_t>(static_cast<double>(bar_length) * static_cast<double>(current_value) / static_cast<double>(max_value));
+        }
+
+        _buffer.append(bar, bar + l);
+    }
+
+    // the section is printed at once in its color
+    void flush(fmt::text_style style)
+    {
+        fmt::print(_file, style, "{}", fmt::string_view{_buffer.data(), _buffer.size()});
+        _buffer.clear();
+    }
+
+    void flush()
+    {
+        std::fwrite(_buffer.data(), 1u, _buffer.size(), _file);
+        _buffer.clear();
+    }
+
+    void write_text(const itch::order_book & buying_book, const itch::order_book & selling_book)
+    {
+        if (buying_book.empty() || selling_book.empty()) return;
+
+        fmt::print(_file, fmt::fg(fmt::color::cyan), "\nDETAILED ORDER BOOK \n");
+
+        auto it_max_sell = std::max_element(selling_book.cbegin(), selling_book.cend(),
+            [](const auto & left, const auto & right) { return left.first.shares < right.first.shares; });
+        auto it_max_buy  = std::max_element(buying_book.cbegin(), buying_book.cend(),
+            [](const auto & left, const auto & right) { return left.first.shares < right.first.shares; });
+
+        const auto the_max = std::max(it_max_sell->first.shares, it_max_buy->first.shares);
+
+        const auto render = [this, the_max](const itch::order_book & book) {
+            for (auto it = book.crbegin(); it != book.crend(); ++it)
+            {
+                fmt::format_to(_buffer, " {:>9.2f} USD - {:>6L} shares - ref: {:>10L} | ", static_cast<double>(it->first.price) / 1000.0,
+                    it->first.shares, it->second);
+                append_bar(it->first.shares, the_max);
+                _buffer.push_back('\n');
+            }
+        };
+
+        fmt::format_to(_buffer, "\n *** Selling\n");
+        render(selling_book);
+        flush(fmt::fg(fmt::color::orange));
+
+        fmt::format_to(_buffer, "\n *** Buying\n");
+        render(buying_book);
+        flush(fmt::fg(fmt::color::green));
+    }
+
+    void write_text(const itch::collapsed_book & buying_book, const itch::collapsed_book & selling_book)
+    {
+        if (buying_book.empty() || selling_book.empty()) return;
+
+        fmt::print(_file, fmt::fg(fmt::color::cyan), "\nCOLLAPSED ORDER BOOK \n");
+
+        auto it_max_sell = std::max_element(
+            selling_book.cbegin(), selling_book.cend(), [](const auto & left, const auto & right) { return left.second < right.second; });
+        auto it_max_buy = std::max_element(
+            buying_book.cbegin(), buying_book.cend(), [](const auto & left, const auto & right) { return left.second < right.second; });
+
+        const auto the_max = std::max(it_max_sell->second, it_max_buy->second);
+
+        const auto render = [this, the_max](const itch::collapsed_book & book) {
+            for (auto it = book.crbegin(); it != book.crend(); ++it)
+            {
+                fmt::format_to(_buffer, " {:>9.2f} USD - {:>6L} shares | ", static_cast<double>(it->first) / 1000.0, it->second);
+                append_bar(it->second, the_max);
+                _buffer.push_back('\n');
+            }
+        };
+
+        fmt::format_to(_buffer, "\n *** Selling\n");
+        render(selling_book);
+        flush(fmt::fg(fmt::color::orange));
+
+        fmt::format_to(_buffer, "\n *** Buying\n");
+        render(buying_book);
+        flush(fmt::fg(fmt::color::green));
+    }
+
+    // calls f(price, shares, reference) on the orders of the side, best first
+    template <typename Function>
+    static void for_each_best(const itch::order_book & book, bool is_buy, Function && f)
+    {
+        if (is_buy)
+        {
+            for (auto it = book.crbegin(); it != book.crend(); ++it) f(it->first.price, it->first.shares, it->second);
+        }
+        else
+        {
+            for (auto it = book.cbegin(); it != book.cend(); ++it) f(it->first.price, it->first.shares, it->second);
+        }
+    }
+
+    // same for the levels, without reference
+    template <typename Function>
+    static void for_each_best(const itch::collapsed_book & book, bool is_buy, Function && f)
+    {
+        if (is_buy)
+        {
+            for (auto it = book.crbegin(); it != book.crend(); ++it) f(it->first, it->second);
+        }
+        else
+        {
+            for (auto it = book.cbegin(); it != book.cend(); ++it) f(it->first, it->second);
+        }
+    }
+
+    template <typename Book>
+    void write_csv(const std::string & stock, std::int64_t time, const Book & buying_book, const Book & selling_book)
+    {
+        constexpr bool has_reference = std::is_same<Book, itch::order_book>::value;
+
+        if (!_header_written)
+        {
+            fmt::format_to(_buffer, has_reference ? "stock,time,side,price,shares,reference\n" : "stock,time,side,price,shares\n");
+            _header_written = true;
+        }
+
+        for (const bool is_buy : {false, true})
+        {
+            const char * side = is_buy ? "buy" : "sell";
+
+            const auto & book = is_buy ? buying_book : selling_book;
+
+            for_each_best(book, is_buy, [&](std::uint32_t price, std::uint32_t shares, auto... reference) {
+                fmt::format_to(_buffer, "{},{},{},", stock, time, side);
+                append_price(price);
+                fmt::format_to(_buffer, ",{}", shares);
+                (fmt::format_to(_buffer, ",{}", reference), ...);
+                _buffer.push_back('\n');
+            });
+        }
+
+        flush();
+    }
+
+    template <typename Book>
+    void write_jsonl(const std::string & stock, std::int64_t time, const Book & buying_book, const Book & selling_book)
+    {
+        for (const bool is_buy : {false, true})
+        {
+            const char * side = is_buy ? "buy" : "sell";
+
+            const auto & book = is_buy ? buying_book : selling_book;
+
+            for_each_best(book, is_buy, [&](std::uint32_t price, std::uint32_t shares, auto... reference) {
+                fmt::format_to(_buffer, "{{\"stock\":\"{}\",\"time\":{},\"side\":\"{}\",\"price\":", stock, time, side);
+                append_price(price);
+                fmt::format_to(_buffer, ",\"shares\":{}", shares);
+                (fmt::format_to(_buffer, ",\"reference\":{}", reference), ...);
+                _buffer.append(std::begin("}\n"), std::end("}\n") - 1);
+            });
+        }
+
+        flush();
+    }
+
+    template <typename Integer>
+    void append_integer(Integer v)
+    {
+        std::uint8_t raw[sizeof(Integer)];
+
+        std::uint8_t * p = raw;
+        size_t l         = sizeof(raw);
+
+        itch::serialize_integer(p, l, v);
+        _buffer.append(std::begin(raw), std::end(raw));
+    }
+
+    template <typename Book>
+    void write_binary(std::int64_t time, const Book & buying_book, const Book & selling_book)
+    {
+        constexpr bool has_reference = std::is_same<Book, itch::order_book>::value;
+
+        append_integer(static_cast<std::uint8_t>(has_reference ? 0u : 1u));
+        append_integer(time);
+        append_integer(static_cast<std::uint32_t>(selling_book.size()));
+        append_integer(static_cast<std::uint32_t>(buying_book.size()));
+
+        for (const bool is_buy : {false, true})
+        {
+            const auto & book = is_buy ? buying_book : selling_book;
+
+            for_each_best(book, is_buy, [this](std::uint32_t price, std::uint32_t shares, auto... reference) {
+                append_integer(price);
+                append_integer(shares);
+                (append_integer(static_cast<std::uint64_t>(reference)), ...);
+            });
+        }
+
+        flush();
+    }
+
+    template <typename Book>
+    void write(const std::string & stock, utils::timespec when, const Book & buying_book, const Book & selling_book)
+    {
+        const auto time = itch::order_batch::to_nanoseconds(when);
+
+        if (_format == "csv") return write_csv(stock, time, buying_book, selling_book);
+        if (_format == "jsonl") return write_jsonl(stock, time, buying_book, selling_book);
+        if (_format == "binary") return write_binary(time, buying_book, selling_book);
+
+        write_text(buying_book, selling_book);
+    }
+
+public:
+    void write(const book_view & view, const std::string & stock, utils::timespec when)
+    {
+        if (_collapsed)
+        {
+            write(stock, when, view.collapsed_buying_book, view.collapsed_selling_book);
+        }
+        else
+        {
+            write(stock, when, view.buying_book, view.selling_book);
+        }
+
+        std::fflush(_file);
+    }
+
+private:
+    std::string _format;
+    bool _collapsed;
+    bool _header_written{false};
+
+    std::FILE * _file{stdout};
+    fmt::memory_buffer _buffer;
+};
+
+inline double share_percent(std::uint64_t shares, std::uint64_t total) noexcept
+{
+    return total ? (100.0 * static_cast<double>(shares) / static_cast<double>(total)) : 0.0;
+}
+
+// the resting and executed shares of every participant, largest resting liquidity first
+inline void print_liquidity_shares(const itch::participant_book & participants)
+{
+    std::vector<itch::participant_liquidity> rows = participants.participants();
+
+    std::stable_sort(rows.begin(), rows.end(), [](const auto & left, const auto & right) {
+        return (left.buy_shares + left.sell_shares) > (right.buy_shares + right.sell_shares);
+    });
+
+    const auto total = participants.total();
+
+    fmt::print(report_file, "\nLiquidity shares - {} participants\n", rows.size() - 1u);
+    fmt::print(report_file, "{:>9} {:>12} {:>7} {:>12} {:>7} {:>12} {:>7}\n", "mpid", "buy", "%", "sell", "%", "executed", "%");
+
+    for (const auto & p : rows)
+    {
+        fmt::print(report_file, "{:>9} {:>12L} {:>7.2f} {:>12L} {:>7.2f} {:>12L} {:>7.2f}\n",
+            p.mpid ? itch::unpack_mpid(p.mpid) : "anonymous", p.buy_shares, share_percent(p.buy_shares, total.buy_shares), p.sell_shares,
+            share_percent(p.sell_shares, total.sell_shares), p.executed, share_percent(p.executed, total.executed));
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <qdb/client.h>
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/gregorian.hpp>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the snapshots of the books, taken by the builder and read by every mode that positions an engine
+struct snapshot_options
+{
+    std::uint16_t full_every;
+    std::uint32_t minutes;
+    std::uint64_t messages;
+    std::string cache;
+    std::uint64_t cache_mb;
+    std::string layout;
+};
+
+// the top of book published to the query threads of the point in time
+struct publisher_options
+{
+    size_t readers;
+    std::uint64_t messages;
+    std::uint64_t us;
+};
+
+struct viewer_options
+{
+    std::uint32_t speed;
+    std::uint32_t fps;
+};
+
+struct service_options
+{
+    std::string socket;
+    size_t warm_engines;
+};
+
+struct config
+{
+    bool bbo;
+    bool book_series;
+    bool collapsed;
+    bool point_in_time;
+    bool snapshot_builder;
+    size_t depth;
+    std::uint32_t sample_ms;
+    std::uint32_t stream_minutes;
+    bool scalable_allocator;
+    std::string qdb_url;
+    std::string orders_schema;
+    std::string output;
+    std::string output_format;
+    std::string stock;
+    std::string store;
+    std::string when;
+    std::string until;
+    std::uint32_t every_seconds;
+    bool view;
+    std::string bars;
+    bool flow;
+    std::string flow_depths;
+    bool level_deltas;
+    bool attribution;
+    bool convert_orders;
+    snapshot_options snapshots;
+    publisher_options publishing;
+    viewer_options viewer;
+    service_options service;
+};
+
+// the levels kept by the service, the viewer and the publisher when --depth isn't given
+static constexpr size_t default_levels = 10u;
+
+// the levels of the sampled book series when --depth isn't given
+static constexpr size_t default_sample_levels = 5u;
+
+// --depth when given, the default of the mode otherwise
+inline size_t get_levels(const config & cfg, size_t default_depth) noexcept
+{
+    return cfg.depth ? cfg.depth : default_depth;
+}
+
+// where the messages and the timings go, stderr when the books written to stdout are meant for a program
+inline std::FILE * report_file = stdout;
+
+inline void throw_on_failure(qdb_error_t err, const char * msg)
+{
+    if (QDB_FAILURE(err))
+    {
+        fmt::print(report_file, fmt::fg(fmt::color::red), "Error: {} ({})\n", qdb_error(err), err);
+        throw std::runtime_error(msg);
+    }
+}
+
+inline std::pair<utils::timespec, utils::timespec> get_time_range(const std::string & when)
+{
+    const auto time_point = utils::from_iso_extended_string_utc(when);
+    if (time_point == std::chrono::system_clock::time_point{}) throw std::runtime_error("invalid time");
+
+    const auto time_point_ts = utils::timespec{std::chrono::duration_cast<std::chrono::seconds>(time_point.time_since_epoch())};
+    const auto requested_day = utils::extract_date(time_point_ts);
+
+    return std::make_pair(utils::make_timespec(requested_day), time_point_ts);
+}
+
+// comma separated values, empty values are skipped
+inline std::vector<std::string> split_list(const std::string & values)
+{
+    std::vector<std::string> res;
+
+    for (std::string::size_type first = 0; first <= values.size();)
+    {
+        auto last = values.find(',', first);
+        if (last == std::string::npos) last = values.size();
+
+        if (last > first) res.emplace_back(values.substr(first, last - first));
+        first = last + 1u;
+    }
+
+    return res;
+}
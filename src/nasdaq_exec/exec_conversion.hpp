@@ -0,0 +1,109 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "exec_series.hpp"
+#include "itch_messages.hpp"
+#include "itch_schema.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <tbb/parallel_for.h>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+struct conversion_result
+{
+    std::uint64_t orders{0};
+    std::uint64_t replaces{0};
+    std::chrono::microseconds elapsed{0};
+};
+
+// writes the compact tables of a stock-day from its legacy table, a slice at a time, the rows are appended
+// the orders go through the legacy reader which keeps three decimals, the fourth decimal of the converted prices is 0
+inline conversion_result convert_day_orders(qdb_handle_t h, const config & cfg, const std::string & stock, utils::timespec day_start)
+{
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    conversion_result res;
+
+    series_columns event_columns;
+
+    for (const char * name : itch::compact_event_columns)
+    {
+        event_columns.add(name, qdb_ts_column_int64);
+    }
+
+    series_columns replace_columns;
+
+    replace_columns.add(itch::compact_replace_column, qdb_ts_column_int64);
+
+    series_batch events{h, itch::compact_events_table(stock), event_columns, 0u};
+    series_batch replaces{h, itch::compact_replaces_table(stock), replace_columns, 0u};
+
+    order_stream stream{h, itch::orders_schema::legacy, stock, day_start, day_start + std::chrono::hours{24}, get_slice(cfg)};
+    itch::order_batch orders;
+
+    while (stream.next(orders))
+    {
+        for (size_t i = 0; i < orders.size(); ++i)
+        {
+            const utils::timespec timestamp{utils::nanoseconds{orders.timestamps[i]}};
+
+            events.start_row(timestamp);
+            events.set_int64(itch::pack_event(orders.types[i], orders.is_buy[i] != 0, orders.shares[i], orders.printable[i] != 0));
+            events.set_int64(static_cast<std::int64_t>(orders.references[i]));
+            events.set_int64(static_cast<std::int64_t>(orders.prices[i]) * 10);
+
+            if (orders.types[i] != itch::messages::order_replace::message_code) continue;
+
+            // the n-th row of the replaces belongs to the n-th replace of the events
+            replaces.start_row(timestamp);
+            replaces.set_int64(static_cast<std::int64_t>(orders.new_references[i]));
+
+            ++res.replaces;
+        }
+
+        events.push();
+        replaces.push();
+    }
+
+    res.orders  = stream.records();
+    res.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+
+    return res;
+}
+
+// converts the day of every stock from the legacy layout to the compact one, in parallel
+// the attributions table is shared by both layouts and stays as it is
+inline void run_orders_conversion(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+    const auto stocks    = split_list(cfg.stock);
+
+    std::vector<conversion_result> results(stocks.size());
+
+    tbb::parallel_for(size_t{0}, stocks.size(), [&](size_t i) { results[i] = convert_day_orders(h, cfg, stocks[i], day_start); });
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "Compact orders tables for {} stocks on {}\n", stocks.size(),
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())));
+
+    for (size_t i = 0; i < stocks.size(); ++i)
+    {
+        const auto & r = results[i];
+        fmt::print(
+            report_file, "{:>8} - orders {:>12L} - replaces {:>10L} - {:>9L} us\n", stocks[i], r.orders, r.replaces, r.elapsed.count());
+    }
+
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_series.hpp"
+#include "itch_flow.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// writes the samples to <stock>_flow, one row per sample and, for every depth L, two columns: ofi_<L> and imbalance_<L>
+inline void write_flow_samples(
+    qdb_handle_t h, const std::string & stock, const std::vector<size_t> & depths, const itch::flow_samples & samples)
+{
+    series_columns columns;
+
+    for (const auto d : depths)
+    {
+        columns.add(fmt::format("ofi_{}", d), qdb_ts_column_int64);
+        columns.add(fmt::format("imbalance_{}", d), qdb_ts_column_double);
+    }
+
+    write_series(h, stock + "_flow", columns, samples.timestamps, [&depths, &samples](series_batch & b, size_t i) {
+        for (size_t d = 0; d < depths.size(); ++d)
+        {
+            b.set_int64(samples.flows[d][i]);
+            b.set_double(samples.imbalances[d][i]);
+        }
+    });
+}
+
+// the order flow and depth imbalances of the day of --stock at the depths of --flow-depths, sampled every --sample-ms
+// on a grid aligned on the start of the day, the flows of a sample are those since the previous one
+template <typename Engine>
+void run_flow_series(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+    const auto step      = std::chrono::nanoseconds{std::chrono::milliseconds{cfg.sample_ms}};
+
+    std::vector<size_t> depths;
+
+    for (const auto & d : split_list(cfg.flow_depths))
+    {
+        depths.push_back(std::stoul(d));
+    }
+
+    itch::flow_metrics metrics{depths};
+    if (!metrics.max_depth()) throw std::runtime_error("please specify the depths of the flow metrics");
+
+    itch::flow_samples samples{metrics.depths().size()};
+
+    Engine engine;
+    engine.set_flow_metrics(&metrics);
+
+    const auto replay = replay_day_on_grid(
+        h, cfg, cfg.stock, day_start, engine, step, [&samples, &metrics](utils::timespec t) { samples.append(t, metrics); });
+
+    engine.set_flow_metrics(nullptr);
+
+    auto engine_end_time = std::chrono::high_resolution_clock::now();
+
+    write_flow_samples(h, cfg.stock, metrics.depths(), samples);
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "Flow series for {} on {}, every {} ms\n", cfg.stock,
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())), cfg.sample_ms);
+    fmt::print(report_file, "Processed orders {:L} - missed orders {:L} - samples {:L}\n", replay.orders, replay.missed_orders,
+        samples.size());
+
+    const auto elapsed_run   = std::chrono::duration_cast<std::chrono::microseconds>(engine_end_time - total_start_time) - replay.waited;
+    const auto elapsed_write = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - engine_end_time);
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    print_replay_timings(total_elapsed, replay);
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "   Engine execution: {:>9L} us\n", elapsed_run.count());
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "       Series write: {:>9L} us\n", elapsed_write.count());
+}
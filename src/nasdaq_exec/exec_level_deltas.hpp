@@ -0,0 +1,76 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_series.hpp"
+#include "itch_deltas.hpp"
+#include <fmt/format.h>
+#include <utils/stringify.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+// the market by price deltas of the day of --stock, written to --output, see itch_deltas.hpp
+// the changes of a timestamp are coalesced, and a slice never splits a timestamp, which closes it
+template <typename Engine>
+void run_level_deltas(qdb_handle_t h, const config & cfg)
+{
+    if (cfg.output.empty()) throw std::runtime_error("the delta feed needs an output file");
+
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file{std::fopen(cfg.output.c_str(), "wb"), &std::fclose};
+    if (!file) throw std::runtime_error("cannot open the output file");
+
+    Engine engine;
+    itch::level_delta_log log;
+
+    engine.set_level_delta_log(&log);
+
+    std::vector<std::uint8_t> buffer;
+
+    std::uint64_t timestamps = 0;
+    std::uint64_t deltas     = 0;
+    std::uint64_t bytes      = 0;
+
+    const auto write = [&]() {
+        log.close();
+
+        timestamps += log.size();
+        deltas += log.deltas.size();
+
+        buffer.clear();
+        itch::serialize_level_deltas(log, buffer);
+        log.clear();
+
+        if (std::fwrite(buffer.data(), 1, buffer.size(), file.get()) != buffer.size())
+        {
+            throw std::runtime_error("cannot write the delta feed");
+        }
+
+        bytes += buffer.size();
+    };
+
+    const auto replay = replay_day(h, cfg, cfg.stock, day_start, [&](const itch::order_batch & orders) {
+        const auto missed_orders = engine.run_orders(orders, 0, orders.size());
+        write();
+
+        return missed_orders;
+    });
+
+    engine.set_level_delta_log(nullptr);
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "Level deltas for {} on {} \n", cfg.stock,
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())));
+    fmt::print(report_file, "Processed orders {:L} - missed orders {:L} - timestamps {:L} - deltas {:L} - {:L} bytes\n", replay.orders,
+        replay.missed_orders, timestamps, deltas, bytes);
+
+    print_replay_timings(std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time), replay);
+}
@@ -0,0 +1,580 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "itch_batch.hpp"
+#include "itch_messages.hpp"
+#include "itch_schema.hpp"
+#include <qdb/ts.h>
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ts_int64
+{
+    qdb_ts_int64_point * points;
+    size_t count;
+    std::chrono::microseconds elapsed{0};
+};
+
+struct ts_double
+{
+    qdb_ts_double_point * points;
+    size_t count;
+    std::chrono::microseconds elapsed{0};
+};
+
+inline ts_int64 get_ranges_int64(qdb_handle_t h, const std::string & table_name, const std::string & column, const qdb_ts_range_t & ranges)
+{
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    ts_int64 res;
+
+    auto err = qdb_ts_int64_get_ranges(h, table_name.c_str(), column.c_str(), &ranges, 1u, &res.points, &res.count);
+    throw_on_failure(err, "int64 get range");
+
+    res.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+
+    return res;
+}
+
+inline ts_double get_ranges_double(
+    qdb_handle_t h, const std::string & table_name, const std::string & column, const qdb_ts_range_t & ranges)
+{
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    ts_double res;
+
+    auto err = qdb_ts_double_get_ranges(h, table_name.c_str(), column.c_str(), &ranges, 1u, &res.points, &res.count);
+    throw_on_failure(err, "double get range");
+
+    res.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+
+    return res;
+}
+
+// The points of a column, released as soon as they have been read or, whatever path leaves the query, on destruction.
+// A column still in flight when the query throws is released too: the future of std::async waits for it when it is
+// destroyed and its result goes with it.
+template <typename Column>
+class column_points
+{
+public:
+    column_points(qdb_handle_t h, Column column) noexcept
+        : _handle{h}
+        , _column{column}
+    {}
+
+    column_points(column_points && other) noexcept
+        : _handle{other._handle}
+        , _column{other._column}
+    {
+        other._column.points = nullptr;
+    }
+
+    column_points(const column_points &) = delete;
+    column_points & operator=(const column_points &) = delete;
+    column_points & operator=(column_points &&) = delete;
+
+    ~column_points()
+    {
+        release();
+    }
+
+    const Column * operator->() const noexcept
+    {
+        return &_column;
+    }
+
+    void release() noexcept
+    {
+        if (_column.points) qdb_release(_handle, _column.points);
+        _column.points = nullptr;
+    }
+
+private:
+    qdb_handle_t _handle;
+    Column _column;
+};
+
+// how long each column took to arrive, and how long the conversion to records took once they did
+struct fetch_timings
+{
+    std::vector<std::pair<const char *, std::chrono::microseconds>> columns;
+    std::chrono::microseconds materialization{0};
+
+    // the columns of a schema are always fetched in the same order
+    void add(const fetch_timings & other)
+    {
+        if (columns.empty()) columns = other.columns;
+        else
+        {
+            for (size_t i = 0; i < std::min(columns.size(), other.columns.size()); ++i)
+            {
+                columns[i].second += other.columns[i].second;
+            }
+        }
+
+        materialization += other.materialization;
+    }
+};
+
+// all the columns are requested at once, the handle is thread safe
+// the batch is filled column by column as they arrive, while the remaining columns are still being transferred
+inline itch::order_batch get_legacy_orders_records(
+    qdb_handle_t h, const std::string & stock, utils::timespec first, utils::timespec last, fetch_timings * timings)
+{
+    static constexpr const auto & order_columns = itch::legacy_order_columns;
+
+    const std::string table_name = itch::legacy_orders_table(stock);
+
+    qdb_ts_range_t r;
+
+    r.begin = first.as_timespec();
+    r.end   = last.as_timespec();
+
+    const auto fetch_int64 = [h, &table_name, &r](const char * column) {
+        return std::async(std::launch::async,
+            [h, &table_name, &r, column] { return column_points<ts_int64>{h, get_ranges_int64(h, table_name, column, r)}; });
+    };
+
+    auto pending_type               = fetch_int64(order_columns[0]);
+    auto pending_reference          = fetch_int64(order_columns[1]);
+    auto pending_original_reference = fetch_int64(order_columns[2]);
+    auto pending_new_reference      = fetch_int64(order_columns[3]);
+    auto pending_is_buy             = fetch_int64(order_columns[4]);
+    auto pending_shares             = fetch_int64(order_columns[5]);
+    auto pending_price              = std::async(std::launch::async,
+        [h, &table_name, &r] { return column_points<ts_double>{h, get_ranges_double(h, table_name, order_columns[6], r)}; });
+
+    std::chrono::microseconds materialization{0};
+
+    const auto timed = [&materialization](auto && f) {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        f();
+        materialization += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+    };
+
+    itch::order_batch result;
+
+    auto order_type = pending_type.get();
+
+    timed([&] {
+        result.resize(order_type->count);
+
+        for (size_t i = 0; i < order_type->count; ++i)
+        {
+            result.timestamps[i] = itch::order_batch::to_nanoseconds(utils::timespec{order_type->points[i].timestamp});
+            result.types[i]      = static_cast<char>(order_type->points[i].value);
+        }
+
+        order_type.release();
+    });
+
+    // every column has one point per order, in the same order
+    const auto check_count = [&result](size_t count) {
+        if (count != result.size()) throw std::runtime_error("incoherence column count");
+    };
+
+    // each column is a plain loop over the points, without branches
+    const auto fill_int64 = [&](column_points<ts_int64> column, auto && f) {
+        timed([&] {
+            check_count(column->count);
+
+            for (size_t i = 0; i < column->count; ++i)
+            {
+                f(i, column->points[i].value);
+            }
+
+            column.release();
+        });
+
+        return column->elapsed;
+    };
+
+    const auto reference_elapsed = fill_int64(pending_reference.get(), [&result](size_t i, std::int64_t v) {
+        // reference
+        result.references[i] = static_cast<std::uint64_t>(v);
+    });
+
+    const auto original_reference_elapsed = fill_int64(pending_original_reference.get(), [&result](size_t i, std::int64_t v) {
+        // original reference, only set when the reference isn't
+        result.references[i] = (v != qdb_int64_undefined) ? static_cast<std::uint64_t>(v) : result.references[i];
+    });
+
+    const auto new_reference_elapsed = fill_int64(pending_new_reference.get(), [&result](size_t i, std::int64_t v) {
+        // new reference
+        result.new_references[i] = static_cast<std::uint64_t>(v);
+    });
+
+    const auto is_buy_elapsed = fill_int64(pending_is_buy.get(), [&result](size_t i, std::int64_t v) {
+        // is buy, and the printable flag of the executions with price
+        result.is_buy[i]    = static_cast<std::uint8_t>((v & 1) != 0);
+        result.printable[i] = static_cast<std::uint8_t>((v & itch::legacy_non_printable) == 0);
+    });
+
+    const auto shares_elapsed = fill_int64(pending_shares.get(), [&result](size_t i, std::int64_t v) {
+        // shares
+        result.shares[i] = static_cast<std::uint32_t>(v);
+    });
+
+    auto order_price = pending_price.get();
+
+    timed([&] {
+        check_count(order_price->count);
+
+        for (size_t i = 0; i < order_price->count; ++i)
+        {
+            // price
+            result.prices[i] = itch::convert_to_fix(order_price->points[i].value);
+        }
+
+        order_price.release();
+    });
+
+    if (timings)
+    {
+        const std::array<std::chrono::microseconds, order_columns.size()> elapsed{order_type->elapsed, reference_elapsed,
+            original_reference_elapsed, new_reference_elapsed, is_buy_elapsed, shares_elapsed, order_price->elapsed};
+
+        timings->columns.clear();
+
+        for (size_t i = 0; i < order_columns.size(); ++i)
+        {
+            timings->columns.emplace_back(order_columns[i], elapsed[i]);
+        }
+
+        timings->materialization = materialization;
+    }
+
+    return result;
+}
+
+// the events and the new references of the replaces are requested at once, like the legacy columns
+inline itch::order_batch get_compact_orders_records(
+    qdb_handle_t h, const std::string & stock, utils::timespec first, utils::timespec last, fetch_timings * timings)
+{
+    static constexpr const auto & event_columns = itch::compact_event_columns;
+
+    const std::string events_table   = itch::compact_events_table(stock);
+    const std::string replaces_table = itch::compact_replaces_table(stock);
+
+    qdb_ts_range_t r;
+
+    r.begin = first.as_timespec();
+    r.end   = last.as_timespec();
+
+    const auto fetch_int64 = [h, &r](const std::string & table_name, const char * column) {
+        return std::async(std::launch::async,
+            [h, &table_name, &r, column] { return column_points<ts_int64>{h, get_ranges_int64(h, table_name, column, r)}; });
+    };
+
+    auto pending_event         = fetch_int64(events_table, event_columns[0]);
+    auto pending_reference     = fetch_int64(events_table, event_columns[1]);
+    auto pending_price4        = fetch_int64(events_table, event_columns[2]);
+    auto pending_new_reference = fetch_int64(replaces_table, itch::compact_replace_column);
+
+    std::chrono::microseconds materialization{0};
+
+    const auto timed = [&materialization](auto && f) {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        f();
+        materialization += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+    };
+
+    itch::order_batch result;
+
+    auto event = pending_event.get();
+
+    timed([&] {
+        result.resize(event->count);
+
+        for (size_t i = 0; i < event->count; ++i)
+        {
+            const std::int64_t v = event->points[i].value;
+
+            result.timestamps[i] = itch::order_batch::to_nanoseconds(utils::timespec{event->points[i].timestamp});
+            result.types[i]      = itch::event_type(v);
+            result.is_buy[i]     = static_cast<std::uint8_t>(itch::event_is_buy(v));
+            result.printable[i]  = static_cast<std::uint8_t>(itch::event_printable(v));
+            result.shares[i]     = itch::event_shares(v);
+        }
+
+        event.release();
+    });
+
+    const auto check_count = [&result](size_t count) {
+        if (count != result.size()) throw std::runtime_error("incoherence column count");
+    };
+
+    auto reference = pending_reference.get();
+
+    timed([&] {
+        check_count(reference->count);
+
+        for (size_t i = 0; i < reference->count; ++i)
+        {
+            result.references[i] = static_cast<std::uint64_t>(reference->points[i].value);
+        }
+
+        reference.release();
+    });
+
+    auto price4 = pending_price4.get();
+
+    timed([&] {
+        check_count(price4->count);
+
+        for (size_t i = 0; i < price4->count; ++i)
+        {
+            result.prices[i] = itch::price4_to_fix(price4->points[i].value);
+        }
+
+        price4.release();
+    });
+
+    auto new_reference = pending_new_reference.get();
+
+    timed([&] {
+        // the n-th row of the replaces belongs to the n-th replace of the events
+        size_t j = 0;
+
+        for (size_t i = 0; i < result.size(); ++i)
+        {
+            if (result.types[i] != itch::messages::order_replace::message_code) continue;
+
+            const bool matched =
+                (j < new_reference->count)
+                && (result.timestamps[i] == itch::order_batch::to_nanoseconds(utils::timespec{new_reference->points[j].timestamp}));
+            if (!matched) throw std::runtime_error("incoherence replace events");
+
+            result.new_references[i] = static_cast<std::uint64_t>(new_reference->points[j++].value);
+        }
+
+        const bool complete = (j == new_reference->count);
+
+        new_reference.release();
+
+        if (!complete) throw std::runtime_error("incoherence replace events");
+    });
+
+    if (timings)
+    {
+        timings->columns = {{event_columns[0], event->elapsed}, {event_columns[1], reference->elapsed}, {event_columns[2], price4->elapsed},
+            {itch::compact_replace_column, new_reference->elapsed}};
+        timings->materialization = materialization;
+    }
+
+    return result;
+}
+
+// the n-th row of the attributions belongs to the n-th add order with attribution, like the replaces of the compact layout
+inline void join_attributions(column_points<ts_int64> mpid, itch::order_batch & result, fetch_timings * timings)
+{
+    const auto start_time = std::chrono::high_resolution_clock::now();
+
+    result.mpids.assign(result.size(), 0u);
+
+    size_t j = 0;
+
+    for (size_t i = 0; i < result.size(); ++i)
+    {
+        if (result.types[i] != itch::messages::add_order_with_attribution::message_code) continue;
+
+        const bool matched =
+            (j < mpid->count) && (result.timestamps[i] == itch::order_batch::to_nanoseconds(utils::timespec{mpid->points[j].timestamp}));
+        if (!matched) throw std::runtime_error("incoherence attributions");
+
+        result.mpids[i] = static_cast<std::uint32_t>(mpid->points[j++].value);
+    }
+
+    const bool complete = (j == mpid->count);
+
+    mpid.release();
+
+    if (!complete) throw std::runtime_error("incoherence attributions");
+
+    if (timings)
+    {
+        timings->columns.emplace_back(itch::attribution_column, mpid->elapsed);
+        timings->materialization +=
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+    }
+}
+
+// the attributions are only fetched when asked for, they are transferred along with the orders
+inline itch::order_batch get_orders_records(qdb_handle_t h, itch::orders_schema schema, const std::string & stock,
+    utils::timespec first, utils::timespec last, fetch_timings * timings = nullptr, bool attributions = false)
+{
+    const std::string attributions_table = itch::attributions_table(stock);
+
+    qdb_ts_range_t r;
+
+    r.begin = first.as_timespec();
+    r.end   = last.as_timespec();
+
+    std::future<column_points<ts_int64>> pending_mpid;
+
+    if (attributions)
+    {
+        pending_mpid = std::async(std::launch::async, [h, &attributions_table, &r] {
+            return column_points<ts_int64>{h, get_ranges_int64(h, attributions_table, itch::attribution_column, r)};
+        });
+    }
+
+    auto result = (schema == itch::orders_schema::compact) ? get_compact_orders_records(h, stock, first, last, timings)
+                                                            : get_legacy_orders_records(h, stock, first, last, timings);
+
+    if (attributions) join_attributions(pending_mpid.get(), result, timings);
+
+    return result;
+}
+
+inline itch::orders_schema get_orders_schema(const config & cfg) noexcept
+{
+    return (cfg.orders_schema == "compact") ? itch::orders_schema::compact : itch::orders_schema::legacy;
+}
+
+inline void print_fetch_timings(const fetch_timings & timings)
+{
+    for (const auto & c : timings.columns)
+    {
+        fmt::print(report_file, fmt::fg(fmt::color::cyan), "  {:>18}: {:>9L} us\n", c.first, c.second.count());
+    }
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "  {:>18}: {:>9L} us\n", "materialization", timings.materialization.count());
+}
+
+// The orders of a range, fetched in time slices. The next slice is requested as soon as the current one is handed out,
+// it is transferred while the current one is executed and no more than two slices are in memory at any time.
+// A slice of zero minutes is the whole range.
+class order_stream
+{
+public:
+    order_stream(qdb_handle_t h,
+        itch::orders_schema schema,
+        std::string stock,
+        utils::timespec first,
+        utils::timespec last,
+        std::chrono::minutes slice,
+        bool attributions = false)
+        : _handle{h}
+        , _schema{schema}
+        , _stock{std::move(stock)}
+        , _next{first}
+        , _last{last}
+        , _slice{slice}
+        , _attributions{attributions}
+    {
+        prefetch();
+    }
+
+    order_stream(const order_stream &) = delete;
+    order_stream & operator=(const order_stream &) = delete;
+
+    ~order_stream()
+    {
+        // the fetch in flight uses our members
+        if (_pending.valid()) _pending.wait();
+    }
+
+private:
+    void prefetch()
+    {
+        if (_next >= _last) return;
+
+        const auto first = _next;
+        const auto last  = (_slice.count() && (first + _slice < _last)) ? first + _slice : _last;
+
+        _next = last;
+
+        // the timings travel with the slice, the fetch only reads members that don't change
+        _pending = std::async(std::launch::async, [this, first, last] {
+            fetched_slice res;
+            res.orders = get_orders_records(_handle, _schema, _stock, first, last, &res.timings, _attributions);
+            return res;
+        });
+    }
+
+public:
+    // false once the range is exhausted
+    bool next(itch::order_batch & slice)
+    {
+        if (!_pending.valid()) return false;
+
+        const auto start_time = std::chrono::high_resolution_clock::now();
+
+        fetched_slice fetched = _pending.get();
+
+        slice = std::move(fetched.orders);
+        _timings.add(fetched.timings);
+
+        _waited += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+        _records += slice.size();
+        ++_slices;
+
+        prefetch();
+
+        return true;
+    }
+
+    // how long next() waited for the slices to arrive
+    std::chrono::microseconds waited() const noexcept
+    {
+        return _waited;
+    }
+
+    std::uint64_t records() const noexcept
+    {
+        return _records;
+    }
+
+    std::uint64_t slices() const noexcept
+    {
+        return _slices;
+    }
+
+    // the timings of the slices handed out so far
+    const fetch_timings & timings() const noexcept
+    {
+        return _timings;
+    }
+
+private:
+    struct fetched_slice
+    {
+        itch::order_batch orders;
+        fetch_timings timings;
+    };
+
+    qdb_handle_t _handle;
+    itch::orders_schema _schema;
+    std::string _stock;
+
+    utils::timespec _next;
+    utils::timespec _last;
+    std::chrono::minutes _slice;
+    bool _attributions;
+
+    fetch_timings _timings;
+    std::chrono::microseconds _waited{0};
+    std::uint64_t _records{0};
+    std::uint64_t _slices{0};
+
+    std::future<fetched_slice> _pending;
+};
+
+// the slices of the modes that replay a whole day or a gap of any size, when --stream-minutes isn't given
+static constexpr std::uint32_t default_slice_minutes = 5u;
+
+inline std::chrono::minutes get_slice(const config & cfg) noexcept
+{
+    return std::chrono::minutes{cfg.stream_minutes ? cfg.stream_minutes : default_slice_minutes};
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include "exec_books.hpp"
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "exec_snapshots.hpp"
+#include "itch_participants.hpp"
+#include "itch_publisher.hpp"
+#include "itch_snapshot_cache.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// query threads reading the published top of book while the engine runs
+class book_readers
+{
+public:
+    explicit book_readers(const itch::book_publisher & publisher, size_t count)
+    {
+        _threads.reserve(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            _threads.emplace_back([this, &publisher]() { read_loop(publisher); });
+        }
+    }
+
+    ~book_readers()
+    {
+        stop();
+    }
+
+private:
+    void read_loop(const itch::book_publisher & publisher)
+    {
+        itch::book_image image;
+        itch::read_metrics metrics;
+        std::uint64_t spread_sum = 0;
+
+        while (!_done.load(std::memory_order_acquire))
+        {
+            publisher.read(image, metrics);
+
+            if (image.buy_count && image.sell_count)
+            {
+                spread_sum += image.sell[0].price - image.buy[0].price;
+            }
+        }
+
+        // once per reader, the loop doesn't touch anything shared but the flag
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        _metrics += metrics;
+        // so that the reads aren't optimized away
+        _checksum += spread_sum;
+    }
+
+public:
+    void stop()
+    {
+        _done.store(true, std::memory_order_release);
+
+        for (auto & t : _threads)
+        {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    // the reads of all the readers, once they are stopped
+    itch::read_metrics metrics() const
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _metrics;
+    }
+
+private:
+    std::atomic<bool> _done{false};
+    std::vector<std::thread> _threads;
+
+    mutable std::mutex _mutex;
+    itch::read_metrics _metrics;
+    std::uint64_t _checksum{0};
+};
+
+inline void print_publication_metrics(std::uint64_t published, const itch::read_metrics & m, size_t readers)
+{
+    const double retry_rate = m.reads ? (100.0 * static_cast<double>(m.retries) / static_cast<double>(m.reads)) : 0.0;
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\nPublished {:L} images to {} readers - {:L} reads - {:L} retries ({:.3f}%)\n",
+        published, readers, m.reads, m.retries, retry_rate);
+}
+
+template <typename Engine>
+void run_point_in_time(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto [range_start_ts, range_end_ts] = get_time_range(cfg.when);
+
+    Engine engine;
+
+    std::unique_ptr<itch::book_publisher> publisher;
+    std::unique_ptr<book_readers> readers;
+
+    if (cfg.publishing.readers)
+    {
+        itch::publication_policy policy;
+
+        policy.messages = cfg.publishing.messages;
+        policy.interval = std::chrono::microseconds{cfg.publishing.us};
+
+        publisher = std::make_unique<itch::book_publisher>(get_levels(cfg, default_levels), policy);
+    }
+
+    // when a depth is requested only the best levels are maintained and shown
+    // the publisher needs them as well
+    engine.set_depth(publisher ? std::max(cfg.depth, publisher->levels()) : cfg.depth);
+
+    std::uint64_t missed_orders = 0;
+
+    snapshot_info snap;
+
+    std::unique_ptr<itch::snapshot_cache> cache;
+
+    itch::snapshot_directory directory;
+    const itch::snapshot_entry * snap_entry = nullptr;
+
+    // the participants are restored with the snapshot, and stored with the one taken on the way
+    itch::participant_book participants;
+    itch::participant_book * tracked_participants = cfg.attribution ? &participants : nullptr;
+
+    engine.set_participant_book(tracked_participants);
+
+    if (cfg.point_in_time)
+    {
+        if (!cfg.snapshots.cache.empty())
+        {
+            cache = std::make_unique<itch::snapshot_cache>(cfg.snapshots.cache, cfg.snapshots.cache_mb * 1024u * 1024u);
+        }
+
+        // look for a snapshot
+        snap_entry = find_snapshot(h, cfg.stock, range_end_ts, directory);
+    }
+
+    // as soon as we know where the replay starts, the first orders are fetched while the snapshot is restored
+    const auto orders_start = snap_entry ? snap_entry->timestamp : range_start_ts;
+    const auto slice        = std::chrono::minutes{cfg.stream_minutes};
+
+    auto stream = std::make_unique<order_stream>(h, get_orders_schema(cfg), cfg.stock, orders_start, range_end_ts, slice, cfg.attribution);
+
+    std::chrono::microseconds elapsed_restore{0};
+
+    if (snap_entry)
+    {
+        const auto restore_start_time = std::chrono::high_resolution_clock::now();
+
+        snap = restore_snapshot(h, engine, cfg.stock, directory, snap_entry, cache.get(), tracked_participants);
+
+        elapsed_restore =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - restore_start_time);
+    }
+
+    const auto snap_ts = snap.timestamp;
+
+    if (snap_ts != utils::timespec{})
+    {
+        fmt::print(report_file, "Used snapshot {}\n", utils::to_iso_extended_string_utc(static_cast<std::time_t>(snap_ts.sec.count())));
+
+        if (cache)
+        {
+            fmt::print(
+                report_file, "Snapshot cache: {} hits - {} stored - {} evicted\n", cache->hits(), cache->stores(), cache->evictions());
+        }
+    }
+    else if (snap_entry)
+    {
+        // the snapshot could not be restored, we need the orders from the start of the day
+        stream = std::make_unique<order_stream>(h, get_orders_schema(cfg), cfg.stock, range_start_ts, range_end_ts, slice, cfg.attribution);
+    }
+
+    itch::order_batch orders;
+
+    bool has_orders = stream->next(orders);
+
+    auto get_end_time = std::chrono::high_resolution_clock::now();
+
+    // from now on, waiting for a slice isn't execution
+    const auto first_slice_wait = stream->waited();
+
+    const auto replay = [&](size_t first, size_t last) {
+        if (publisher)
+        {
+            for (; first != last; ++first)
+            {
+                if (!engine.run_order(orders, first)) ++missed_orders;
+                publisher->on_message(engine, orders.timestamp(first));
+            }
+        }
+        else
+        {
+            missed_orders += engine.run_orders(orders, first, last);
+        }
+    };
+
+    if (publisher)
+    {
+        readers = std::make_unique<book_readers>(*publisher, cfg.publishing.readers);
+    }
+
+    // the snapshot must be the state of the book at its timestamp, not at the requested time
+    const auto snap_boundary = get_snapshot_timestamp(range_end_ts, cfg.snapshots.minutes);
+
+    bool snapshot_pending = cfg.point_in_time && (snap_ts < snap_boundary);
+
+    // the delta is made of what changed since the snapshot we restored
+    if (snapshot_pending) engine.track_changes(snap_ts != utils::timespec{});
+
+    const auto take_snapshot = [&]() {
+        const auto stored = store_snapshot(h, engine, cfg.stock, snap_boundary, snap, cfg, tracked_participants);
+        update_directory(h, cfg.stock, snap_boundary, {itch::snapshot_entry{stored.timestamp, stored.size, stored.checksum}});
+
+        engine.track_changes(false);
+        snapshot_pending = false;
+    };
+
+    for (; has_orders; has_orders = stream->next(orders))
+    {
+        size_t first = 0;
+
+        if (snapshot_pending)
+        {
+            const auto boundary = orders.lower_bound(snap_boundary);
+
+            replay(first, boundary);
+            first = boundary;
+
+            if (boundary != orders.size()) take_snapshot();
+        }
+
+        replay(first, orders.size());
+    }
+
+    // all the orders were before the boundary
+    if (snapshot_pending && stream->records()) take_snapshot();
+
+    if (publisher)
+    {
+        publisher->publish(engine, range_end_ts);
+        readers->stop();
+    }
+
+    auto engine_end_time = std::chrono::high_resolution_clock::now();
+
+    const book_view view = build_book_view(engine, cfg);
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "Order book for {} at {} \n", cfg.stock,
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(range_end_ts.sec.count())));
+    fmt::print(report_file, "Processed orders {:L} - missed orders {:L} - Point In Time: {}\n", stream->records(), missed_orders,
+        cfg.point_in_time ? "enabled" : "disabled");
+
+    book_writer{cfg}.write(view, cfg.stock, range_end_ts);
+
+    if (cfg.attribution) print_liquidity_shares(participants);
+
+    const auto slices_wait   = stream->waited() - first_slice_wait;
+    const auto elapsed_get   = std::chrono::duration_cast<std::chrono::microseconds>(get_end_time - total_start_time) + slices_wait;
+    const auto elapsed_run   = std::chrono::duration_cast<std::chrono::microseconds>(engine_end_time - get_end_time) - slices_wait;
+    const auto build_book    = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - engine_end_time);
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
+
+    if (stream->slices() > 1u)
+    {
+        // the transfer of a slice overlaps the execution of the previous one, only the waits are counted
+        fmt::print(report_file, fmt::fg(fmt::color::cyan), "      Data transfer: {:>9L} us ({} slices)\n", elapsed_get.count(),
+            stream->slices());
+    }
+    else
+    {
+        fmt::print(report_file, fmt::fg(fmt::color::cyan), "      Data transfer: {:>9L} us\n", elapsed_get.count());
+    }
+
+    print_fetch_timings(stream->timings());
+
+    if (snap_entry)
+    {
+        fmt::print(report_file, fmt::fg(fmt::color::cyan), "   Snapshot restore: {:>9L} us (overlapped)\n", elapsed_restore.count());
+    }
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "   Engine execution: {:>9L} us\n", elapsed_run.count());
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "      Book building: {:>9L} us\n", build_book.count());
+
+    if (publisher)
+    {
+        print_publication_metrics(publisher->published(), readers->metrics(), cfg.publishing.readers);
+    }
+}
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "itch_batch.hpp"
+#include <qdb/ts.h>
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/timespec.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+inline void create_table_if_missing(qdb_handle_t h, const std::string & table_name, const std::vector<qdb_ts_column_info_t> & columns)
+{
+    auto err = qdb_ts_create(h, table_name.c_str(), qdb_d_day, columns.data(), columns.size());
+    if (err == qdb_e_alias_already_exists) return;
+    throw_on_failure(err, "cannot create table");
+}
+
+inline void init_batch_table(qdb_handle_t h, const std::string & table_name, const std::vector<qdb_ts_column_info_t> & columns,
+    size_t rows_hint, qdb_batch_table_t * b)
+{
+    std::vector<qdb_ts_batch_column_info_t> batch_columns(columns.size());
+
+    for (size_t i = 0; i < columns.size(); ++i)
+    {
+        batch_columns[i].timeseries          = table_name.c_str();
+        batch_columns[i].column              = columns[i].name;
+        batch_columns[i].elements_count_hint = rows_hint;
+    }
+
+    throw_on_failure(qdb_ts_batch_table_init(h, batch_columns.data(), batch_columns.size(), b), "cannot create batch");
+}
+
+inline double convert_from_fix(std::uint32_t p) noexcept
+{
+    return static_cast<double>(p) / 1000.0;
+}
+
+// the columns of a time series table, in the order the rows set them
+class series_columns
+{
+public:
+    void add(std::string name, qdb_ts_column_type_t type)
+    {
+        _names.push_back(std::move(name));
+        _types.push_back(type);
+    }
+
+    // the infos point to the names, they are valid until the next add
+    std::vector<qdb_ts_column_info_t> infos() const
+    {
+        std::vector<qdb_ts_column_info_t> res(_names.size());
+
+        for (size_t i = 0; i < _names.size(); ++i)
+        {
+            res[i].name = _names[i].c_str();
+            res[i].type = _types[i];
+        }
+
+        return res;
+    }
+
+private:
+    std::vector<std::string> _names;
+    std::vector<qdb_ts_column_type_t> _types;
+};
+
+// a batch on a time series table, the table is created when missing
+// every row starts with its timestamp and sets all the columns, in order
+class series_batch
+{
+public:
+    series_batch(qdb_handle_t h, const std::string & table_name, const series_columns & columns, size_t rows_hint)
+        : _handle{h}
+    {
+        const auto infos = columns.infos();
+
+        create_table_if_missing(h, table_name, infos);
+        init_batch_table(h, table_name, infos, rows_hint, &_batch);
+    }
+
+    series_batch(series_batch && other) noexcept
+        : _handle{other._handle}
+        , _batch{std::exchange(other._batch, nullptr)}
+        , _index{other._index}
+        , _rows{other._rows}
+    {}
+
+    series_batch(const series_batch &) = delete;
+    series_batch & operator=(const series_batch &) = delete;
+    series_batch & operator=(series_batch &&) = delete;
+
+    ~series_batch()
+    {
+        if (_batch) qdb_release(_handle, _batch);
+    }
+
+    void start_row(const utils::timespec & timestamp)
+    {
+        const qdb_timespec_t ts = timestamp.as_timespec();
+
+        throw_on_failure(qdb_ts_batch_start_row(_batch, &ts), "cannot start new row");
+        _index = 0;
+
+        ++_rows;
+    }
+
+    void set_double(double v)
+    {
+        throw_on_failure(qdb_ts_batch_row_set_double(_batch, _index++, v), "cannot set column");
+    }
+
+    void set_int64(std::int64_t v)
+    {
+        throw_on_failure(qdb_ts_batch_row_set_int64(_batch, _index++, v), "cannot set column");
+    }
+
+    // a batch without rows isn't sent, that's a round trip saved
+    void push()
+    {
+        if (!_rows) return;
+
+        throw_on_failure(qdb_ts_batch_push(_batch), "cannot push batch");
+        _rows = 0;
+    }
+
+private:
+    qdb_handle_t _handle;
+    qdb_batch_table_t _batch{nullptr};
+    qdb_size_t _index{0};
+    // since the last push
+    size_t _rows{0};
+};
+
+// writes a whole series to the table, set_row(b, i) sets the columns of the i-th row
+template <typename Function>
+void write_series(qdb_handle_t h,
+    const std::string & table_name,
+    const series_columns & columns,
+    const std::vector<utils::timespec> & timestamps,
+    Function set_row)
+{
+    series_batch b{h, table_name, columns, timestamps.size()};
+
+    for (size_t i = 0; i < timestamps.size(); ++i)
+    {
+        b.start_row(timestamps[i]);
+        set_row(b, i);
+    }
+
+    b.push();
+}
+
+// what a replay of the day went through
+struct replay_result
+{
+    std::uint64_t orders{0};
+    std::uint64_t missed_orders{0};
+    std::chrono::microseconds waited{0};
+    fetch_timings timings;
+};
+
+// replays the day of the stock, a slice of --stream-minutes at a time
+// run(orders) executes a slice and returns the orders it missed
+template <typename Function>
+replay_result replay_day(qdb_handle_t h, const config & cfg, const std::string & stock, utils::timespec day_start, Function run)
+{
+    replay_result res;
+
+    const auto day_end = day_start + std::chrono::hours{24};
+
+    order_stream stream{h, get_orders_schema(cfg), stock, day_start, day_end, std::chrono::minutes{cfg.stream_minutes}};
+
+    itch::order_batch orders;
+
+    while (stream.next(orders))
+    {
+        res.missed_orders += run(orders);
+    }
+
+    res.orders  = stream.records();
+    res.waited  = stream.waited();
+    res.timings = stream.timings();
+
+    return res;
+}
+
+// replays the day and calls sample(t) at every point t of a grid aligned on the start of the day, once the orders before t are executed
+// the grid starts with the first order and ends with the first point after the last order
+template <typename Engine, typename Function>
+replay_result replay_day_on_grid(qdb_handle_t h,
+    const config & cfg,
+    const std::string & stock,
+    utils::timespec day_start,
+    Engine & engine,
+    std::chrono::nanoseconds step,
+    Function sample)
+{
+    bool started = false;
+    utils::timespec next_sample;
+
+    const auto run = [&](const itch::order_batch & orders) -> std::uint64_t {
+        if (orders.empty()) return 0;
+
+        if (!started)
+        {
+            // the first point of the grid at or after the first order
+            const auto since_day_start = std::chrono::nanoseconds{orders.timestamps.front() - itch::order_batch::to_nanoseconds(day_start)};
+
+            next_sample = day_start + ((since_day_start + step - std::chrono::nanoseconds{1}) / step) * step;
+            started     = true;
+        }
+
+        std::uint64_t missed_orders = 0;
+        size_t first                = 0;
+
+        for (;;)
+        {
+            const auto last = orders.lower_bound(next_sample);
+            if (last == orders.size()) break;
+
+            missed_orders += engine.run_orders(orders, first, last);
+            first = last;
+
+            sample(next_sample);
+            next_sample = next_sample + step;
+        }
+
+        return missed_orders + engine.run_orders(orders, first, orders.size());
+    };
+
+    auto res = replay_day(h, cfg, stock, day_start, run);
+
+    if (started) sample(next_sample);
+
+    return res;
+}
+
+// the total time of a mode and how long it waited for the orders
+inline void print_replay_timings(std::chrono::microseconds total_elapsed, const replay_result & replay)
+{
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "      Data transfer: {:>9L} us\n", replay.waited.count());
+    print_fetch_timings(replay.timings);
+}
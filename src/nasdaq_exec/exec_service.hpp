@@ -0,0 +1,264 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "exec_snapshots.hpp"
+#include "itch_protocol.hpp"
+#include "itch_snapshot_cache.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/endian/conversion.hpp>
+#include <boost/filesystem.hpp>
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/gregorian.hpp>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// the engines of the last queried stocks, with the time up to which they executed the orders
+// the least recently used engine is evicted to make room for a new stock
+template <typename Engine>
+class warm_engines
+{
+public:
+    struct entry
+    {
+        std::string stock;
+        // not a valid day until the engine has been positioned
+        utils::timespec day;
+        // every order before this time has been executed
+        utils::timespec time;
+        Engine engine;
+    };
+
+public:
+    explicit warm_engines(size_t capacity)
+        : _capacity{capacity}
+    {}
+
+    entry & get(const std::string & stock)
+    {
+        auto it = _index.find(stock);
+        if (it != _index.end())
+        {
+            _entries.splice(_entries.begin(), _entries, it->second);
+            return _entries.front();
+        }
+
+        if (_entries.size() >= _capacity)
+        {
+            _index.erase(_entries.back().stock);
+            _entries.pop_back();
+        }
+
+        _entries.emplace_front();
+        _entries.front().stock = stock;
+        _index.emplace(stock, _entries.begin());
+
+        return _entries.front();
+    }
+
+    size_t size() const noexcept
+    {
+        return _entries.size();
+    }
+
+private:
+    size_t _capacity;
+    std::list<entry> _entries;
+    robin_hood::unordered_map<std::string, typename std::list<entry>::iterator> _index;
+};
+
+// answers point in time queries on a local socket, see itch_protocol.hpp
+// a query at or after the time of the warm engine of the stock only replays the orders in between,
+// anything else restores the closest snapshot and replays from there
+template <typename Engine>
+class book_service
+{
+public:
+    book_service(qdb_handle_t h, const config & cfg)
+        : _handle{h}
+        , _cfg{cfg}
+        , _engines{cfg.service.warm_engines}
+    {
+        if (!cfg.snapshots.cache.empty())
+        {
+            _cache = std::make_unique<itch::snapshot_cache>(cfg.snapshots.cache, cfg.snapshots.cache_mb * 1024u * 1024u);
+        }
+    }
+
+private:
+    // the engine keeps the levels of the deepest query it can answer
+    size_t depth() const noexcept
+    {
+        return get_levels(_cfg, default_levels);
+    }
+
+    void position(typename warm_engines<Engine>::entry & e, utils::timespec day, utils::timespec when)
+    {
+        e.engine.clear();
+        e.engine.set_depth(depth());
+        e.engine.track_bbo(true);
+
+        e.day  = day;
+        e.time = position_engine(_handle, e.engine, e.stock, day, when, _cache.get());
+    }
+
+    itch::protocol::book_answer answer(const itch::protocol::book_query & q)
+    {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+
+        itch::protocol::book_answer res;
+
+        auto & e       = _engines.get(q.stock);
+        const auto day = utils::make_timespec(utils::extract_date(q.when));
+
+        res.warm = (e.day == day) && (e.time <= q.when);
+
+        // if anything below throws, the engine is in an unknown state and won't be reused
+        e.day = utils::timespec{};
+
+        if (!res.warm) position(e, day, q.when);
+
+        if (e.time < q.when)
+        {
+            // the gap may be the whole day when nothing was warm
+            order_stream stream{_handle, get_orders_schema(_cfg), e.stock, e.time, q.when, get_slice(_cfg)};
+            itch::order_batch orders;
+
+            while (stream.next(orders))
+            {
+                e.engine.run_orders(orders, 0, orders.size());
+            }
+
+            e.time = q.when;
+
+            res.replayed = stream.records();
+        }
+
+        e.day    = day;
+        res.time = e.time;
+
+        const size_t levels = q.depth ? std::min<size_t>(q.depth, depth()) : depth();
+
+        const auto & buy  = e.engine.buy_levels();
+        const auto & sell = e.engine.sell_levels();
+
+        res.buy.assign(buy.cbegin(), buy.cbegin() + static_cast<std::ptrdiff_t>(std::min(levels, buy.size())));
+        res.sell.assign(sell.cbegin(), sell.cbegin() + static_cast<std::ptrdiff_t>(std::min(levels, sell.size())));
+
+        res.elapsed_us = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time).count());
+
+        return res;
+    }
+
+    itch::protocol::book_answer answer(const std::uint8_t * p, size_t l)
+    {
+        itch::protocol::book_query q;
+        itch::protocol::book_answer res;
+
+        if (!itch::protocol::deserialize_query(p, l, q))
+        {
+            res.result = itch::protocol::status::bad_request;
+            return res;
+        }
+
+        // the engines aren't shared between queries
+        std::lock_guard<std::mutex> lock{_mutex};
+
+        try
+        {
+            return answer(q);
+        }
+        catch (const std::exception & ex)
+        {
+            fmt::print(report_file, fmt::fg(fmt::color::red), "Query {} at {} failed: {}\n", q.stock,
+                utils::to_iso_extended_string_utc(static_cast<std::time_t>(q.when.sec.count())), ex.what());
+        }
+
+        res.result = itch::protocol::status::failure;
+        return res;
+    }
+
+public:
+    // answers the queries of the connection until the client closes it
+    void serve(boost::asio::local::stream_protocol::socket socket)
+    {
+        std::vector<std::uint8_t> query;
+
+        try
+        {
+            for (;;)
+            {
+                std::uint32_t size = 0;
+                boost::asio::read(socket, boost::asio::buffer(&size, sizeof(size)));
+                size = boost::endian::little_to_native(size);
+
+                if (size > itch::protocol::max_query_size) return;
+
+                query.resize(size);
+                boost::asio::read(socket, boost::asio::buffer(query));
+
+                const auto answer_bytes = itch::protocol::serialize_answer(answer(query.data(), query.size()));
+                const auto answer_size  = boost::endian::native_to_little(static_cast<std::uint32_t>(answer_bytes.size()));
+
+                const std::array<boost::asio::const_buffer, 2> buffers{
+                    boost::asio::buffer(&answer_size, sizeof(answer_size)), boost::asio::buffer(answer_bytes)};
+
+                boost::asio::write(socket, buffers);
+            }
+        }
+        catch (const boost::system::system_error &)
+        {
+            // the client is gone
+        }
+    }
+
+private:
+    qdb_handle_t _handle;
+    const config & _cfg;
+
+    std::mutex _mutex;
+    warm_engines<Engine> _engines;
+    std::unique_ptr<itch::snapshot_cache> _cache;
+};
+
+// one thread per connection, the queries are executed one at a time
+template <typename Engine>
+void run_service(qdb_handle_t h, const config & cfg)
+{
+    boost::asio::io_context io;
+
+    // a previous instance may have left its socket behind
+    boost::system::error_code ec;
+    boost::filesystem::remove(cfg.service.socket, ec);
+
+    boost::asio::local::stream_protocol::acceptor acceptor{io, boost::asio::local::stream_protocol::endpoint{cfg.service.socket}};
+
+    book_service<Engine> service{h, cfg};
+
+    fmt::print(report_file, "Serving point in time queries on {} - {} warm engines\n", cfg.service.socket, cfg.service.warm_engines);
+
+    for (;;)
+    {
+        boost::asio::local::stream_protocol::socket socket{io};
+        acceptor.accept(socket);
+
+        std::thread{[&service](boost::asio::local::stream_protocol::socket s) { service.serve(std::move(s)); }, std::move(socket)}.detach();
+    }
+}
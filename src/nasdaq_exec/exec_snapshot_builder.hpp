@@ -0,0 +1,174 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "exec_snapshots.hpp"
+#include "itch_participants.hpp"
+#include "itch_snapshot.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <tbb/parallel_for.h>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct snapshot_builder_result
+{
+    std::uint64_t orders{0};
+    std::uint64_t missed_orders{0};
+    std::uint64_t full_snapshots{0};
+    std::uint64_t delta_snapshots{0};
+    std::chrono::microseconds elapsed{0};
+};
+
+// replays the day once and stores a snapshot at every boundary that saw orders since the previous one
+template <typename Engine>
+snapshot_builder_result build_day_snapshots(qdb_handle_t h, const config & cfg, const std::string & stock, utils::timespec day_start)
+{
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    snapshot_builder_result res;
+
+    const auto day_end = day_start + std::chrono::hours{24};
+
+    Engine engine;
+    engine.track_changes(true);
+
+    // with the attributions, every snapshot gets the participants, a query of the liquidity shares starts from it
+    itch::participant_book participants;
+    itch::participant_book * tracked_participants = cfg.attribution ? &participants : nullptr;
+
+    engine.set_participant_book(tracked_participants);
+
+    snapshot_info base;
+    std::vector<itch::snapshot_entry> entries;
+
+    const auto snapshot = [&](utils::timespec boundary) {
+        base = store_snapshot(h, engine, stock, boundary, base, cfg, tracked_participants);
+        engine.clear_changes();
+
+        entries.push_back(itch::snapshot_entry{base.timestamp, base.size, base.checksum});
+
+        if (base.chain)
+        {
+            ++res.delta_snapshots;
+        }
+        else
+        {
+            ++res.full_snapshots;
+        }
+    };
+
+    // the day arrives in slices, a slice never splits a timestamp
+    // a boundary always falls between orders of different timestamps as the replay resumes from the boundary
+    order_stream stream{h, get_orders_schema(cfg), stock, day_start, day_end, get_slice(cfg), cfg.attribution};
+    itch::order_batch orders;
+
+    // the snapshot is due once an order at or after due_at shows up, the orders before it are executed
+    std::optional<utils::timespec> due_at;
+
+    // the orders executed since the previous snapshot, and the last grid point passed
+    std::uint64_t since = 0;
+    auto grid           = day_start;
+
+    while (stream.next(orders))
+    {
+        for (size_t first = 0; first != orders.size();)
+        {
+            if (due_at && (orders.timestamp(first) >= *due_at))
+            {
+                // with a message count, the boundary is the first order after the cut
+                snapshot(cfg.snapshots.messages ? orders.timestamp(first) : *due_at);
+
+                due_at.reset();
+                since = 0;
+            }
+
+            size_t last = orders.size();
+
+            if (cfg.snapshots.messages)
+            {
+                // the cut is at the timestamp of the message after the count, when this slice has it
+                const auto count = cfg.snapshots.messages - since;
+                if (count < orders.size() - first)
+                {
+                    const auto nth = orders.timestamp(first + static_cast<size_t>(count));
+
+                    last = orders.lower_bound(nth);
+                    if ((last == first) && !since) last = orders.upper_bound(nth);
+
+                    // the rest of the slice shares the timestamp, the next slice starts after it
+                    due_at = (last != orders.size()) ? orders.timestamp(last) : nth + std::chrono::nanoseconds{1};
+                }
+            }
+            else if (!due_at)
+            {
+                // nothing happened during an interval, the previous snapshot is as good
+                while (grid <= orders.timestamp(first))
+                {
+                    grid = grid + std::chrono::minutes{cfg.snapshots.minutes};
+                }
+
+                if (grid <= day_end) due_at = grid;
+            }
+
+            if (!cfg.snapshots.messages && due_at) last = orders.lower_bound(*due_at);
+
+            res.missed_orders += engine.run_orders(orders, first, last);
+
+            since += last - first;
+            first = last;
+        }
+    }
+
+    // the last interval ends without an order after it, unlike a message count
+    if (!cfg.snapshots.messages && due_at) snapshot(*due_at);
+
+    res.orders = stream.records();
+
+    update_directory(h, stock, day_start, entries);
+
+    res.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+
+    return res;
+}
+
+// writes the snapshots of the whole day for every stock, in parallel
+// after this, a point in time query replays at most one snapshot interval, or snapshot_messages messages
+template <typename Engine>
+void run_snapshot_builder(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto day_start = get_time_range(cfg.when).first;
+    const auto stocks    = split_list(cfg.stock);
+
+    std::vector<snapshot_builder_result> results(stocks.size());
+
+    tbb::parallel_for(size_t{0}, stocks.size(), [&](size_t i) { results[i] = build_day_snapshots<Engine>(h, cfg, stocks[i], day_start); });
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    const auto spacing =
+        cfg.snapshots.messages ? fmt::format("{:L} messages", cfg.snapshots.messages) : fmt::format("{} minutes", cfg.snapshots.minutes);
+
+    fmt::print(report_file, "Snapshots for {} stocks on {}, every {}{}\n", stocks.size(),
+        utils::to_iso_extended_string_utc(static_cast<std::time_t>(day_start.sec.count())), spacing,
+        cfg.attribution ? ", with the participants" : "");
+
+    for (size_t i = 0; i < stocks.size(); ++i)
+    {
+        const auto & r = results[i];
+        fmt::print(report_file, "{:>8} - orders {:>12L} - missed {:>8L} - full {:>4L} - delta {:>4L} - {:>9L} us\n", stocks[i], r.orders,
+            r.missed_orders, r.full_snapshots, r.delta_snapshots, r.elapsed.count());
+    }
+
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
+}
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "itch_participants.hpp"
+#include "itch_snapshot.hpp"
+#include "itch_snapshot_cache.hpp"
+#include <qdb/blob.h>
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/crc32c.hpp>
+#include <utils/file_mapping.hpp>
+#include <utils/gregorian.hpp>
+#include <utils/stringify.hpp>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+inline utils::timespec get_snapshot_timestamp(utils::timespec when, std::uint32_t minutes) noexcept
+{
+    when.sec  = when.sec - (when.sec % std::chrono::minutes{minutes});
+    when.nsec = std::chrono::nanoseconds{};
+    return when;
+}
+
+// the key of the snapshot taken at when, keys sort like their timestamps
+// boundaries placed by message count aren't on a second, they get the nanoseconds as a fraction
+inline std::string make_snapshot_key(const std::string & stock, utils::timespec when)
+{
+    const auto iso = utils::to_iso_extended_string_utc(static_cast<std::time_t>(when.sec.count()));
+
+    if (when.nsec.count()) return fmt::format("{}_orders_snap_{}.{:09}", stock, iso, when.nsec.count());
+    return fmt::format("{}_orders_snap_{}", stock, iso);
+}
+
+// the participants of the snapshot taken at when, stored next to it when the liquidity shares are tracked
+inline std::string make_participants_key(const std::string & stock, utils::timespec when)
+{
+    return make_snapshot_key(stock, when) + "_participants";
+}
+
+inline std::string make_directory_key(const std::string & stock, utils::timespec when)
+{
+    const auto day = utils::extract_date(when);
+    return fmt::format("{}_orders_snapdir_{:04}-{:02}-{:02}", stock, static_cast<int>(day.year()), static_cast<int>(day.month()),
+        static_cast<int>(day.day()));
+}
+
+// the snapshot the engine was restored from
+struct snapshot_info
+{
+    utils::timespec timestamp;
+
+    // number of deltas since the last full snapshot
+    std::uint16_t chain{0};
+
+    // of the blob
+    std::uint64_t size{0};
+    std::uint32_t checksum{0};
+};
+
+// a snapshot blob as returned by quasardb, released on destruction, or mapped from the local cache
+class snapshot_blob
+{
+public:
+    explicit snapshot_blob(std::shared_ptr<const utils::file_mapping> mapping)
+        : _handle{nullptr}
+        , _mapping{std::move(mapping)}
+    {
+        const auto v = _mapping->view();
+
+        _data = v.first;
+        _size = v.second;
+    }
+
+    snapshot_blob(qdb_handle_t h, const std::string & key)
+        : _handle{h}
+    {
+        auto err = qdb_blob_get(h, key.c_str(), &_data, &_size);
+        if (err == qdb_e_alias_not_found) return;
+        throw_on_failure(err, "cannot get snapshot");
+    }
+
+    snapshot_blob(const snapshot_blob &) = delete;
+    snapshot_blob & operator=(const snapshot_blob &) = delete;
+
+    ~snapshot_blob()
+    {
+        if (_data && !_mapping) qdb_release(_handle, _data);
+    }
+
+public:
+    bool empty() const noexcept
+    {
+        return !_data;
+    }
+
+    const std::uint8_t * data() const noexcept
+    {
+        return static_cast<const std::uint8_t *>(_data);
+    }
+
+    size_t size() const noexcept
+    {
+        return static_cast<size_t>(_size);
+    }
+
+private:
+    qdb_handle_t _handle;
+    std::shared_ptr<const utils::file_mapping> _mapping;
+    const void * _data{nullptr};
+    qdb_size_t _size{0};
+};
+
+// gets the snapshot from the cache when it has the expected version, otherwise from quasardb and caches it
+// entry may be null when the directory doesn't know the snapshot, the cache is then bypassed
+inline std::unique_ptr<snapshot_blob> fetch_snapshot(
+    qdb_handle_t h, itch::snapshot_cache * cache, const std::string & key, const itch::snapshot_entry * entry)
+{
+    if (!cache || !entry) return std::make_unique<snapshot_blob>(h, key);
+
+    if (auto mapping = cache->get(key, *entry))
+    {
+        return std::make_unique<snapshot_blob>(std::move(mapping));
+    }
+
+    auto blob = std::make_unique<snapshot_blob>(h, key);
+
+    if (!blob->empty() && (blob->size() == entry->size) && (utils::crc32c(blob->data(), blob->size()) == entry->checksum))
+    {
+        cache->put(key, blob->data(), blob->size());
+    }
+
+    return blob;
+}
+
+inline bool load_directory(qdb_handle_t h, const std::string & key, itch::snapshot_directory & directory)
+{
+    snapshot_blob blob{h, key};
+    if (blob.empty()) return false;
+
+    if (!directory.deserialize(blob.data(), blob.size()))
+    {
+        fmt::print(report_file, fmt::fg(fmt::color::red), "Snapshot directory {} is corrupted, ignored\n", key);
+        directory = itch::snapshot_directory{};
+    }
+
+    return true;
+}
+
+// adds the snapshots to the directory of the day with a compare and swap
+// several queries may store snapshots of the same stock at the same time, we retry until our version is the one written
+inline void update_directory(
+    qdb_handle_t h, const std::string & stock, utils::timespec day, const std::vector<itch::snapshot_entry> & entries)
+{
+    if (entries.empty()) return;
+
+    const auto key = make_directory_key(stock, day);
+
+    for (;;)
+    {
+        snapshot_blob current{h, key};
+
+        itch::snapshot_directory directory;
+        if (!current.empty() && !directory.deserialize(current.data(), current.size()))
+        {
+            // we'd rather lose the snapshots of a corrupted directory than never be able to update it again
+            directory = itch::snapshot_directory{};
+        }
+
+        for (const auto & e : entries)
+        {
+            directory.insert(e);
+        }
+
+        const std::vector<std::uint8_t> updated = directory.serialize();
+
+        if (current.empty())
+        {
+            auto err = qdb_blob_put(h, key.c_str(), updated.data(), updated.size(), qdb_never_expires);
+            if (err == qdb_e_alias_already_exists) continue;
+            throw_on_failure(err, "cannot create snapshot directory");
+            return;
+        }
+
+        const void * original     = nullptr;
+        qdb_size_t original_size = 0;
+
+        auto err = qdb_blob_compare_and_swap(h, key.c_str(), updated.data(), updated.size(), current.data(), current.size(),
+            qdb_never_expires, &original, &original_size);
+        if (original) qdb_release(h, original);
+
+        if (err == qdb_e_unmatched_content) continue;
+        throw_on_failure(err, "cannot update snapshot directory");
+        return;
+    }
+}
+
+// the closest snapshot at or before when, nullptr if there is none
+inline const itch::snapshot_entry * find_snapshot(
+    qdb_handle_t h, const std::string & stock, utils::timespec when, itch::snapshot_directory & directory)
+{
+    if (!load_directory(h, make_directory_key(stock, when), directory)) return nullptr;
+    return directory.find(when);
+}
+
+// false when the snapshot was stored without its participants, or when they are corrupted, the book is then empty
+inline bool restore_participants(qdb_handle_t h, itch::participant_book & participants, const std::string & stock, utils::timespec when)
+{
+    const auto key = make_participants_key(stock, when);
+
+    snapshot_blob blob{h, key};
+    if (blob.empty())
+    {
+        participants.clear();
+        return false;
+    }
+
+    if (participants.deserialize(blob.data(), blob.size())) return true;
+
+    fmt::print(report_file, fmt::fg(fmt::color::red), "Snapshot participants {} are corrupted, ignored\n", key);
+    return false;
+}
+
+// restores the engine from a snapshot of the directory
+// a delta snapshot is applied on top of its base, we walk the chain back to the full snapshot
+// and then apply everything from the oldest to the newest
+// with participants, a snapshot stored without them isn't restored, the liquidity shares need the whole day then
+template <typename Engine>
+snapshot_info restore_snapshot(qdb_handle_t h,
+    Engine & engine,
+    const std::string & stock,
+    const itch::snapshot_directory & directory,
+    const itch::snapshot_entry * entry,
+    itch::snapshot_cache * cache = nullptr,
+    itch::participant_book * participants = nullptr)
+{
+    const auto boundary = entry->timestamp;
+    const auto snap_key = make_snapshot_key(stock, boundary);
+
+    // newest first
+    std::vector<std::unique_ptr<snapshot_blob>> chain;
+
+    const itch::snapshot_entry * key_entry = entry;
+
+    // the chain of the blob read before, every base is one delta closer to the full snapshot
+    std::uint32_t previous_chain = 0;
+
+    for (auto key = snap_key;;)
+    {
+        auto blob = fetch_snapshot(h, cache, key, key_entry);
+        if (blob->empty()) return snapshot_info{};
+
+        const std::uint8_t * p = blob->data();
+        size_t l               = blob->size();
+
+        itch::snapshot_header header;
+        const bool has_header = itch::deserialize_snapshot_header(p, l, header);
+
+        if (!itch::verify_snapshot(header, p, l))
+        {
+            fmt::print(report_file, fmt::fg(fmt::color::red), "Snapshot {} is corrupted, ignored\n", key);
+            return snapshot_info{};
+        }
+
+        chain.push_back(std::move(blob));
+
+        // snapshots without a header are full snapshots
+        const bool is_full             = !has_header || (header.kind == itch::snapshot_kind::full);
+        const std::uint32_t blob_chain = is_full ? 0u : header.chain;
+
+        // a broken chain, we'd rather replay from the start of the day
+        if ((chain.size() > 1u) && (blob_chain + 1u != previous_chain)) return snapshot_info{};
+        if (!is_full && !blob_chain) return snapshot_info{};
+
+        if (is_full) break;
+
+        previous_chain = blob_chain;
+
+        key = make_snapshot_key(stock, header.base);
+
+        key_entry = directory.find(header.base);
+        if (key_entry && (key_entry->timestamp != header.base)) key_entry = nullptr;
+    }
+
+    bool restored = true;
+
+    for (size_t i = chain.size(); restored && i > 0; --i)
+    {
+        const std::uint8_t * p = chain[i - 1u]->data();
+        size_t l               = chain[i - 1u]->size();
+
+        itch::snapshot_header header;
+        itch::deserialize_snapshot_header(p, l, header);
+
+        restored = (i == chain.size()) ? engine.deserialize_state(p, l, header.version, header.layout)
+                                       : engine.apply_changes(p, l, header.version);
+    }
+
+    if (restored && participants) restored = restore_participants(h, *participants, stock, boundary);
+
+    if (!restored)
+    {
+        // don't leave a half restored book behind
+        engine.clear();
+        return snapshot_info{};
+    }
+
+    snapshot_info res;
+
+    res.timestamp = boundary;
+    res.chain     = static_cast<std::uint16_t>(chain.size() - 1u);
+    res.size      = entry->size;
+    res.checksum  = entry->checksum;
+
+    return res;
+}
+
+// stores a delta snapshot when the engine tracked its changes since the base snapshot and the chain isn't too long,
+// otherwise a full snapshot, returns what was stored
+// the participants, when given, are stored in full next to it
+// the snapshot isn't visible to queries until it is added to the directory of the day
+template <typename Engine>
+snapshot_info store_snapshot(qdb_handle_t h,
+    const Engine & engine,
+    const std::string & stock,
+    utils::timespec when,
+    const snapshot_info & base,
+    const config & cfg,
+    const itch::participant_book * participants = nullptr)
+{
+    itch::snapshot_header header;
+
+    // full snapshots only, the image layout needs the direct store
+    header.layout = (cfg.snapshots.layout == "image") ? itch::snapshot_layout::image : itch::snapshot_layout::compact;
+
+    if (engine.tracks_changes() && (base.timestamp != utils::timespec{}) && (base.chain + 1u < cfg.snapshots.full_every))
+    {
+        header.kind  = itch::snapshot_kind::delta;
+        header.chain = static_cast<std::uint16_t>(base.chain + 1u);
+        header.base  = base.timestamp;
+    }
+
+    const auto snap_key                       = make_snapshot_key(stock, when);
+    std::vector<std::uint8_t> serialized_snap = itch::make_snapshot(engine, header);
+    auto err = qdb_blob_update(h, snap_key.data(), serialized_snap.data(), serialized_snap.size(), qdb_never_expires);
+    throw_on_failure(err, "cannot store snapshot");
+
+    if (participants)
+    {
+        const auto participants_key                             = make_participants_key(stock, when);
+        const std::vector<std::uint8_t> serialized_participants = participants->serialize();
+
+        err = qdb_blob_update(
+            h, participants_key.data(), serialized_participants.data(), serialized_participants.size(), qdb_never_expires);
+        throw_on_failure(err, "cannot store snapshot participants");
+    }
+
+    snapshot_info res;
+
+    res.timestamp = when;
+    res.chain     = header.chain;
+    res.size      = serialized_snap.size();
+    res.checksum  = utils::crc32c(serialized_snap.data(), serialized_snap.size());
+
+    return res;
+}
+
+// empties the engine and restores the closest snapshot at or before when
+// returns the time up to which the orders have been executed, the start of the day without a snapshot
+template <typename Engine>
+utils::timespec position_engine(
+    qdb_handle_t h, Engine & engine, const std::string & stock, utils::timespec day, utils::timespec when, itch::snapshot_cache * cache)
+{
+    engine.clear();
+
+    itch::snapshot_directory directory;
+
+    const itch::snapshot_entry * snap_entry = find_snapshot(h, stock, when, directory);
+    if (!snap_entry) return day;
+
+    const auto snap = restore_snapshot(h, engine, stock, directory, snap_entry, cache);
+    if (snap.timestamp != utils::timespec{}) return snap.timestamp;
+
+    // a failed restore may leave part of the snapshot behind
+    engine.clear();
+    return day;
+}
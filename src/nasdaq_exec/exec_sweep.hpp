@@ -0,0 +1,202 @@
+#pragma once
+
+#include "exec_books.hpp"
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "exec_snapshots.hpp"
+#include "itch_participants.hpp"
+#include "itch_snapshot_cache.hpp"
+#include <fmt/color.h>
+#include <fmt/format.h>
+#include <utils/gregorian.hpp>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// several instants are given as a list of times, or as a start time and a --until time
+inline bool is_sweep(const config & cfg)
+{
+    return (cfg.when.find(',') != std::string::npos) || !cfg.until.empty();
+}
+
+// sorted and unique, all in the same day as the orders tables are daily
+inline std::vector<utils::timespec> get_instants(const config & cfg)
+{
+    std::vector<utils::timespec> res;
+
+    for (const auto & when : split_list(cfg.when))
+    {
+        res.push_back(get_time_range(when).second);
+    }
+
+    if (!cfg.until.empty())
+    {
+        if (res.size() != 1u) throw std::runtime_error("a range of instants needs a single start time");
+
+        const auto last = get_time_range(cfg.until).second;
+        const auto step = std::chrono::seconds{cfg.every_seconds};
+
+        for (auto t = res.front() + step; t <= last; t = t + step)
+        {
+            res.push_back(t);
+        }
+    }
+
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+
+    if (res.empty()) throw std::runtime_error("please specify a point in time");
+
+    if (utils::extract_date(res.front()) != utils::extract_date(res.back()))
+    {
+        throw std::runtime_error("the instants must be in the same day");
+    }
+
+    return res;
+}
+
+// the books at several instants of the same day from a single replay
+// the replay starts from the snapshot before the first instant and the book is built every time an instant is crossed
+template <typename Engine>
+void run_sweep(qdb_handle_t h, const config & cfg)
+{
+    auto total_start_time = std::chrono::high_resolution_clock::now();
+
+    const auto instants  = get_instants(cfg);
+    const auto day_start = utils::make_timespec(utils::extract_date(instants.front()));
+
+    Engine engine;
+    engine.set_depth(cfg.depth);
+
+    // the liquidity shares of every instant, without replaying the day when the snapshot has the participants
+    itch::participant_book participants;
+    itch::participant_book * tracked_participants = cfg.attribution ? &participants : nullptr;
+
+    engine.set_participant_book(tracked_participants);
+
+    std::unique_ptr<itch::snapshot_cache> cache;
+
+    itch::snapshot_directory directory;
+    const itch::snapshot_entry * snap_entry = nullptr;
+
+    if (cfg.point_in_time)
+    {
+        if (!cfg.snapshots.cache.empty())
+        {
+            cache = std::make_unique<itch::snapshot_cache>(cfg.snapshots.cache, cfg.snapshots.cache_mb * 1024u * 1024u);
+        }
+
+        snap_entry = find_snapshot(h, cfg.stock, instants.front(), directory);
+    }
+
+    const auto schema = get_orders_schema(cfg);
+    const auto slice  = std::chrono::minutes{cfg.stream_minutes};
+
+    const auto orders_start = snap_entry ? snap_entry->timestamp : day_start;
+
+    auto stream = std::make_unique<order_stream>(h, schema, cfg.stock, orders_start, instants.back(), slice, cfg.attribution);
+
+    std::chrono::microseconds elapsed_restore{0};
+
+    if (snap_entry)
+    {
+        const auto restore_start_time = std::chrono::high_resolution_clock::now();
+
+        const auto snap = restore_snapshot(h, engine, cfg.stock, directory, snap_entry, cache.get(), tracked_participants);
+
+        elapsed_restore =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - restore_start_time);
+
+        if (snap.timestamp != utils::timespec{})
+        {
+            fmt::print(report_file, "Used snapshot {}\n",
+                utils::to_iso_extended_string_utc(static_cast<std::time_t>(snap.timestamp.sec.count())));
+        }
+        else
+        {
+            // the snapshot could not be restored, we need the orders from the start of the day
+            stream = std::make_unique<order_stream>(h, schema, cfg.stock, day_start, instants.back(), slice, cfg.attribution);
+        }
+    }
+
+    std::uint64_t missed_orders = 0;
+
+    std::chrono::microseconds elapsed_run{0};
+    std::chrono::microseconds elapsed_books{0};
+
+    const auto replay = [&](const itch::order_batch & orders, size_t first, size_t last) {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        missed_orders += engine.run_orders(orders, first, last);
+        elapsed_run += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+    };
+
+    book_writer writer{cfg};
+
+    // every order before the instant has been executed
+    const auto emit = [&](utils::timespec instant) {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        const book_view view  = build_book_view(engine, cfg);
+        elapsed_books += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start_time);
+
+        fmt::print(report_file, "\nOrder book for {} at {} \n", cfg.stock,
+            utils::to_iso_extended_string_utc(static_cast<std::time_t>(instant.sec.count())));
+        writer.write(view, cfg.stock, instant);
+
+        if (tracked_participants) print_liquidity_shares(participants);
+    };
+
+    itch::order_batch orders;
+    size_t next_instant = 0;
+
+    while (stream->next(orders))
+    {
+        size_t first = 0;
+
+        // the orders of the following slices are all after this one's
+        for (; next_instant < instants.size(); ++next_instant)
+        {
+            const auto last = orders.lower_bound(instants[next_instant]);
+            if (last == orders.size()) break;
+
+            replay(orders, first, last);
+            first = last;
+
+            emit(instants[next_instant]);
+        }
+
+        replay(orders, first, orders.size());
+    }
+
+    // no order after these
+    for (; next_instant < instants.size(); ++next_instant)
+    {
+        emit(instants[next_instant]);
+    }
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+
+    fmt::print(report_file, "\nSweep of {} instants for {} - processed orders {:L} - missed orders {:L}\n", instants.size(), cfg.stock,
+        stream->records(), missed_orders);
+
+    const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "      Data transfer: {:>9L} us waited ({} slices)\n", stream->waited().count(),
+        stream->slices());
+    print_fetch_timings(stream->timings());
+
+    if (snap_entry)
+    {
+        fmt::print(report_file, fmt::fg(fmt::color::cyan), "   Snapshot restore: {:>9L} us (overlapped)\n", elapsed_restore.count());
+    }
+
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "   Engine execution: {:>9L} us\n", elapsed_run.count());
+    fmt::print(report_file, fmt::fg(fmt::color::cyan), "      Book building: {:>9L} us\n", elapsed_books.count());
+}
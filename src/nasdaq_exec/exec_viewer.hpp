@@ -0,0 +1,456 @@
+#pragma once
+
+#include "exec_config.hpp"
+#include "exec_orders.hpp"
+#include "exec_series.hpp"
+#include "exec_snapshots.hpp"
+#include "itch_depth.hpp"
+#include "itch_executions.hpp"
+#include "itch_snapshot_cache.hpp"
+#include <boost/circular_buffer.hpp>
+#include <fmt/format.h>
+#include <rxterm/style.hpp>
+#include <rxterm/utils.hpp>
+#include <utils/stringify.hpp>
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <termios.h>
+#include <unistd.h>
+
+// the keyboard of the viewer, without echo and without waiting for a new line, restored on destruction
+class raw_keyboard
+{
+public:
+    raw_keyboard()
+    {
+        if (!::isatty(STDIN_FILENO) || (::tcgetattr(STDIN_FILENO, &_saved) != 0))
+        {
+            throw std::runtime_error("the viewer needs a terminal");
+        }
+
+        termios raw = _saved;
+
+        raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO);
+        raw.c_cc[VMIN]  = 0;
+        raw.c_cc[VTIME] = 0;
+
+        ::tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    raw_keyboard(const raw_keyboard &) = delete;
+    raw_keyboard & operator=(const raw_keyboard &) = delete;
+
+    ~raw_keyboard()
+    {
+        ::tcsetattr(STDIN_FILENO, TCSANOW, &_saved);
+    }
+
+    // 0 when no key is waiting, the right and left arrows are returned as 'f' and 'b'
+    char read_key()
+    {
+        char c = 0;
+        if (::read(STDIN_FILENO, &c, 1) != 1) return 0;
+        if (c != '\x1b') return c;
+
+        // an arrow is ESC [ C or ESC [ D
+        std::array<char, 2> seq{0, 0};
+        if ((::read(STDIN_FILENO, seq.data(), seq.size()) != 2) || (seq[0] != '[')) return 0;
+
+        return (seq[1] == 'C') ? 'f' : ((seq[1] == 'D') ? 'b' : 0);
+    }
+
+private:
+    termios _saved;
+};
+
+// the rows of the viewer as they are on the terminal
+// a frame only writes the rows whose text or style changed, all of them with a single write
+class book_screen
+{
+public:
+    explicit book_screen(size_t rows)
+        : _rows(rows)
+    {
+        // hide the cursor and clear the screen
+        fmt::format_to(_buffer, "\x1b[?25l\x1b[2J");
+        flush();
+    }
+
+    book_screen(const book_screen &) = delete;
+    book_screen & operator=(const book_screen &) = delete;
+
+    ~book_screen()
+    {
+        // the cursor is shown again below the last row
+        fmt::format_to(_buffer, "{}\x1b[{};1H\x1b[?25h", _reset, _rows.size() + 1u);
+        flush();
+    }
+
+    void set(size_t row, const std::string & style, std::string text)
+    {
+        auto & r = _rows[row];
+        if ((r.style == &style) && (r.text == text)) return;
+
+        fmt::format_to(_buffer, "\x1b[{};1H{}{}{}{}", row + 1u, style, text, _reset, erase_to_line_end);
+
+        r.style = &style;
+        r.text  = std::move(text);
+    }
+
+    void flush()
+    {
+        if (!_buffer.size()) return;
+
+        std::fwrite(_buffer.data(), 1, _buffer.size(), stdout);
+        std::fflush(stdout);
+
+        _buffer.clear();
+    }
+
+private:
+    struct row
+    {
+        const std::string * style{nullptr};
+        std::string text;
+    };
+
+    std::vector<row> _rows;
+    fmt::memory_buffer _buffer;
+
+    const std::string _reset = rxterm::turnOffCharAttributes();
+
+    // CSI 0K, erases from the cursor to the end of the line
+    static constexpr const char * erase_to_line_end = "\x1b[0K";
+};
+
+// replays the day of a stock for the viewer, up to the requested time
+// going back, or forward past a snapshot, restores the closest snapshot and replays from there
+template <typename Engine>
+class book_player
+{
+public:
+    book_player(qdb_handle_t h, const config & cfg, utils::timespec day)
+        : _handle{h}
+        , _cfg{cfg}
+        , _day{day}
+        , _day_end{day + std::chrono::hours{24}}
+        , _time{day}
+    {
+        if (!cfg.snapshots.cache.empty())
+        {
+            _cache = std::make_unique<itch::snapshot_cache>(cfg.snapshots.cache, cfg.snapshots.cache_mb * 1024u * 1024u);
+        }
+
+        _engine.set_depth(levels());
+        _engine.track_bbo(true);
+        _engine.set_execution_log(&_executions);
+    }
+
+    book_player(const book_player &) = delete;
+    book_player & operator=(const book_player &) = delete;
+
+    ~book_player()
+    {
+        _engine.set_execution_log(nullptr);
+    }
+
+private:
+    void reposition(utils::timespec when)
+    {
+        // waits for the fetch in flight
+        _stream.reset();
+
+        _time = position_engine(_handle, _engine, _cfg.stock, _day, when, _cache.get());
+
+        // a slice is on screen for a while at any speed, the next one has the time to arrive
+        _stream    = std::make_unique<order_stream>(_handle, get_orders_schema(_cfg), _cfg.stock, _time, _day_end, get_slice(_cfg));
+        _exhausted = false;
+        _next      = 0;
+
+        _orders.clear();
+    }
+
+public:
+    // executes the orders up to when, the end of the day at most
+    void advance(utils::timespec when)
+    {
+        if (!_stream) return;
+
+        when = std::min(when, _day_end);
+
+        while (!_exhausted)
+        {
+            if (_next == _orders.size())
+            {
+                _exhausted = !_stream->next(_orders);
+                _next      = 0;
+                continue;
+            }
+
+            const size_t last = std::max(_next, _orders.upper_bound(when));
+
+            _missed += _engine.run_orders(_orders, _next, last);
+            _next = last;
+
+            if (_next != _orders.size()) break;
+        }
+
+        _time = std::max(_time, when);
+    }
+
+    void seek(utils::timespec when)
+    {
+        when = std::min(std::max(when, _day), _day_end);
+
+        if (_stream && (_time <= when))
+        {
+            itch::snapshot_directory directory;
+            const itch::snapshot_entry * snap_entry = find_snapshot(_handle, _cfg.stock, when, directory);
+
+            // replaying the gap is cheaper than restoring a snapshot we already passed
+            if (!snap_entry || (snap_entry->timestamp <= _time)) return advance(when);
+        }
+
+        reposition(when);
+        advance(when);
+    }
+
+    size_t levels() const noexcept
+    {
+        return get_levels(_cfg, default_levels);
+    }
+
+    const Engine & engine() const noexcept
+    {
+        return _engine;
+    }
+
+    // the executions since the log was last cleared
+    itch::execution_log & executions() noexcept
+    {
+        return _executions;
+    }
+
+    utils::timespec time() const noexcept
+    {
+        return _time;
+    }
+
+    // every order of the day has been executed
+    bool done() const noexcept
+    {
+        return _exhausted;
+    }
+
+    std::uint64_t missed() const noexcept
+    {
+        return _missed;
+    }
+
+private:
+    qdb_handle_t _handle;
+    const config & _cfg;
+
+    utils::timespec _day;
+    utils::timespec _day_end;
+    // every order up to this time has been executed
+    utils::timespec _time;
+
+    Engine _engine;
+    itch::execution_log _executions;
+    std::unique_ptr<itch::snapshot_cache> _cache;
+
+    std::unique_ptr<order_stream> _stream;
+    itch::order_batch _orders;
+    size_t _next{0};
+    bool _exhausted{false};
+
+    std::uint64_t _missed{0};
+};
+
+inline std::string format_viewer_time(utils::timespec t)
+{
+    return fmt::format(
+        "{}.{:03}", utils::to_iso_extended_string_utc(static_cast<std::time_t>(t.sec.count())), t.nsec.count() / 1'000'000);
+}
+
+inline bool same_level(const itch::price_level & left, const itch::price_level & right) noexcept
+{
+    return (left.price == right.price) && (left.shares == right.shares) && (left.orders == right.orders);
+}
+
+// replays the day of the stock in the terminal from --when, --speed times faster than it happened, --fps frames per second
+// space pauses, + and - double or halve the speed, the arrows seek one minute back or forward and q quits
+//
+// the best levels are maintained by the engine, a frame compares them to the levels on screen and only formats and
+// writes the rows that changed, the cost of a frame doesn't depend on the size of the book
+template <typename Engine>
+void run_viewer(qdb_handle_t h, const config & cfg)
+{
+    static constexpr size_t execution_rows = 10u;
+
+    const auto [day_start, start] = get_time_range(cfg.when);
+
+    book_player<Engine> player{h, cfg, day_start};
+
+    const size_t levels = player.levels();
+
+    // title, bbo, an empty row, the sells from the worst to the best, the buys from the best to the worst,
+    // an empty row, the last executions, an empty row and the keys
+    const size_t sell_title_row      = 3u;
+    const size_t buy_title_row       = sell_title_row + levels + 1u;
+    const size_t execution_title_row = buy_title_row + levels + 2u;
+    const size_t help_row            = execution_title_row + execution_rows + 2u;
+
+    const std::string title_style = rxterm::Style{rxterm::FontColor::Cyan}.toString();
+    const std::string sell_style  = rxterm::Style{rxterm::FontColor::Yellow}.toString();
+    const std::string buy_style   = rxterm::Style{rxterm::FontColor::Green}.toString();
+    const std::string plain_style = rxterm::turnOffCharAttributes();
+
+    raw_keyboard keyboard;
+
+    player.seek(start);
+
+    book_screen screen{help_row + 1u};
+
+    // what is on screen, the rows of a side without a level are empty
+    std::vector<itch::price_level> shown_sells(levels, itch::price_level{0, 0, 0});
+    std::vector<itch::price_level> shown_buys(levels, itch::price_level{0, 0, 0});
+
+    // newest first
+    boost::circular_buffer<itch::execution> recent{execution_rows};
+
+    const auto show_levels = [&](const std::vector<itch::price_level> & current, std::vector<itch::price_level> & shown, bool is_buy) {
+        for (size_t i = 0; i < levels; ++i)
+        {
+            const itch::price_level l = (i < current.size()) ? current[i] : itch::price_level{0, 0, 0};
+            if (same_level(l, shown[i])) continue;
+
+            shown[i] = l;
+
+            // the best prices of both sides meet in the middle
+            const size_t row = is_buy ? (buy_title_row + 1u + i) : (sell_title_row + levels - i);
+
+            screen.set(row, is_buy ? buy_style : sell_style,
+                l.shares ? fmt::format(" {:>9.2f} USD - {:>8L} shares - {:>5L} orders", convert_from_fix(l.price), l.shares, l.orders)
+                         : std::string{});
+        }
+    };
+
+    screen.set(sell_title_row, sell_style, " *** Selling");
+    screen.set(buy_title_row, buy_style, " *** Buying");
+    screen.set(execution_title_row, title_style, " *** Executions");
+    screen.set(help_row, plain_style, " space: pause - +/-: speed - arrows: seek one minute - q: quit");
+
+    std::uint32_t speed = cfg.viewer.speed;
+    bool paused         = false;
+
+    const auto frame = std::chrono::microseconds{1'000'000 / cfg.viewer.fps};
+    auto last_frame  = std::chrono::steady_clock::now();
+
+    const auto seek = [&](utils::timespec when) {
+        player.seek(when);
+
+        // the time spent seeking isn't replayed
+        last_frame = std::chrono::steady_clock::now();
+    };
+
+    for (;;)
+    {
+        bool quit = false;
+
+        for (char key = keyboard.read_key(); key && !quit; key = keyboard.read_key())
+        {
+            switch (key)
+            {
+            case 'q':
+                quit = true;
+                break;
+
+            case ' ':
+                paused = !paused;
+                break;
+
+            case '+':
+                speed = std::min(speed * 2u, 1000u);
+                break;
+
+            case '-':
+                speed = std::max(speed / 2u, 1u);
+                break;
+
+            case 'f':
+                seek(player.time() + std::chrono::minutes{1});
+                break;
+
+            case 'b':
+                seek(player.time() - std::chrono::minutes{1});
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        if (quit) break;
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if (!paused)
+        {
+            player.advance(player.time() + std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_frame) * speed);
+        }
+
+        last_frame = now;
+
+        const char * state = paused ? "paused" : (player.done() ? "end of day" : "playing");
+
+        screen.set(0u, title_style, fmt::format(" {} - {} - x{} - {}", cfg.stock, format_viewer_time(player.time()), speed, state));
+
+        const auto b = player.engine().best_bid_offer();
+
+        screen.set(1u, plain_style,
+            fmt::format(" bid {:>9.2f} x {:>8L} - ask {:>9.2f} x {:>8L} - missed orders {:L}", convert_from_fix(b.bid), b.bid_shares,
+                convert_from_fix(b.ask), b.ask_shares, player.missed()));
+
+        show_levels(player.engine().sell_levels(), shown_sells, false);
+        show_levels(player.engine().buy_levels(), shown_buys, true);
+
+        auto & executions = player.executions();
+
+        if (!executions.empty())
+        {
+            for (const auto & e : executions)
+            {
+                recent.push_front(e);
+            }
+
+            executions.clear();
+
+            for (size_t i = 0; i < recent.size(); ++i)
+            {
+                const auto & e = recent[i];
+
+                screen.set(execution_title_row + 1u + i, e.is_buy ? buy_style : sell_style,
+                    fmt::format(" {} - {:>8L} shares at {:>9.2f} USD - ref: {:>10L}",
+                        format_viewer_time(utils::timespec{utils::nanoseconds{e.timestamp}}), e.shares, convert_from_fix(e.price),
+                        e.reference));
+            }
+        }
+
+        screen.flush();
+
+        std::this_thread::sleep_until(now + frame);
+    }
+}
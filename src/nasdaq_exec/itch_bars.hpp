@@ -0,0 +1,173 @@
+#pragma once
+
+#include "itch_executions.hpp"
+#include <boost/circular_buffer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// the executions of one interval
+struct bar
+{
+    // nanoseconds since the epoch, a multiple of the width of the bar
+    std::int64_t start;
+
+    // fixed point
+    std::uint32_t open;
+    std::uint32_t high;
+    std::uint32_t low;
+    std::uint32_t close;
+
+    std::uint64_t volume;
+    // the sum of price * shares, fixed point
+    std::uint64_t notional;
+    std::uint32_t trades;
+
+    // fixed point, truncated
+    std::uint32_t vwap() const noexcept
+    {
+        return volume ? static_cast<std::uint32_t>(notional / volume) : 0u;
+    }
+};
+
+// the bars of one width, intervals without executions have no bar
+// the completed bars wait in a ring of fixed capacity until they are drained
+class bar_series
+{
+public:
+    bar_series(std::chrono::nanoseconds width, size_t capacity)
+        : _width{width.count()}
+        , _completed{capacity}
+    {}
+
+    void add(std::int64_t timestamp, std::uint32_t price, std::uint32_t shares)
+    {
+        const std::int64_t start = timestamp - timestamp % _width;
+
+        if (_open && (_current.start == start))
+        {
+            _current.high  = std::max(_current.high, price);
+            _current.low   = std::min(_current.low, price);
+            _current.close = price;
+            _current.volume += shares;
+            _current.notional += static_cast<std::uint64_t>(price) * shares;
+            ++_current.trades;
+            return;
+        }
+
+        close();
+
+        _current = bar{start, price, price, price, price, shares, static_cast<std::uint64_t>(price) * shares, 1u};
+        _open    = true;
+    }
+
+    // completes the current bar, the next execution starts a new one
+    void close()
+    {
+        if (!_open) return;
+
+        _completed.push_back(_current);
+        _open = false;
+    }
+
+    std::chrono::nanoseconds width() const noexcept
+    {
+        return std::chrono::nanoseconds{_width};
+    }
+
+    // no room left for another completed bar
+    bool full() const noexcept
+    {
+        return _completed.full();
+    }
+
+    // hands out the completed bars, oldest first, and empties the ring
+    template <typename Function>
+    void drain(Function && f)
+    {
+        for (const auto & b : _completed)
+        {
+            f(b);
+        }
+
+        _completed.clear();
+    }
+
+private:
+    std::int64_t _width;
+
+    bar _current{};
+    bool _open{false};
+
+    boost::circular_buffer<bar> _completed;
+};
+
+// the bars of several widths, every execution updates all of them
+class bar_builder
+{
+public:
+    bar_builder(const std::vector<std::chrono::seconds> & widths, size_t capacity)
+    {
+        _series.reserve(widths.size());
+
+        for (const auto w : widths)
+        {
+            _series.emplace_back(w, capacity);
+        }
+    }
+
+    // true when a ring is full, the bars must be drained before the next execution
+    // the non printable executions are skipped, their shares are in the cross trade that follows
+    bool add(const execution & e)
+    {
+        if (!e.printable) return false;
+
+        bool full = false;
+
+        for (auto & s : _series)
+        {
+            s.add(e.timestamp, e.price, e.shares);
+            full |= s.full();
+        }
+
+        return full;
+    }
+
+    // completes the current bars, at the end of the replay
+    void close()
+    {
+        for (auto & s : _series)
+        {
+            s.close();
+        }
+    }
+
+    size_t size() const noexcept
+    {
+        return _series.size();
+    }
+
+    const bar_series & operator[](size_t i) const noexcept
+    {
+        return _series[i];
+    }
+
+    // f(i, bar) for the completed bars of every series, i being the index of the series
+    template <typename Function>
+    void drain(Function && f)
+    {
+        for (size_t i = 0; i < _series.size(); ++i)
+        {
+            _series[i].drain([&f, i](const bar & b) { f(i, b); });
+        }
+    }
+
+private:
+    std::vector<bar_series> _series;
+};
+
+} // namespace itch
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// prices are fixed point with three decimals once in the engine, Nasdaq sends four, the last one is rounded half up
+inline constexpr std::uint32_t price4_to_fix(std::int64_t price4) noexcept
+{
+    return static_cast<std::uint32_t>((price4 + 5) / 10);
+}
+
+// a stored 12.345 may be 12.34499..., the price goes through its four decimals so that both layouts give the same book
+inline std::uint32_t convert_to_fix(double p) noexcept
+{
+    return price4_to_fix(std::llround(p * 10'000.0));
+}
+
+// Orders as parallel columns, sorted by timestamp, which is how the database returns them.
+//
+// Every column is filled in bulk from the points of the matching database column, timestamps are nanoseconds since
+// the epoch and prices are converted to fixed point when the batch is filled, which makes an order 35 bytes, 39 with the
+// participants, instead of the 56 bytes of a (timespec, order_record) pair.
+struct order_batch
+{
+    std::vector<std::int64_t> timestamps;
+    std::vector<char> types;
+    std::vector<std::uint64_t> references;
+    std::vector<std::uint64_t> new_references;
+    std::vector<std::uint32_t> shares;
+    std::vector<std::uint32_t> prices;
+    // not a vector<bool>, bits can't be filled in bulk
+    std::vector<std::uint8_t> is_buy;
+    // 0 for an execution with price marked as non printable, 1 otherwise
+    std::vector<std::uint8_t> printable;
+    // the participants packed with pack_mpid, 0 when anonymous
+    // empty unless the attributions were requested, resize() leaves it alone
+    std::vector<std::uint32_t> mpids;
+
+    static std::int64_t to_nanoseconds(const utils::timespec & ts) noexcept
+    {
+        return ts.sec.count() * 1'000'000'000 + ts.nsec.count();
+    }
+
+    size_t size() const noexcept
+    {
+        return timestamps.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return timestamps.empty();
+    }
+
+    void resize(size_t count)
+    {
+        timestamps.resize(count);
+        types.resize(count);
+        references.resize(count);
+        new_references.resize(count);
+        shares.resize(count);
+        prices.resize(count);
+        is_buy.resize(count);
+        printable.resize(count, 1u);
+    }
+
+    void clear()
+    {
+        resize(0);
+        mpids.clear();
+    }
+
+    utils::timespec timestamp(size_t i) const
+    {
+        return utils::timespec{utils::nanoseconds{timestamps[i]}};
+    }
+
+    // the index of the first order at or after ts
+    size_t lower_bound(const utils::timespec & ts) const
+    {
+        return static_cast<size_t>(std::lower_bound(timestamps.cbegin(), timestamps.cend(), to_nanoseconds(ts)) - timestamps.cbegin());
+    }
+
+    // the index of the first order after ts
+    size_t upper_bound(const utils::timespec & ts) const
+    {
+        return static_cast<size_t>(std::upper_bound(timestamps.cbegin(), timestamps.cend(), to_nanoseconds(ts)) - timestamps.cbegin());
+    }
+};
+
+} // namespace itch
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <utils/timespec.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// best bid and offer, a zero price means the side is empty
+struct bbo
+{
+    std::uint32_t bid{0};
+    std::uint32_t bid_shares{0};
+    std::uint32_t bid_orders{0};
+
+    std::uint32_t ask{0};
+    std::uint32_t ask_shares{0};
+    std::uint32_t ask_orders{0};
+
+    bool operator==(const bbo & other) const noexcept
+    {
+        return (bid == other.bid) && (bid_shares == other.bid_shares) && (bid_orders == other.bid_orders) && (ask == other.ask)
+               && (ask_shares == other.ask_shares) && (ask_orders == other.ask_orders);
+    }
+
+    bool operator!=(const bbo & other) const noexcept
+    {
+        return !(*this == other);
+    }
+};
+
+// every change of the best bid and offer, one column per field
+class bbo_timeline
+{
+public:
+    void reserve(size_t s)
+    {
+        timestamps.reserve(s);
+        bids.reserve(s);
+        bid_shares.reserve(s);
+        bid_orders.reserve(s);
+        asks.reserve(s);
+        ask_shares.reserve(s);
+        ask_orders.reserve(s);
+    }
+
+    // appends a row only if the bbo changed since the last row
+    bool update(const utils::timespec & timestamp, const bbo & b)
+    {
+        if (!timestamps.empty() && (b == _last)) return false;
+
+        timestamps.push_back(timestamp);
+        bids.push_back(b.bid);
+        bid_shares.push_back(b.bid_shares);
+        bid_orders.push_back(b.bid_orders);
+        asks.push_back(b.ask);
+        ask_shares.push_back(b.ask_shares);
+        ask_orders.push_back(b.ask_orders);
+
+        _last = b;
+        return true;
+    }
+
+    size_t size() const noexcept
+    {
+        return timestamps.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return timestamps.empty();
+    }
+
+    void clear()
+    {
+        timestamps.clear();
+        bids.clear();
+        bid_shares.clear();
+        bid_orders.clear();
+        asks.clear();
+        ask_shares.clear();
+        ask_orders.clear();
+    }
+
+public:
+    std::vector<utils::timespec> timestamps;
+
+    std::vector<std::uint32_t> bids;
+    std::vector<std::uint32_t> bid_shares;
+    std::vector<std::uint32_t> bid_orders;
+
+    std::vector<std::uint32_t> asks;
+    std::vector<std::uint32_t> ask_shares;
+    std::vector<std::uint32_t> ask_orders;
+
+private:
+    bbo _last;
+};
+
+} // namespace itch
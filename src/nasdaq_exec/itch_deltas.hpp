@@ -0,0 +1,186 @@
+#pragma once
+
+#include "itch_snapshot.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// the aggregate size of a price level after a change, zero when the level is gone
+struct level_delta
+{
+    std::uint32_t price;
+    std::uint32_t shares;
+    bool is_buy;
+};
+
+// The changes of the price levels, market by price, coalesced by timestamp.
+//
+// The engine reports every change of a level, a timestamp is closed when a change with another timestamp arrives
+// and only the levels whose size differs from what it was before the timestamp are kept, in the order they first
+// changed. An order replaced and restored within the same timestamp leaves nothing behind.
+class level_delta_log
+{
+public:
+    // the level at price is now shares, it changed by delta
+    void update(std::int64_t timestamp, bool is_buy, std::uint32_t price, std::uint32_t shares, std::int64_t delta)
+    {
+        if (timestamp != _timestamp) close();
+
+        _timestamp = timestamp;
+
+        auto it = std::find_if(_pending.begin(), _pending.end(), [is_buy, price](const pending_level & p) {
+            return (p.is_buy == is_buy) && (p.price == price);
+        });
+
+        if (it == _pending.end())
+        {
+            _pending.push_back(pending_level{price, static_cast<std::uint32_t>(static_cast<std::int64_t>(shares) - delta), shares, is_buy});
+            return;
+        }
+
+        it->after = shares;
+    }
+
+    // the changes of the current timestamp are final
+    void close()
+    {
+        if (_pending.empty()) return;
+
+        const size_t first = deltas.size();
+
+        for (const auto & p : _pending)
+        {
+            if (p.before != p.after) deltas.push_back(level_delta{p.price, p.after, p.is_buy});
+        }
+
+        if (deltas.size() != first)
+        {
+            timestamps.push_back(_timestamp);
+            ends.push_back(deltas.size());
+        }
+
+        _pending.clear();
+    }
+
+    // the closed timestamps
+    size_t size() const noexcept
+    {
+        return timestamps.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return timestamps.empty();
+    }
+
+    // the consumer clears the closed timestamps once it has read them, the current timestamp stays open
+    void clear()
+    {
+        timestamps.clear();
+        ends.clear();
+        deltas.clear();
+    }
+
+public:
+    // nanoseconds since the epoch, the deltas of the i-th timestamp are [ends[i - 1], ends[i])
+    std::vector<std::int64_t> timestamps;
+    std::vector<size_t> ends;
+    std::vector<level_delta> deltas;
+
+private:
+    struct pending_level
+    {
+        std::uint32_t price;
+        std::uint32_t before;
+        std::uint32_t after;
+        bool is_buy;
+    };
+
+    std::int64_t _timestamp{0};
+    std::vector<pending_level> _pending;
+};
+
+// The binary delta feed, little endian, one record per timestamp:
+//
+//   time (i64, nanoseconds since the epoch), count (u32), then count times price (u32, fixed point), shares (u32), side (u8, 1 for buy)
+//
+// the record of a timestamp is enough to move collapsed books from the previous timestamp to this one
+static constexpr size_t level_delta_size = sizeof(std::uint32_t) * 2u + sizeof(std::uint8_t);
+
+// appends the closed timestamps of the log to the buffer
+inline void serialize_level_deltas(const level_delta_log & log, std::vector<std::uint8_t> & res)
+{
+    const size_t offset = res.size();
+
+    res.resize(offset + log.size() * (sizeof(std::int64_t) + sizeof(std::uint32_t)) + log.deltas.size() * level_delta_size);
+
+    std::uint8_t * p = res.data() + offset;
+    size_t l         = res.size() - offset;
+
+    size_t first = 0;
+
+    for (size_t i = 0; i < log.size(); ++i)
+    {
+        serialize_integer(p, l, log.timestamps[i]);
+        serialize_integer(p, l, static_cast<std::uint32_t>(log.ends[i] - first));
+
+        for (; first < log.ends[i]; ++first)
+        {
+            const auto & d = log.deltas[first];
+
+            serialize_integer(p, l, d.price);
+            serialize_integer(p, l, d.shares);
+            serialize_integer(p, l, static_cast<std::uint8_t>(d.is_buy));
+        }
+    }
+}
+
+// reads the record of the next timestamp, false at the end of the buffer or if the record is truncated
+inline bool deserialize_level_deltas(const std::uint8_t *& p, size_t & l, std::int64_t & timestamp, std::vector<level_delta> & deltas)
+{
+    std::uint32_t count = 0;
+
+    if (!deserialize_integer(p, l, timestamp) || !deserialize_integer(p, l, count)) return false;
+
+    // don't trust the count for the allocation
+    if (static_cast<std::uint64_t>(count) * level_delta_size > l) return false;
+
+    deltas.resize(count);
+
+    for (auto & d : deltas)
+    {
+        std::uint8_t is_buy = 0;
+
+        deserialize_integer(p, l, d.price);
+        deserialize_integer(p, l, d.shares);
+        deserialize_integer(p, l, is_buy);
+
+        d.is_buy = is_buy != 0;
+    }
+
+    return true;
+}
+
+// moves collapsed books (price, shares) to the state after the deltas
+template <typename CollapsedBook>
+inline void apply_level_deltas(const std::vector<level_delta> & deltas, CollapsedBook & buying_book, CollapsedBook & selling_book)
+{
+    for (const auto & d : deltas)
+    {
+        auto & book = d.is_buy ? buying_book : selling_book;
+
+        if (d.shares)
+        {
+            book[d.price] = d.shares;
+        }
+        else
+        {
+            book.erase(d.price);
+        }
+    }
+}
+
+} // namespace itch
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// aggregated view of all the orders resting at one price
+struct price_level
+{
+    price_level() = default;
+    price_level(std::uint32_t p, std::uint32_t s, std::uint32_t o)
+        : price{p}
+        , shares{s}
+        , orders{o}
+    {}
+
+    std::uint32_t price; // fixed point, same unit as order::price
+    std::uint32_t shares;
+    std::uint32_t orders;
+};
+
+// keeps the N best price levels of one side of the book, best level first
+//
+// the levels are updated incrementally as orders come and go, deeper levels are not tracked
+// when a level of the top is depleted and we know deeper levels exist, the top is flagged as stale
+// and must be rebuilt from the orders before being read again
+class depth_book
+{
+public:
+    depth_book() = default;
+    depth_book(bool is_buy, size_t depth)
+        : _depth{depth}
+        , _is_buy{is_buy}
+    {
+        _levels.reserve(_depth + 1u);
+    }
+
+private:
+    bool better(std::uint32_t left, std::uint32_t right) const noexcept
+    {
+        return _is_buy ? (left > right) : (left < right);
+    }
+
+    std::vector<price_level>::iterator find_level(std::uint32_t price) noexcept
+    {
+        return std::lower_bound(_levels.begin(), _levels.end(), price,
+            [this](const price_level & level, std::uint32_t p) { return better(level.price, p); });
+    }
+
+public:
+    bool enabled() const noexcept
+    {
+        return _depth > 0u;
+    }
+
+    size_t depth() const noexcept
+    {
+        return _depth;
+    }
+
+    bool stale() const noexcept
+    {
+        return _stale;
+    }
+
+    // the level must be rebuilt before being read again
+    void invalidate() noexcept
+    {
+        _stale = true;
+    }
+
+    const std::vector<price_level> & levels() const noexcept
+    {
+        return _levels;
+    }
+
+    // shares and orders are signed deltas applied to the level at price
+    void update(std::uint32_t price, std::int64_t shares, std::int32_t orders)
+    {
+        // no point in maintaining something we will throw away
+        if (!enabled() || _stale) return;
+
+        auto it = find_level(price);
+
+        if ((it != _levels.end()) && (it->price == price))
+        {
+            it->shares = static_cast<std::uint32_t>(static_cast<std::int64_t>(it->shares) + shares);
+            it->orders = static_cast<std::uint32_t>(static_cast<std::int32_t>(it->orders) + orders);
+
+            if (!it->orders || !it->shares)
+            {
+                _levels.erase(it);
+
+                // a level we don't know of may now belong to the top
+                if (!_complete) _stale = true;
+            }
+
+            return;
+        }
+
+        // removal from a level below the top, nothing to do
+        if ((shares <= 0) || (orders <= 0)) return;
+
+        if (it == _levels.end())
+        {
+            if (_levels.size() >= _depth)
+            {
+                // new deeper level, we no longer have the full picture
+                _complete = false;
+                return;
+            }
+        }
+
+        _levels.emplace(it, price, static_cast<std::uint32_t>(shares), static_cast<std::uint32_t>(orders));
+
+        if (_levels.size() > _depth)
+        {
+            _levels.pop_back();
+            _complete = false;
+        }
+    }
+
+    // rebuilds the top levels from a range of levels sorted best first
+    template <typename Iterator>
+    void assign(Iterator first, Iterator last)
+    {
+        _levels.clear();
+        _stale = false;
+
+        for (; (first != last) && (_levels.size() < _depth); ++first)
+        {
+            _levels.push_back(*first);
+        }
+
+        _complete = (first == last);
+    }
+
+    // rebuilds the top levels from an order store
+    // a level pushed out of the top can never come back in, which is why one pass with a bounded array is enough
+    template <typename OrderStore>
+    void rebuild(const OrderStore & m)
+    {
+        _levels.clear();
+        _complete = true;
+        _stale    = false;
+
+        if (!enabled()) return;
+
+        m.for_each([this](std::uint64_t /*reference*/, const auto & o) {
+            auto it = find_level(o.price);
+            if ((it != _levels.end()) && (it->price == o.price))
+            {
+                it->shares += o.shares;
+                ++it->orders;
+                return;
+            }
+
+            if ((it == _levels.end()) && (_levels.size() >= _depth))
+            {
+                _complete = false;
+                return;
+            }
+
+            _levels.emplace(it, o.price, o.shares, 1u);
+
+            if (_levels.size() > _depth)
+            {
+                _levels.pop_back();
+                _complete = false;
+            }
+        });
+    }
+
+private:
+    std::vector<price_level> _levels;
+
+    size_t _depth{0};
+    bool _is_buy{false};
+
+    // true when _levels contains every level of the side
+    bool _complete{true};
+    bool _stale{false};
+};
+
+// every price level of one side of the book
+//
+// levels are kept sorted from the worst to the best price, activity concentrates around the best price
+// which is why this order keeps insertions and removals close to the end of the vector
+// the best level is therefore always available in constant time
+class level_ladder
+{
+public:
+    level_ladder() = default;
+    explicit level_ladder(bool is_buy)
+        : _is_buy{is_buy}
+    {}
+
+private:
+    bool worse(std::uint32_t left, std::uint32_t right) const noexcept
+    {
+        return _is_buy ? (left < right) : (left > right);
+    }
+
+    std::vector<price_level>::iterator find_level(std::uint32_t price) noexcept
+    {
+        return std::lower_bound(_levels.begin(), _levels.end(), price,
+            [this](const price_level & level, std::uint32_t p) { return worse(level.price, p); });
+    }
+
+public:
+    bool enabled() const noexcept
+    {
+        return _enabled;
+    }
+
+    void enable(bool e) noexcept
+    {
+        _enabled = e;
+        if (!_enabled) _levels.clear();
+    }
+
+    bool empty() const noexcept
+    {
+        return _levels.empty();
+    }
+
+    size_t size() const noexcept
+    {
+        return _levels.size();
+    }
+
+    // undefined when empty
+    const price_level & best() const noexcept
+    {
+        return _levels.back();
+    }
+
+    // best levels first
+    std::vector<price_level>::const_reverse_iterator begin() const noexcept
+    {
+        return _levels.crbegin();
+    }
+
+    std::vector<price_level>::const_reverse_iterator end() const noexcept
+    {
+        return _levels.crend();
+    }
+
+    // shares and orders are signed deltas applied to the level at price, returns the shares of the level after the update
+    std::uint32_t update(std::uint32_t price, std::int64_t shares, std::int32_t orders)
+    {
+        if (!_enabled) return 0;
+
+        auto it = find_level(price);
+
+        if ((it != _levels.end()) && (it->price == price))
+        {
+            it->shares = static_cast<std::uint32_t>(static_cast<std::int64_t>(it->shares) + shares);
+            it->orders = static_cast<std::uint32_t>(static_cast<std::int32_t>(it->orders) + orders);
+
+            if (!it->orders || !it->shares)
+            {
+                _levels.erase(it);
+                return 0;
+            }
+
+            return it->shares;
+        }
+
+        if ((shares <= 0) || (orders <= 0)) return 0;
+
+        _levels.emplace(it, price, static_cast<std::uint32_t>(shares), static_cast<std::uint32_t>(orders));
+        return static_cast<std::uint32_t>(shares);
+    }
+
+    template <typename OrderStore>
+    void rebuild(const OrderStore & m)
+    {
+        _levels.clear();
+
+        if (!_enabled) return;
+
+        m.for_each([this](std::uint64_t /*reference*/, const auto & o) { update(o.price, o.shares, 1); });
+    }
+
+private:
+    std::vector<price_level> _levels;
+
+    bool _is_buy{false};
+    bool _enabled{false};
+};
+
+} // namespace itch
@@ -1,9 +1,17 @@
 ﻿#pragma once
 
+#include "itch_batch.hpp"
+#include "itch_bbo.hpp"
+#include "itch_deltas.hpp"
+#include "itch_depth.hpp"
+#include "itch_executions.hpp"
+#include "itch_flow.hpp"
 #include "itch_messages.hpp"
+#include "itch_participants.hpp"
+#include "itch_snapshot.hpp"
+#include "itch_store.hpp"
 #include <boost/container/flat_map.hpp>
 #include <boost/container/flat_set.hpp>
-#include <boost/endian/conversion.hpp>
 #include <rh/robin_hood.h>
 #include <utils/timespec.hpp>
 #include <cmath>
@@ -13,101 +21,10 @@
 namespace itch
 {
 
-// an order at instant X, can be buy or sell
-struct order
-{
-    order() = default;
-    order(std::uint32_t p, std::uint32_t s)
-        : price{p}
-        , shares{s}
-    {}
-
-    std::uint32_t price; // fixed point, 4 decimal precision on Nasdaq
-    std::uint32_t shares;
-
-    bool operator==(const order & other) const noexcept
-    {
-        return (shares == other.shares) && (price == other.price);
-    }
-
-    bool operator!=(const order & other) const noexcept
-    {
-        return !(*this == other);
-    }
-
-    bool operator<(const order & other) const noexcept
-    {
-        return (price < other.price) || ((price == other.price) && (shares < other.shares));
-    }
-};
-
-// reference => order
-using order_map  = robin_hood::unordered_flat_map<std::uint64_t, order>;
 using order_book = boost::container::flat_multimap<order, std::uint64_t>;
 // price share collapsed book
 using collapsed_book = boost::container::flat_map<std::uint32_t, std::uint32_t>;
 
-template <typename Integer>
-inline void serialize_integer(std::uint8_t *& p, size_t & l, Integer v) noexcept
-{
-    *reinterpret_cast<Integer *>(p) = boost::endian::native_to_little(v);
-
-    p += sizeof(v);
-    l -= sizeof(v);
-}
-
-template <typename Integer>
-inline bool deserialize_integer(const std::uint8_t *& p, size_t & l, Integer & v) noexcept
-{
-    if (l < sizeof(v)) return false;
-    v = *reinterpret_cast<const Integer *>(p);
-
-    p += sizeof(v);
-    l -= sizeof(v);
-    return true;
-}
-
-inline void serialize_order_map(std::uint8_t *& p, size_t & l, const order_map & orders) noexcept
-{
-    serialize_integer(p, l, static_cast<std::uint64_t>(orders.size()));
-
-    for (const auto & o : orders)
-    {
-        serialize_integer(p, l, o.first);
-        serialize_integer(p, l, o.second.price);
-        serialize_integer(p, l, o.second.shares);
-    }
-}
-
-inline bool deserialize_order_map(const std::uint8_t *& p, size_t & l, order_map & orders)
-{
-    std::uint64_t s;
-    if (!deserialize_integer(p, l, s)) return false;
-
-    orders.clear();
-    orders.reserve(s);
-
-    for (std::uint64_t i = 0; i < s; ++i)
-    {
-        std::uint64_t reference;
-        if (!deserialize_integer(p, l, reference)) return false;
-
-        order o;
-        if (!deserialize_integer(p, l, o.price)) return false;
-
-        if (!deserialize_integer(p, l, o.shares)) return false;
-
-        orders.emplace(reference, o);
-    }
-
-    return true;
-}
-
-static const size_t serialized_size(const order_map & m) noexcept
-{
-    return sizeof(std::uint64_t) + m.size() * (sizeof(std::uint64_t) + sizeof(std::uint32_t) * 2);
-}
-
 struct order_record
 {
     std::uint64_t reference;
@@ -116,122 +33,268 @@ struct order_record
     double price;
     char order_type;
     bool is_buy;
+    // the participant of an add order with attribution, packed with pack_mpid
+    std::uint32_t mpid{0};
+    // false for an execution with price that is part of a later cross trade
+    bool printable{true};
 };
 
-using order_records = boost::container::flat_multimap<utils::timespec, order_record>;
-
-class execution_engine
+// the order store policy selects the container of the orders, the allocator policy where it takes its memory from
+// see itch_store.hpp
+template <typename OrderStorePolicy = flat_store_policy, typename AllocatorPolicy = std_allocator_policy>
+class basic_execution_engine
 {
+public:
+    using store_type = typename OrderStorePolicy::template store_type<AllocatorPolicy>;
 
 private:
-    static constexpr std::uint32_t convert_to_fix(double p) noexcept
+    void update_level(bool is_buy, std::uint32_t price, std::int64_t shares, std::int32_t orders)
     {
-        return static_cast<std::uint32_t>(p * 1000.0);
+        auto & d = is_buy ? _buy_depth : _sell_depth;
+        d.update(price, shares, orders);
+
+        auto & l                = is_buy ? _buy_ladder : _sell_ladder;
+        const auto level_shares = l.update(price, shares, orders);
+
+        if (_level_deltas && shares) _level_deltas->update(_timestamp, is_buy, price, level_shares, shares);
     }
 
-private:
-    void run_add_order(bool is_buy, std::uint64_t reference, std::uint32_t shares, double price)
+    void record_change(std::uint64_t reference)
+    {
+        if (_track_changes) _changes.insert(reference);
+    }
+
+    void run_add_order(bool is_buy, std::uint64_t reference, std::uint32_t shares, std::uint32_t fixed_price)
     {
         auto & m = is_buy ? _all_buy_orders : _all_sell_orders;
 
-        m.emplace(reference, order{convert_to_fix(price), shares});
+        m.emplace(reference, order{fixed_price, shares});
+        update_level(is_buy, fixed_price, shares, 1);
+        record_change(reference);
     }
 
-    template <typename Map>
-    bool run_execute_order(Map & m, std::uint64_t reference, std::uint32_t shares)
+    // a cancel reduces the order the same way, but isn't an execution
+    bool run_reduce_order(
+        store_type & m, bool is_buy, std::uint64_t reference, std::uint32_t shares, bool executed, std::uint32_t price, bool printable)
     {
-        auto it = m.find(reference);
-        if (it != m.end())
-        {
-            it->second.shares -= shares;
-            if (!it->second.shares)
+        const bool found = m.update(reference, [this, is_buy, reference, shares, executed, price, printable](order & o) {
+            o.shares -= shares;
+
+            const bool depleted = !o.shares;
+            update_level(is_buy, o.price, -static_cast<std::int64_t>(shares), depleted ? -1 : 0);
+
+            if (executed && _executions)
             {
-                m.erase(it);
+                _executions->append(execution{_timestamp, reference, price ? price : o.price, shares, is_buy, printable});
             }
-            return true;
-        }
 
-        return false;
+            if (_participants) _participants->reduce(is_buy, reference, shares, executed, depleted);
+            return depleted;
+        });
+
+        if (found) record_change(reference);
+        return found;
     }
 
-    bool run_execute_order(std::uint64_t reference, std::uint32_t shares)
+    bool run_reduce_order(std::uint64_t reference, std::uint32_t shares, bool executed, std::uint32_t price, bool printable)
     {
-        if (run_execute_order(_all_buy_orders, reference, shares)) return true;
-        return run_execute_order(_all_sell_orders, reference, shares);
+        if (run_reduce_order(_all_buy_orders, true, reference, shares, executed, price, printable)) return true;
+        return run_reduce_order(_all_sell_orders, false, reference, shares, executed, price, printable);
+    }
+
+    // a zero price is the price of the resting order
+    bool run_execute_order(std::uint64_t reference, std::uint32_t shares, std::uint32_t price, bool printable)
+    {
+        return run_reduce_order(reference, shares, true, price, printable);
     }
 
     bool run_cancel_order(std::uint64_t reference, std::uint32_t shares)
     {
-        return run_execute_order(reference, shares);
+        return run_reduce_order(reference, shares, false, 0u, true);
+    }
+
+    // an execution against a hidden order, or a cross, the book doesn't change
+    void run_trade(bool is_buy, std::uint64_t reference, std::uint32_t shares, std::uint32_t fixed_price)
+    {
+        if (_executions) _executions->append(execution{_timestamp, reference, fixed_price, shares, is_buy, true});
+    }
+
+    bool run_delete_order(store_type & m, bool is_buy, std::uint64_t reference)
+    {
+        const bool found = m.update(reference, [this, is_buy, reference](const order & o) {
+            update_level(is_buy, o.price, -static_cast<std::int64_t>(o.shares), -1);
+            if (_participants) _participants->remove(is_buy, reference, o.shares);
+            return true;
+        });
+
+        if (found) record_change(reference);
+        return found;
     }
 
     bool run_delete_order(std::uint64_t reference)
     {
-        if (_all_buy_orders.erase(reference) > 0u) return true;
-        return _all_sell_orders.erase(reference) > 0u;
+        if (run_delete_order(_all_buy_orders, true, reference)) return true;
+        return run_delete_order(_all_sell_orders, false, reference);
     }
 
-    template <typename Map>
-    bool run_replace_order(Map & m, bool is_buy, std::uint64_t reference, std::uint64_t new_reference, std::uint32_t shares, double price)
+    bool run_replace_order(
+        store_type & m, bool is_buy, std::uint64_t reference, std::uint64_t new_reference, std::uint32_t shares, std::uint32_t fixed_price)
     {
-        auto it = m.find(reference);
-        if (it == m.end()) return false;
+        std::uint32_t replaced_shares = 0;
+
+        const bool found = m.update(reference, [this, is_buy, &replaced_shares](const order & o) {
+            update_level(is_buy, o.price, -static_cast<std::int64_t>(o.shares), -1);
+            replaced_shares = o.shares;
+            return true;
+        });
+
+        if (!found) return false;
 
-        m.erase(it);
-        run_add_order(is_buy, new_reference, shares, price);
+        record_change(reference);
+        run_add_order(is_buy, new_reference, shares, fixed_price);
+
+        if (_participants) _participants->replace(is_buy, reference, new_reference, replaced_shares, shares);
         return true;
     }
 
-    bool run_replace_order(std::uint64_t reference, std::uint64_t new_reference, std::uint32_t shares, double price)
+    bool run_replace_order(std::uint64_t reference, std::uint64_t new_reference, std::uint32_t shares, std::uint32_t fixed_price)
     {
-        if (run_replace_order(_all_buy_orders, true, reference, new_reference, shares, price)) return true;
+        if (run_replace_order(_all_buy_orders, true, reference, new_reference, shares, fixed_price)) return true;
 
-        return run_replace_order(_all_sell_orders, false, reference, new_reference, shares, price);
+        return run_replace_order(_all_sell_orders, false, reference, new_reference, shares, fixed_price);
     }
 
-public:
-    bool run_order(const order_record & record)
+    bool run_order(char order_type,
+        bool is_buy,
+        std::uint64_t reference,
+        std::uint64_t new_reference,
+        std::uint32_t shares,
+        std::uint32_t fixed_price,
+        std::uint32_t mpid,
+        bool printable)
     {
-        switch (record.order_type)
+        switch (order_type)
         {
         case itch::messages::add_order_with_attribution::message_code:
-            [[fallthrough]];
+            run_add_order(is_buy, reference, shares, fixed_price);
+            if (_participants) _participants->add(is_buy, reference, shares, mpid);
+            return true;
+
         case itch::messages::add_order_without_attribution::message_code:
-            run_add_order(record.is_buy, record.reference, record.shares, record.price);
+            run_add_order(is_buy, reference, shares, fixed_price);
+            if (_participants) _participants->add(is_buy, reference, shares, 0u);
             return true;
 
         case itch::messages::order_executed::message_code:
-            [[fallthrough]];
+            return run_execute_order(reference, shares, 0u, true);
+
         case itch::messages::order_executed_with_price::message_code:
-            return run_execute_order(record.reference, record.shares);
+            return run_execute_order(reference, shares, fixed_price, printable);
 
         case itch::messages::order_cancel::message_code:
-            return run_cancel_order(record.reference, record.shares);
+            return run_cancel_order(reference, shares);
 
         case itch::messages::order_delete::message_code:
-            return run_delete_order(record.reference);
+            return run_delete_order(reference);
 
         case itch::messages::order_replace::message_code:
-            return run_replace_order(record.reference, record.new_reference, record.shares, record.price);
+            return run_replace_order(reference, new_reference, shares, fixed_price);
+
+        case itch::messages::trade_non_cross::message_code:
+            [[fallthrough]];
+        case itch::messages::trade_cross::message_code:
+            run_trade(is_buy, reference, shares, fixed_price);
+            return true;
 
         default:
             return false;
         }
     }
 
+public:
+    bool run_order(const order_record & record)
+    {
+        return run_order(record.order_type, record.is_buy, record.reference, record.new_reference, record.shares,
+            convert_to_fix(record.price), record.mpid, record.printable);
+    }
+
+    // same as above, records the change of the best bid and offer if a timeline is attached
+    bool run_order(const utils::timespec & timestamp, const order_record & record)
+    {
+        _timestamp     = order_batch::to_nanoseconds(timestamp);
+        const bool res = run_order(record);
+        if (_bbo_timeline) _bbo_timeline->update(timestamp, best_bid_offer());
+        if (_flow) _flow->update(buy_levels(), sell_levels());
+        return res;
+    }
+
+    // the i-th order of the batch
+    bool run_order(const order_batch & batch, size_t i)
+    {
+        _timestamp = batch.timestamps[i];
+
+        const bool res = run_order(batch.types[i], batch.is_buy[i] != 0, batch.references[i], batch.new_references[i], batch.shares[i],
+            batch.prices[i], batch.mpids.empty() ? 0u : batch.mpids[i], batch.printable[i] != 0);
+        if (_bbo_timeline) _bbo_timeline->update(batch.timestamp(i), best_bid_offer());
+        if (_flow) _flow->update(buy_levels(), sell_levels());
+        return res;
+    }
+
+    // runs the orders [first, last) of the batch, returns the number of orders that could not be executed
+    std::uint64_t run_orders(const order_batch & batch, size_t first, size_t last)
+    {
+        std::uint64_t missed = 0;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            if (!run_order(batch, i)) ++missed;
+        }
+
+        return missed;
+    }
+
 private:
-    template <typename Map>
-    order_book make_book(Map & m) const
+    order_book make_book(const store_type & m) const
     {
         boost::container::vector<std::pair<order, std::uint64_t>> orders;
 
         orders.reserve(m.size());
 
-        for (const auto & e : m)
+        m.for_each([&orders](std::uint64_t reference, const order & o) { orders.emplace_back(o, reference); });
+
+        std::sort(orders.begin(), orders.end());
+
+        order_book res;
+
+        res.adopt_sequence(boost::container::ordered_range_t{}, std::move(orders));
+
+        return res;
+    }
+
+    // only the orders resting at the given levels, we don't sort what we don't show
+    order_book make_book(const store_type & m, bool is_buy, const std::vector<price_level> & levels) const
+    {
+        boost::container::vector<std::pair<order, std::uint64_t>> orders;
+
+        if (levels.empty()) return order_book{};
+
+        const std::uint32_t worst_price = levels.back().price;
+
+        size_t count = 0;
+        for (const auto & l : levels)
         {
-            orders.emplace_back(e.second, e.first);
+            count += l.orders;
         }
 
+        orders.reserve(count);
+
+        m.for_each([&orders, is_buy, worst_price](std::uint64_t reference, const order & o) {
+            if (is_buy ? (o.price >= worst_price) : (o.price <= worst_price))
+            {
+                orders.emplace_back(o, reference);
+            }
+        });
+
         std::sort(orders.begin(), orders.end());
 
         order_book res;
@@ -259,6 +322,161 @@ public:
         return make_book(_all_sell_orders);
     }
 
+    // orders at the best levels only, requires depth tracking
+    order_book buy_book_top() const
+    {
+        return make_book(_all_buy_orders, true, buy_levels());
+    }
+
+    order_book sell_book_top() const
+    {
+        return make_book(_all_sell_orders, false, sell_levels());
+    }
+
+public:
+    // tracks the best depth levels of each side incrementally, 0 disables tracking
+    void set_depth(size_t depth)
+    {
+        _buy_depth  = depth_book{true, depth};
+        _sell_depth = depth_book{false, depth};
+
+        _buy_depth.invalidate();
+        _sell_depth.invalidate();
+    }
+
+    size_t depth() const noexcept
+    {
+        return _buy_depth.depth();
+    }
+
+    // best levels first, deeper levels are recomputed only when the top got depleted
+    // from all the levels if we track them, from the orders otherwise
+    const std::vector<price_level> & buy_levels() const
+    {
+        refresh_depth(_buy_depth, _buy_ladder, _all_buy_orders);
+        return _buy_depth.levels();
+    }
+
+    const std::vector<price_level> & sell_levels() const
+    {
+        refresh_depth(_sell_depth, _sell_ladder, _all_sell_orders);
+        return _sell_depth.levels();
+    }
+
+private:
+    static void refresh_depth(depth_book & d, const level_ladder & l, const store_type & m)
+    {
+        if (!d.stale()) return;
+
+        if (l.enabled())
+        {
+            d.assign(l.begin(), l.end());
+        }
+        else
+        {
+            d.rebuild(m);
+        }
+    }
+
+    static void best_level(const level_ladder & l, std::uint32_t & price, std::uint32_t & shares, std::uint32_t & orders) noexcept
+    {
+        if (l.empty()) return;
+
+        price  = l.best().price;
+        shares = l.best().shares;
+        orders = l.best().orders;
+    }
+
+public:
+    // maintains every price level of both sides, which gives the best bid and offer in constant time
+    void track_bbo(bool enable)
+    {
+        _buy_ladder.enable(enable);
+        _sell_ladder.enable(enable);
+
+        _buy_ladder.rebuild(_all_buy_orders);
+        _sell_ladder.rebuild(_all_sell_orders);
+    }
+
+    bool tracks_bbo() const noexcept
+    {
+        return _buy_ladder.enabled();
+    }
+
+    // every bbo change is appended to the timeline by run_order, nullptr to detach
+    // the timeline must outlive the engine, or be detached
+    void set_bbo_timeline(bbo_timeline * timeline)
+    {
+        if (timeline && !tracks_bbo()) track_bbo(true);
+        _bbo_timeline = timeline;
+    }
+
+    // every execution is appended to the log by run_order, nullptr to detach
+    // the log must outlive the engine, or be detached
+    void set_execution_log(execution_log * log) noexcept
+    {
+        _executions = log;
+    }
+
+    // the metrics are updated by run_order after every order, nullptr to detach
+    // the levels are tracked deep enough for the metrics and refreshed from all the levels when the top is depleted
+    // the metrics must outlive the engine, or be detached
+    void set_flow_metrics(flow_metrics * metrics)
+    {
+        if (metrics && (depth() < metrics->max_depth())) set_depth(metrics->max_depth());
+        if (metrics && !tracks_bbo()) track_bbo(true);
+
+        _flow = metrics;
+        if (!_flow) return;
+
+        // the flows start from the current book, not from an empty one
+        _flow->update(buy_levels(), sell_levels());
+        _flow->reset_flows();
+    }
+
+    // every change of the size of a level is reported to the log by run_order, nullptr to detach
+    // the log must outlive the engine, or be detached
+    void set_level_delta_log(level_delta_log * log)
+    {
+        if (log && !tracks_bbo()) track_bbo(true);
+        _level_deltas = log;
+    }
+
+    // the liquidity of every participant is maintained by run_order, nullptr to detach
+    // the book must be attached before the first order, the orders restored from a snapshot are unattributed
+    // the book must outlive the engine, or be detached
+    void set_participant_book(participant_book * book) noexcept
+    {
+        _participants = book;
+    }
+
+    bbo best_bid_offer() const
+    {
+        bbo res;
+
+        if (tracks_bbo())
+        {
+            best_level(_buy_ladder, res.bid, res.bid_shares, res.bid_orders);
+            best_level(_sell_ladder, res.ask, res.ask_shares, res.ask_orders);
+            return res;
+        }
+
+        // slow path, one pass on all orders
+        level_ladder buy_ladder{true};
+        level_ladder sell_ladder{false};
+
+        buy_ladder.enable(true);
+        sell_ladder.enable(true);
+
+        buy_ladder.rebuild(_all_buy_orders);
+        sell_ladder.rebuild(_all_sell_orders);
+
+        best_level(buy_ladder, res.bid, res.bid_shares, res.bid_orders);
+        best_level(sell_ladder, res.ask, res.ask_shares, res.ask_orders);
+
+        return res;
+    }
+
 public:
     static collapsed_book collapse_book(const order_book & orders)
     {
@@ -286,29 +504,256 @@ public:
         return res;
     }
 
+    static collapsed_book collapse_levels(const std::vector<price_level> & levels)
+    {
+        boost::container::vector<std::pair<std::uint32_t, std::uint32_t>> res;
+
+        res.reserve(levels.size());
+
+        for (const auto & l : levels)
+        {
+            res.emplace_back(l.price, l.shares);
+        }
+
+        std::sort(res.begin(), res.end());
+
+        collapsed_book book;
+        book.adopt_sequence(boost::container::ordered_unique_range_t{}, std::move(res));
+        return book;
+    }
+
 public:
+    // appends the full state to the buffer, in the current snapshot format, returns the layout used
+    snapshot_layout serialize_state(std::vector<std::uint8_t> & res, snapshot_layout layout = snapshot_layout::compact) const
+    {
+        if constexpr (has_page_image_v<store_type>)
+        {
+            if (layout == snapshot_layout::image)
+            {
+                serialize_order_image(res, _all_buy_orders);
+                serialize_order_image(res, _all_sell_orders);
+                return layout;
+            }
+        }
+
+        serialize_order_store(res, _all_buy_orders);
+        serialize_order_store(res, _all_sell_orders);
+        return snapshot_layout::compact;
+    }
+
     std::vector<std::uint8_t> serialize_state() const
     {
-        std::vector<std::uint8_t> res(serialized_size(_all_buy_orders) + serialized_size(_all_sell_orders));
+        std::vector<std::uint8_t> res;
+        serialize_state(res);
+        return res;
+    }
+
+    void clear()
+    {
+        _all_buy_orders.clear();
+        _all_sell_orders.clear();
+
+        rebuild_levels();
+        clear_changes();
+    }
 
-        auto * p = res.data();
-        size_t l = res.size();
+    bool deserialize_state(const std::uint8_t *& p,
+        size_t & l,
+        std::uint8_t version   = snapshot_header::current_version,
+        snapshot_layout layout = snapshot_layout::compact)
+    {
+        bool res = false;
+
+        if (version < 2u)
+        {
+            res = deserialize_order_map(p, l, _all_buy_orders) && deserialize_order_map(p, l, _all_sell_orders);
+        }
+        else if (layout == snapshot_layout::image)
+        {
+            res = deserialize_order_image(p, l, _all_buy_orders) && deserialize_order_image(p, l, _all_sell_orders);
+        }
+        else
+        {
+            res = deserialize_order_store(p, l, _all_buy_orders) && deserialize_order_store(p, l, _all_sell_orders);
+        }
 
-        serialize_order_map(p, l, _all_buy_orders);
-        serialize_order_map(p, l, _all_sell_orders);
+        rebuild_levels();
+        clear_changes();
 
         return res;
     }
 
-    bool deserialize_state(const std::uint8_t *& p, size_t & l)
+private:
+    void rebuild_levels()
+    {
+        _buy_depth.invalidate();
+        _sell_depth.invalidate();
+
+        _buy_ladder.rebuild(_all_buy_orders);
+        _sell_ladder.rebuild(_all_sell_orders);
+    }
+
+    static void upsert(store_type & m, std::uint64_t reference, const order & o)
     {
-        if (!deserialize_order_map(p, l, _all_buy_orders)) return false;
-        return deserialize_order_map(p, l, _all_sell_orders);
+        const bool found = m.update(reference, [&o](order & existing) {
+            existing = o;
+            return false;
+        });
+
+        if (!found) m.emplace(reference, o);
+    }
+
+    void erase(std::uint64_t reference)
+    {
+        const auto erase_order = [](const order &) { return true; };
+        if (!_all_buy_orders.update(reference, erase_order)) _all_sell_orders.update(reference, erase_order);
+    }
+
+    // version 1 deltas, raw orders
+    static bool apply_raw_upserts(const std::uint8_t *& p, size_t & l, store_type & m)
+    {
+        std::uint64_t count;
+        if (!deserialize_integer(p, l, count)) return false;
+
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            std::uint64_t reference;
+            order o;
+
+            if (!deserialize_integer(p, l, reference)) return false;
+            if (!deserialize_integer(p, l, o.price)) return false;
+            if (!deserialize_integer(p, l, o.shares)) return false;
+
+            upsert(m, reference, o);
+        }
+
+        return true;
+    }
+
+    bool apply_raw_changes(const std::uint8_t *& p, size_t & l)
+    {
+        if (!apply_raw_upserts(p, l, _all_buy_orders) || !apply_raw_upserts(p, l, _all_sell_orders)) return false;
+
+        std::uint64_t removed_count = 0;
+        if (!deserialize_integer(p, l, removed_count)) return false;
+
+        for (std::uint64_t i = 0; i < removed_count; ++i)
+        {
+            std::uint64_t reference;
+            if (!deserialize_integer(p, l, reference)) return false;
+
+            erase(reference);
+        }
+
+        return true;
+    }
+
+    bool apply_compact_changes(const std::uint8_t *& p, size_t & l)
+    {
+        const auto upsert_buy  = [this](std::uint64_t reference, const order & o) { upsert(_all_buy_orders, reference, o); };
+        const auto upsert_sell = [this](std::uint64_t reference, const order & o) { upsert(_all_sell_orders, reference, o); };
+
+        if (!deserialize_orders(p, l, upsert_buy) || !deserialize_orders(p, l, upsert_sell)) return false;
+
+        std::vector<std::uint64_t> removed;
+        if (!deserialize_references(p, l, removed)) return false;
+
+        for (const auto reference : removed)
+        {
+            erase(reference);
+        }
+
+        return true;
+    }
+
+public:
+    // remembers the references of the orders added, modified or removed until clear_changes() is called
+    // this is what delta snapshots are made of
+    void track_changes(bool enable)
+    {
+        _track_changes = enable;
+        clear_changes();
+    }
+
+    bool tracks_changes() const noexcept
+    {
+        return _track_changes;
+    }
+
+    void clear_changes()
+    {
+        _changes.clear();
+    }
+
+    size_t changes_count() const noexcept
+    {
+        return _changes.size();
+    }
+
+    // appends the orders changed since the last clear_changes() to the buffer, in the current snapshot format
+    // the buy and sell orders that still exist, then the references of those which no longer do
+    void serialize_changes(std::vector<std::uint8_t> & res) const
+    {
+        order_entries buys;
+        order_entries sells;
+        std::vector<std::uint64_t> removed;
+
+        for (const auto reference : _changes)
+        {
+            if (const auto o = _all_buy_orders.find(reference))
+            {
+                buys.emplace_back(reference, *o);
+            }
+            else if (const auto o = _all_sell_orders.find(reference))
+            {
+                sells.emplace_back(reference, *o);
+            }
+            else
+            {
+                removed.push_back(reference);
+            }
+        }
+
+        serialize_orders(res, buys);
+        serialize_orders(res, sells);
+        serialize_references(res, removed);
+    }
+
+    // applies changes written by serialize_changes() on top of the current state
+    bool apply_changes(const std::uint8_t *& p, size_t & l, std::uint8_t version = snapshot_header::current_version)
+    {
+        const bool res = (version < 2u) ? apply_raw_changes(p, l) : apply_compact_changes(p, l);
+
+        rebuild_levels();
+        clear_changes();
+
+        return res;
     }
 
 private:
-    order_map _all_buy_orders;
-    order_map _all_sell_orders;
+    store_type _all_buy_orders;
+    store_type _all_sell_orders;
+
+    // rebuilt lazily from the const accessors
+    mutable depth_book _buy_depth;
+    mutable depth_book _sell_depth;
+
+    level_ladder _buy_ladder{true};
+    level_ladder _sell_ladder{false};
+
+    bbo_timeline * _bbo_timeline{nullptr};
+
+    execution_log * _executions{nullptr};
+    flow_metrics * _flow{nullptr};
+    level_delta_log * _level_deltas{nullptr};
+    participant_book * _participants{nullptr};
+    // the time of the order being executed, for the execution log
+    std::int64_t _timestamp{0};
+
+    bool _track_changes{false};
+    robin_hood::unordered_flat_set<std::uint64_t> _changes;
 };
 
+using execution_engine = basic_execution_engine<>;
+
 } // namespace itch
\ No newline at end of file
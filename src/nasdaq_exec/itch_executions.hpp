@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// an order executed against a resting order, a hidden order or in a cross
+struct execution
+{
+    // nanoseconds since the epoch
+    std::int64_t timestamp;
+    std::uint64_t reference;
+    // fixed point, the price of the resting order unless the execution had its own
+    std::uint32_t price;
+    std::uint32_t shares;
+    // the side of the resting order, a cross has no side and is a sell
+    bool is_buy;
+    // a non printable execution is part of a later cross trade, it must not be counted twice in the volumes
+    bool printable{true};
+};
+
+// the executions in the order they happened, the consumer clears the log once it has read them
+class execution_log
+{
+public:
+    void reserve(size_t s)
+    {
+        _executions.reserve(s);
+    }
+
+    void append(const execution & e)
+    {
+        _executions.push_back(e);
+    }
+
+    size_t size() const noexcept
+    {
+        return _executions.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return _executions.empty();
+    }
+
+    void clear()
+    {
+        _executions.clear();
+    }
+
+    const execution & operator[](size_t i) const noexcept
+    {
+        return _executions[i];
+    }
+
+    std::vector<execution>::const_iterator begin() const noexcept
+    {
+        return _executions.cbegin();
+    }
+
+    std::vector<execution>::const_iterator end() const noexcept
+    {
+        return _executions.cend();
+    }
+
+private:
+    std::vector<execution> _executions;
+};
+
+} // namespace itch
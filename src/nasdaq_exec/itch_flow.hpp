@@ -0,0 +1,195 @@
+#pragma once
+
+#include "itch_depth.hpp"
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace itch
+{
+
+// Order flow imbalance and depth imbalance of the best levels, updated after every event from the levels the engine
+// already maintains, which costs a pass on the deepest levels and nothing else.
+//
+// The flow of the k-th level is what arrives on the bid minus what leaves it, minus the same on the ask:
+//
+//   e(k) = [bid >= previous bid] bid shares - [bid <= previous bid] previous bid shares
+//        - [ask <= previous ask] ask shares + [ask >= previous ask] previous ask shares
+//
+// the order flow imbalance at depth L is the sum of the flows of the levels 1 to L since the last sample,
+// the depth imbalance at depth L compares the shares of the L best levels of both sides, from -1 to 1
+class flow_metrics
+{
+public:
+    // the depths at which the metrics are computed, the engine tracks the deepest one
+    explicit flow_metrics(std::vector<size_t> depths)
+        : _depths{std::move(depths)}
+    {
+        std::sort(_depths.begin(), _depths.end());
+        _depths.erase(std::unique(_depths.begin(), _depths.end()), _depths.end());
+        _depths.erase(std::remove(_depths.begin(), _depths.end(), size_t{0}), _depths.end());
+
+        _flows.assign(_depths.size(), 0);
+
+        _buy.assign(max_depth(), price_level{0, 0, 0});
+        _sell.assign(max_depth(), price_level{0, 0, 0});
+    }
+
+private:
+    static price_level level_or_empty(const std::vector<price_level> & levels, size_t k) noexcept
+    {
+        return (k < levels.size()) ? levels[k] : price_level{0, 0, 0};
+    }
+
+    // an empty bid is below every price
+    static std::int64_t bid_flow(const price_level & current, const price_level & previous) noexcept
+    {
+        std::int64_t res = 0;
+
+        if (current.price >= previous.price) res += current.shares;
+        if (current.price <= previous.price) res -= previous.shares;
+
+        return res;
+    }
+
+    // an empty ask is above every price
+    static std::int64_t ask_flow(const price_level & current, const price_level & previous) noexcept
+    {
+        const std::uint32_t current_price  = current.shares ? current.price : std::numeric_limits<std::uint32_t>::max();
+        const std::uint32_t previous_price = previous.shares ? previous.price : std::numeric_limits<std::uint32_t>::max();
+
+        std::int64_t res = 0;
+
+        if (current_price <= previous_price) res += current.shares;
+        if (current_price >= previous_price) res -= previous.shares;
+
+        return res;
+    }
+
+public:
+    const std::vector<size_t> & depths() const noexcept
+    {
+        return _depths;
+    }
+
+    size_t max_depth() const noexcept
+    {
+        return _depths.empty() ? 0u : _depths.back();
+    }
+
+    // the best levels after an event, best first
+    void update(const std::vector<price_level> & buys, const std::vector<price_level> & sells)
+    {
+        std::int64_t flow = 0;
+        size_t d          = 0;
+
+        for (size_t k = 0; k < _buy.size(); ++k)
+        {
+            const price_level b = level_or_empty(buys, k);
+            const price_level a = level_or_empty(sells, k);
+
+            flow += bid_flow(b, _buy[k]) - ask_flow(a, _sell[k]);
+
+            _buy[k]  = b;
+            _sell[k] = a;
+
+            if (k + 1u == _depths[d]) _flows[d++] += flow;
+        }
+    }
+
+    // the order flow imbalance at the i-th depth since the flows were last reset
+    std::int64_t flow(size_t i) const noexcept
+    {
+        return _flows[i];
+    }
+
+    void reset_flows() noexcept
+    {
+        std::fill(_flows.begin(), _flows.end(), 0);
+    }
+
+    // the depth imbalance at the i-th depth, 0 when both sides are empty
+    double imbalance(size_t i) const noexcept
+    {
+        std::uint64_t buy_shares  = 0;
+        std::uint64_t sell_shares = 0;
+
+        for (size_t k = 0; k < _depths[i]; ++k)
+        {
+            buy_shares += _buy[k].shares;
+            sell_shares += _sell[k].shares;
+        }
+
+        const auto total = buy_shares + sell_shares;
+
+        return total ? (static_cast<double>(buy_shares) - static_cast<double>(sell_shares)) / static_cast<double>(total) : 0.0;
+    }
+
+private:
+    std::vector<size_t> _depths;
+    std::vector<std::int64_t> _flows;
+
+    // the levels after the last update
+    std::vector<price_level> _buy;
+    std::vector<price_level> _sell;
+};
+
+// the metrics sampled on a time grid, one column per metric and depth
+class flow_samples
+{
+public:
+    explicit flow_samples(size_t depths)
+        : flows(depths)
+        , imbalances(depths)
+    {}
+
+    void reserve(size_t s)
+    {
+        timestamps.reserve(s);
+
+        for (auto & c : flows)
+        {
+            c.reserve(s);
+        }
+
+        for (auto & c : imbalances)
+        {
+            c.reserve(s);
+        }
+    }
+
+    // the flows since the previous sample, the metrics are ready for the next one
+    void append(const utils::timespec & timestamp, flow_metrics & m)
+    {
+        timestamps.push_back(timestamp);
+
+        for (size_t i = 0; i < flows.size(); ++i)
+        {
+            flows[i].push_back(m.flow(i));
+            imbalances[i].push_back(m.imbalance(i));
+        }
+
+        m.reset_flows();
+    }
+
+    size_t size() const noexcept
+    {
+        return timestamps.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return timestamps.empty();
+    }
+
+public:
+    std::vector<utils::timespec> timestamps;
+
+    // indexed by depth, then by sample
+    std::vector<std::vector<std::int64_t>> flows;
+    std::vector<std::vector<double>> imbalances;
+};
+
+} // namespace itch
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "itch_snapshot.hpp"
+#include <rh/robin_hood.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace itch
+{
+
+// the liquidity of one market participant
+struct participant_liquidity
+{
+    // packed with pack_mpid, 0 for the anonymous orders
+    std::uint32_t mpid{0};
+
+    // resting shares
+    std::uint64_t buy_shares{0};
+    std::uint64_t sell_shares{0};
+
+    // shares of its resting orders that were executed
+    std::uint64_t executed{0};
+};
+
+// The resting and executed shares of every market participant, updated by the engine as the orders come and go.
+//
+// Participants are interned to small ids in the order they first appear, id 0 being all the anonymous orders,
+// only the orders of an identified participant are remembered, which keeps the cost of the anonymous flow to an
+// addition. A replace keeps the participant of the original order.
+//
+// Every total is maintained incrementally, the shares of liquidity at any point of the replay are a pass on the
+// participants, not on the orders.
+class participant_book
+{
+public:
+    participant_book()
+        : _participants(1u)
+    {}
+
+private:
+    std::uint16_t intern(std::uint32_t mpid)
+    {
+        auto it = _ids.find(mpid);
+        if (it != _ids.end()) return it->second;
+
+        if (_participants.size() > std::numeric_limits<std::uint16_t>::max()) throw std::length_error("too many participants");
+
+        const auto id = static_cast<std::uint16_t>(_participants.size());
+
+        _participants.emplace_back();
+        _participants.back().mpid = mpid;
+
+        _ids.emplace(mpid, id);
+
+        return id;
+    }
+
+    std::uint16_t find(std::uint64_t reference) const
+    {
+        if (_orders.empty()) return 0u;
+
+        auto it = _orders.find(reference);
+        return (it != _orders.end()) ? it->second : std::uint16_t{0};
+    }
+
+    std::uint64_t & resting(std::uint16_t id, bool is_buy) noexcept
+    {
+        return is_buy ? _participants[id].buy_shares : _participants[id].sell_shares;
+    }
+
+public:
+    // mpid is 0 for an anonymous order
+    void add(bool is_buy, std::uint64_t reference, std::uint32_t shares, std::uint32_t mpid)
+    {
+        std::uint16_t id = 0;
+
+        if (mpid)
+        {
+            id = intern(mpid);
+            _orders[reference] = id;
+        }
+
+        resting(id, is_buy) += shares;
+    }
+
+    // an execution or a cancel of part of the order, depleted when nothing is left
+    void reduce(bool is_buy, std::uint64_t reference, std::uint32_t shares, bool executed, bool depleted)
+    {
+        const auto id = find(reference);
+
+        resting(id, is_buy) -= shares;
+        if (executed) _participants[id].executed += shares;
+
+        if (id && depleted) _orders.erase(reference);
+    }
+
+    // the order is gone with the shares it had left
+    void remove(bool is_buy, std::uint64_t reference, std::uint32_t shares)
+    {
+        const auto id = find(reference);
+
+        resting(id, is_buy) -= shares;
+
+        if (id) _orders.erase(reference);
+    }
+
+    void replace(bool is_buy, std::uint64_t reference, std::uint64_t new_reference, std::uint32_t shares, std::uint32_t new_shares)
+    {
+        const auto id = find(reference);
+
+        resting(id, is_buy) -= shares;
+        resting(id, is_buy) += new_shares;
+
+        if (!id) return;
+
+        _orders.erase(reference);
+        _orders[new_reference] = id;
+    }
+
+    // anonymous first, then in the order of appearance
+    const std::vector<participant_liquidity> & participants() const noexcept
+    {
+        return _participants;
+    }
+
+    // the totals of every participant, anonymous included
+    participant_liquidity total() const noexcept
+    {
+        participant_liquidity res;
+
+        for (const auto & p : _participants)
+        {
+            res.buy_shares += p.buy_shares;
+            res.sell_shares += p.sell_shares;
+            res.executed += p.executed;
+        }
+
+        return res;
+    }
+
+    void clear()
+    {
+        _participants.assign(1u, participant_liquidity{});
+        _ids.clear();
+        _orders.clear();
+    }
+
+    static constexpr std::uint32_t magic          = 0x52415053; // "SPAR"
+    static constexpr std::uint8_t current_version = 1;
+
+private:
+    static constexpr size_t header_size = sizeof(std::uint32_t) + sizeof(std::uint8_t) + sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+public:
+    // Stored next to a snapshot, always in full as the identified orders are a small part of the book:
+    //
+    //  - magic, version, size and CRC-32C of the body
+    //  - the participants by id, (mpid, buy shares, sell shares, executed shares) as varints
+    //  - the references of the identified orders, sorted and delta encoded, then their participant ids as varints
+    std::vector<std::uint8_t> serialize() const
+    {
+        std::vector<std::uint8_t> res(header_size);
+
+        serialize_varint(res, _participants.size());
+
+        for (const auto & p : _participants)
+        {
+            serialize_varint(res, p.mpid);
+            serialize_varint(res, p.buy_shares);
+            serialize_varint(res, p.sell_shares);
+            serialize_varint(res, p.executed);
+        }
+
+        std::vector<std::pair<std::uint64_t, std::uint16_t>> orders;
+        orders.reserve(_orders.size());
+
+        for (const auto & o : _orders)
+        {
+            orders.emplace_back(o.first, o.second);
+        }
+
+        std::sort(orders.begin(), orders.end());
+
+        std::vector<std::uint64_t> references(orders.size());
+        std::transform(orders.cbegin(), orders.cend(), references.begin(), [](const auto & o) { return o.first; });
+
+        serialize_references(res, references);
+
+        for (const auto & o : orders)
+        {
+            serialize_varint(res, o.second);
+        }
+
+        auto * p = res.data();
+        size_t l = header_size;
+
+        serialize_integer(p, l, magic);
+        serialize_integer(p, l, current_version);
+        serialize_integer(p, l, static_cast<std::uint64_t>(res.size() - header_size));
+        serialize_integer(p, l, utils::crc32c(res.data() + header_size, res.size() - header_size));
+
+        return res;
+    }
+
+    // false when truncated or corrupted, the book is then empty
+    bool deserialize(const std::uint8_t * p, size_t l)
+    {
+        clear();
+
+        if (!deserialize_body(p, l))
+        {
+            clear();
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    bool deserialize_body(const std::uint8_t * p, size_t l)
+    {
+        std::uint32_t m;
+        std::uint8_t version;
+        std::uint64_t body_size;
+        std::uint32_t checksum;
+
+        if (!deserialize_integer(p, l, m) || (m != magic)) return false;
+        if (!deserialize_integer(p, l, version) || (version != current_version)) return false;
+        if (!deserialize_integer(p, l, body_size) || !deserialize_integer(p, l, checksum)) return false;
+        if ((body_size != l) || (utils::crc32c(p, l) != checksum)) return false;
+
+        std::uint64_t count;
+        if (!deserialize_varint(p, l, count) || !count || (count > std::numeric_limits<std::uint16_t>::max() + 1u)) return false;
+
+        _participants.resize(static_cast<size_t>(count));
+
+        for (size_t id = 0; id < _participants.size(); ++id)
+        {
+            auto & participant = _participants[id];
+
+            std::uint64_t mpid;
+            if (!deserialize_varint(p, l, mpid) || (mpid > std::numeric_limits<std::uint32_t>::max())) return false;
+
+            if (!deserialize_varint(p, l, participant.buy_shares)) return false;
+            if (!deserialize_varint(p, l, participant.sell_shares)) return false;
+            if (!deserialize_varint(p, l, participant.executed)) return false;
+
+            participant.mpid = static_cast<std::uint32_t>(mpid);
+
+            // the anonymous orders are always id 0
+            if (!id != !participant.mpid) return false;
+            if (id) _ids.emplace(participant.mpid, static_cast<std::uint16_t>(id));
+        }
+
+        std::vector<std::uint64_t> references;
+        if (!deserialize_references(p, l, references)) return false;
+
+        _orders.reserve(references.size());
+
+        for (const auto r : references)
+        {
+            std::uint64_t id;
+            if (!deserialize_varint(p, l, id) || !id || (id >= _participants.size())) return false;
+
+            _orders.emplace(r, static_cast<std::uint16_t>(id));
+        }
+
+        return !l;
+    }
+
+private:
+    std::vector<participant_liquidity> _participants;
+    robin_hood::unordered_flat_map<std::uint32_t, std::uint16_t> _ids;
+
+    // the orders of the identified participants only
+    robin_hood::unordered_flat_map<std::uint64_t, std::uint16_t> _orders;
+};
+
+} // namespace itch
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "itch_depth.hpp"
+#include "itch_snapshot.hpp"
+#include <utils/timespec.hpp>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace itch
+{
+
+// The binary protocol of the book service, every integer is little endian.
+//
+// A message is its size as a uint32 followed by its content, queries and answers alternate on a connection.
+//
+// query:  version (u8), stock size (u8), stock, time (i64 seconds, i64 nanoseconds), depth (u16)
+// answer: version (u8), status (u8), warm (u8), engine time (i64 seconds, i64 nanoseconds), replayed orders (u64),
+//         elapsed microseconds (u64), buy levels (u32), sell levels (u32), then the levels, best first,
+//         each as price (u32, fixed point), shares (u32) and orders (u32)
+//
+// an answer whose status isn't ok has no levels
+namespace protocol
+{
+
+static constexpr std::uint8_t version = 1;
+
+// larger messages are refused, a query is a few dozen bytes
+static constexpr std::uint32_t max_query_size = 1024u;
+
+enum class status : std::uint8_t
+{
+    ok          = 0,
+    bad_request = 1,
+    failure     = 2
+};
+
+struct book_query
+{
+    std::string stock;
+    utils::timespec when;
+    std::uint16_t depth{0};
+};
+
+struct book_answer
+{
+    status result{status::ok};
+    // the engine was already positioned before the requested time and only replayed the gap
+    bool warm{false};
+    utils::timespec time;
+    std::uint64_t replayed{0};
+    std::uint64_t elapsed_us{0};
+    std::vector<price_level> buy;
+    std::vector<price_level> sell;
+};
+
+inline std::vector<std::uint8_t> serialize_query(const book_query & q)
+{
+    if (q.stock.size() > 255u) throw std::length_error("stock name too long");
+
+    std::vector<std::uint8_t> res(sizeof(std::uint8_t) * 2u + q.stock.size() + sizeof(std::int64_t) * 2u + sizeof(std::uint16_t));
+
+    std::uint8_t * p = res.data();
+    size_t l         = res.size();
+
+    serialize_integer(p, l, version);
+    serialize_integer(p, l, static_cast<std::uint8_t>(q.stock.size()));
+    std::memcpy(p, q.stock.data(), q.stock.size());
+    p += q.stock.size();
+    l -= q.stock.size();
+    serialize_integer(p, l, static_cast<std::int64_t>(q.when.sec.count()));
+    serialize_integer(p, l, static_cast<std::int64_t>(q.when.nsec.count()));
+    serialize_integer(p, l, q.depth);
+
+    return res;
+}
+
+inline bool deserialize_query(const std::uint8_t * p, size_t l, book_query & q)
+{
+    std::uint8_t v          = 0;
+    std::uint8_t stock_size = 0;
+    std::int64_t sec        = 0;
+    std::int64_t nsec       = 0;
+
+    if (!deserialize_integer(p, l, v) || (v != version)) return false;
+    if (!deserialize_integer(p, l, stock_size) || (l < stock_size)) return false;
+
+    q.stock.assign(reinterpret_cast<const char *>(p), stock_size);
+    p += stock_size;
+    l -= stock_size;
+
+    if (!deserialize_integer(p, l, sec) || !deserialize_integer(p, l, nsec) || !deserialize_integer(p, l, q.depth)) return false;
+    if ((nsec < 0) || (nsec >= 1'000'000'000)) return false;
+
+    q.when = utils::timespec{utils::seconds{sec}, utils::nanoseconds{nsec}};
+
+    return !q.stock.empty() && !l;
+}
+
+inline std::vector<std::uint8_t> serialize_answer(const book_answer & a)
+{
+    const size_t levels = a.buy.size() + a.sell.size();
+
+    std::vector<std::uint8_t> res(sizeof(std::uint8_t) * 3u + sizeof(std::int64_t) * 2u + sizeof(std::uint64_t) * 2u
+                                  + sizeof(std::uint32_t) * 2u + levels * sizeof(std::uint32_t) * 3u);
+
+    std::uint8_t * p = res.data();
+    size_t l         = res.size();
+
+    serialize_integer(p, l, version);
+    serialize_integer(p, l, static_cast<std::uint8_t>(a.result));
+    serialize_integer(p, l, static_cast<std::uint8_t>(a.warm));
+    serialize_integer(p, l, static_cast<std::int64_t>(a.time.sec.count()));
+    serialize_integer(p, l, static_cast<std::int64_t>(a.time.nsec.count()));
+    serialize_integer(p, l, a.replayed);
+    serialize_integer(p, l, a.elapsed_us);
+    serialize_integer(p, l, static_cast<std::uint32_t>(a.buy.size()));
+    serialize_integer(p, l, static_cast<std::uint32_t>(a.sell.size()));
+
+    for (const auto & side : {&a.buy, &a.sell})
+    {
+        for (const auto & level : *side)
+        {
+            serialize_integer(p, l, level.price);
+            serialize_integer(p, l, level.shares);
+            serialize_integer(p, l, level.orders);
+        }
+    }
+
+    return res;
+}
+
+inline bool deserialize_answer(const std::uint8_t * p, size_t l, book_answer & a)
+{
+    std::uint8_t v           = 0;
+    std::uint8_t result      = 0;
+    std::uint8_t warm        = 0;
+    std::int64_t sec         = 0;
+    std::int64_t nsec        = 0;
+    std::uint32_t buy_count  = 0;
+    std::uint32_t sell_count = 0;
+
+    if (!deserialize_integer(p, l, v) || (v != version)) return false;
+    if (!deserialize_integer(p, l, result) || !deserialize_integer(p, l, warm)) return false;
+    if (!deserialize_integer(p, l, sec) || !deserialize_integer(p, l, nsec)) return false;
+    if (!deserialize_integer(p, l, a.replayed) || !deserialize_integer(p, l, a.elapsed_us)) return false;
+    if (!deserialize_integer(p, l, buy_count) || !deserialize_integer(p, l, sell_count)) return false;
+
+    // don't trust the counts for the allocation
+    if ((static_cast<std::uint64_t>(buy_count) + sell_count) * sizeof(std::uint32_t) * 3u != l) return false;
+
+    a.result = static_cast<status>(result);
+    a.warm   = warm != 0;
+    a.time   = utils::timespec{utils::seconds{sec}, utils::nanoseconds{nsec}};
+
+    const auto read_levels = [&p, &l](std::vector<price_level> & levels, std::uint32_t count) {
+        levels.resize(count);
+
+        for (auto & level : levels)
+        {
+            deserialize_integer(p, l, level.price);
+            deserialize_integer(p, l, level.shares);
+            deserialize_integer(p, l, level.orders);
+        }
+    };
+
+    read_levels(a.buy, buy_count);
+    read_levels(a.sell, sell_count);
+
+    return true;
+}
+
+} // namespace protocol
+
+} // namespace itch
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "itch_depth.hpp"
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace itch
+{
+
+// compact collapsed view of the top of the book, what the readers get
+struct book_image
+{
+    static constexpr size_t max_levels = 32;
+
+    utils::timespec timestamp;
+
+    // number of messages applied to the engine when the image was taken
+    std::uint64_t messages{0};
+
+    std::uint32_t buy_count{0};
+    std::uint32_t sell_count{0};
+
+    // best levels first
+    std::array<price_level, max_levels> buy;
+    std::array<price_level, max_levels> sell;
+};
+
+static_assert(std::is_trivially_copyable_v<book_image>, "the image is copied in and out of the seqlock with memcpy");
+
+// single writer, multiple readers sequence lock
+// the writer never waits, readers retry when they raced with the writer
+// an odd sequence means a write is in progress, the epoch is the number of completed writes
+template <typename T>
+class seqlock
+{
+    static_assert(std::is_trivially_copyable_v<T>, "seqlock only works with trivially copyable types");
+
+public:
+    void store(const T & v) noexcept
+    {
+        const std::uint64_t seq = _seq.load(std::memory_order_relaxed);
+
+        _seq.store(seq + 1u, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(&_value, &v, sizeof(T));
+
+        _seq.store(seq + 2u, std::memory_order_release);
+    }
+
+    // returns the number of retries it took to get a consistent copy
+    std::uint64_t load(T & v) const noexcept
+    {
+        std::uint64_t retries = 0;
+
+        for (;; ++retries)
+        {
+            const std::uint64_t before = _seq.load(std::memory_order_acquire);
+            if (before & 1u) continue;
+
+            std::memcpy(&v, &_value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (_seq.load(std::memory_order_relaxed) == before) return retries;
+        }
+    }
+
+    std::uint64_t epoch() const noexcept
+    {
+        return _seq.load(std::memory_order_acquire) >> 1u;
+    }
+
+private:
+    alignas(64) std::atomic<std::uint64_t> _seq{0};
+    alignas(64) T _value;
+};
+
+// when the writer publishes, 0 disables the criterion
+struct publication_policy
+{
+    std::uint64_t messages{0};
+    std::chrono::microseconds interval{0};
+};
+
+// what a reader went through, every reader keeps its own so that the readers never write to a shared cache line
+struct read_metrics
+{
+    std::uint64_t reads{0};
+    std::uint64_t retries{0};
+
+    read_metrics & operator+=(const read_metrics & other) noexcept
+    {
+        reads += other.reads;
+        retries += other.retries;
+        return *this;
+    }
+};
+
+// the writer applies the order flow to its engine and periodically publishes an image of the top of the book
+// the readers copy the last published image without ever blocking the writer
+// the engine must track at least as many levels as published, see execution_engine::set_depth
+class book_publisher
+{
+    using clock = std::chrono::steady_clock;
+
+    // the clock is read every clock_period messages only, an interval publication may be late by as many messages
+    static constexpr std::uint64_t clock_period = 64u;
+
+public:
+    book_publisher(size_t levels, publication_policy policy)
+        : _levels{std::min(levels, book_image::max_levels)}
+        , _policy{policy}
+        , _last_publication{clock::now()}
+    {}
+
+private:
+    bool due() const noexcept
+    {
+        if (_policy.messages && ((_messages - _image.messages) >= _policy.messages)) return true;
+        if ((_policy.interval.count() <= 0) || (_messages % clock_period)) return false;
+        return (clock::now() - _last_publication) >= _policy.interval;
+    }
+
+    static std::uint32_t copy_levels(
+        const std::vector<price_level> & from, std::array<price_level, book_image::max_levels> & to, size_t count)
+    {
+        const auto n = std::min(from.size(), count);
+        std::copy(from.cbegin(), from.cbegin() + static_cast<std::ptrdiff_t>(n), to.begin());
+        return static_cast<std::uint32_t>(n);
+    }
+
+public:
+    size_t levels() const noexcept
+    {
+        return _levels;
+    }
+
+    // writer side, to be called after each message applied, returns true if an image was published
+    template <typename Engine>
+    bool on_message(const Engine & engine, const utils::timespec & timestamp)
+    {
+        ++_messages;
+
+        if (!due()) return false;
+
+        publish(engine, timestamp);
+        return true;
+    }
+
+    // writer side, unconditional publication
+    template <typename Engine>
+    void publish(const Engine & engine, const utils::timespec & timestamp)
+    {
+        _image.timestamp  = timestamp;
+        _image.messages   = _messages;
+        _image.buy_count  = copy_levels(engine.buy_levels(), _image.buy, _levels);
+        _image.sell_count = copy_levels(engine.sell_levels(), _image.sell, _levels);
+
+        _lock.store(_image);
+
+        if (_policy.interval.count() > 0) _last_publication = clock::now();
+    }
+
+    // reader side, can be called from any number of threads, each with its own metrics
+    void read(book_image & image, read_metrics & metrics) const noexcept
+    {
+        metrics.retries += _lock.load(image);
+        ++metrics.reads;
+    }
+
+    // the number of images published, the epoch of the lock
+    std::uint64_t published() const noexcept
+    {
+        return _lock.epoch();
+    }
+
+private:
+    // writer state
+    size_t _levels;
+    publication_policy _policy;
+    std::uint64_t _messages{0};
+    clock::time_point _last_publication;
+    book_image _image;
+
+    seqlock<book_image> _lock;
+};
+
+} // namespace itch
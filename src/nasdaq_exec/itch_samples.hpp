@@ -0,0 +1,84 @@
+#pragma once
+
+#include "itch_depth.hpp"
+#include <utils/timespec.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace itch
+{
+
+// the best levels of both sides sampled on a time grid, one row per sample
+// a row always has the same number of levels, the levels a side doesn't have are zero
+class book_samples
+{
+public:
+    explicit book_samples(size_t levels)
+        : _levels{levels}
+    {}
+
+    void reserve(size_t s)
+    {
+        timestamps.reserve(s);
+        buy.reserve(s * _levels);
+        sell.reserve(s * _levels);
+    }
+
+    void append(
+        const utils::timespec & timestamp, const std::vector<price_level> & buy_levels, const std::vector<price_level> & sell_levels)
+    {
+        timestamps.push_back(timestamp);
+
+        append_levels(buy, buy_levels);
+        append_levels(sell, sell_levels);
+    }
+
+private:
+    void append_levels(std::vector<price_level> & to, const std::vector<price_level> & from)
+    {
+        const size_t count = std::min(from.size(), _levels);
+
+        to.insert(to.end(), from.cbegin(), from.cbegin() + static_cast<std::ptrdiff_t>(count));
+        to.resize(to.size() + (_levels - count), price_level{0, 0, 0});
+    }
+
+public:
+    size_t levels() const noexcept
+    {
+        return _levels;
+    }
+
+    size_t size() const noexcept
+    {
+        return timestamps.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return timestamps.empty();
+    }
+
+    // the level-th best level of the row
+    const price_level & buy_level(size_t row, size_t level) const noexcept
+    {
+        return buy[row * _levels + level];
+    }
+
+    const price_level & sell_level(size_t row, size_t level) const noexcept
+    {
+        return sell[row * _levels + level];
+    }
+
+public:
+    std::vector<utils::timespec> timestamps;
+
+    // size() rows of levels() levels, best first
+    std::vector<price_level> buy;
+    std::vector<price_level> sell;
+
+private:
+    size_t _levels;
+};
+
+} // namespace itch
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace itch
+{
+
+// The layouts of the order tables of a stock.
+//
+// legacy, one table <stock>_orders with a column per field:
+//
+//  - type, reference, original_reference, new_reference, is_buy, shares (int64)
+//  - price (double)
+//
+// the references that don't apply to an event are undefined, which they are for nearly every row
+//
+// is_buy has the side in bit 0. bit 1, legacy_non_printable, was added to the column later, for the executions with
+// price marked as non printable. the tables are written by the feed loader, outside of this repository, and the tables
+// loaded before the bit existed only hold 0 or 1: their executions all read as printable, as they did before
+//
+// compact, one table <stock>_events with the fields every event has:
+//
+//  - event (int64), the type, the side, the printable flag and the shares packed with pack_event
+//  - reference (int64), the original reference for a replace
+//  - price4 (int64), the price as sent by Nasdaq, with 4 decimals, 0 for events without a price
+//
+// and one table <stock>_replaces for the only field a single event type has:
+//
+//  - new_reference (int64), one row per replace, at the timestamp of the replace
+//
+// a query fetches four columns instead of seven, and one of them only has a row per replace
+//
+// the rows of a timestamp keep the order of the feed in both tables. nasdaq_exec --convert-orders writes them from the
+// legacy table of a day, a feed loader can write them directly and keep the fourth decimal of the prices
+//
+// with both layouts, the market participants of the add orders with attribution are in one table <stock>_attributions:
+//
+//  - mpid (int64), the participant packed with pack_mpid, one row per add order with attribution, at its timestamp
+//
+// anonymous orders, nearly all of them, have no row. the feed loader writes it along with the orders table, the rows
+// of a timestamp in the order of the feed, the n-th row belongs to the n-th add order with attribution of the orders
+enum class orders_schema
+{
+    legacy,
+    compact
+};
+
+static constexpr std::array<const char *, 7> legacy_order_columns{
+    "type", "reference", "original_reference", "new_reference", "is_buy", "shares", "price"};
+
+static constexpr std::array<const char *, 3> compact_event_columns{"event", "reference", "price4"};
+static constexpr const char * compact_replace_column = "new_reference";
+
+static constexpr const char * attribution_column = "mpid";
+
+inline std::string legacy_orders_table(const std::string & stock)
+{
+    return stock + "_orders";
+}
+
+inline std::string compact_events_table(const std::string & stock)
+{
+    return stock + "_events";
+}
+
+inline std::string compact_replaces_table(const std::string & stock)
+{
+    return stock + "_replaces";
+}
+
+inline std::string attributions_table(const std::string & stock)
+{
+    return stock + "_attributions";
+}
+
+// bit 1 of the legacy is_buy column, see above, a reader can't tell an old table from a day without such executions
+static constexpr std::int64_t legacy_non_printable = 2;
+
+// bits 0-7 the type, bit 8 the side, bit 9 set for a non printable execution, bits 32-63 the shares
+// the events written before the flag existed are all printable
+inline constexpr std::int64_t pack_event(char type, bool is_buy, std::uint32_t shares, bool printable = true) noexcept
+{
+    return static_cast<std::int64_t>(
+        static_cast<std::uint64_t>(static_cast<std::uint8_t>(type)) | (static_cast<std::uint64_t>(is_buy) << 8u)
+        | (static_cast<std::uint64_t>(!printable) << 9u) | (static_cast<std::uint64_t>(shares) << 32u));
+}
+
+inline constexpr char event_type(std::int64_t event) noexcept
+{
+    return static_cast<char>(static_cast<std::uint64_t>(event) & 0xffu);
+}
+
+inline constexpr bool event_is_buy(std::int64_t event) noexcept
+{
+    return ((static_cast<std::uint64_t>(event) >> 8u) & 1u) != 0;
+}
+
+inline constexpr bool event_printable(std::int64_t event) noexcept
+{
+    return ((static_cast<std::uint64_t>(event) >> 9u) & 1u) == 0;
+}
+
+inline constexpr std::uint32_t event_shares(std::int64_t event) noexcept
+{
+    return static_cast<std::uint32_t>(static_cast<std::uint64_t>(event) >> 32u);
+}
+
+// the four characters of the participant, the first one in the low byte, 0 is no participant
+inline constexpr std::uint32_t pack_mpid(const std::array<char, 4> & mpid) noexcept
+{
+    return static_cast<std::uint32_t>(static_cast<std::uint8_t>(mpid[0]))
+           | (static_cast<std::uint32_t>(static_cast<std::uint8_t>(mpid[1])) << 8u)
+           | (static_cast<std::uint32_t>(static_cast<std::uint8_t>(mpid[2])) << 16u)
+           | (static_cast<std::uint32_t>(static_cast<std::uint8_t>(mpid[3])) << 24u);
+}
+
+// without the padding spaces
+inline std::string unpack_mpid(std::uint32_t mpid)
+{
+    std::string res;
+
+    for (; mpid; mpid >>= 8u)
+    {
+        const char c = static_cast<char>(mpid & 0xffu);
+        if (c != ' ') res.push_back(c);
+    }
+
+    return res;
+}
+
+} // namespace itch
@@ -0,0 +1,711 @@
+#pragma once
+
+#include "itch_store.hpp"
+#include <utils/crc32c.hpp>
+#include <utils/timespec.hpp>
+#include <boost/endian/conversion.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace itch
+{
+
+template <typename Integer>
+inline void serialize_integer(std::uint8_t *& p, size_t & l, Integer v) noexcept
+{
+    v = boost::endian::native_to_little(v);
+    std::memcpy(p, &v, sizeof(v));
+
+    p += sizeof(v);
+    l -= sizeof(v);
+}
+
+template <typename Integer>
+inline bool deserialize_integer(const std::uint8_t *& p, size_t & l, Integer & v) noexcept
+{
+    if (l < sizeof(v)) return false;
+
+    std::memcpy(&v, p, sizeof(v));
+    v = boost::endian::little_to_native(v);
+
+    p += sizeof(v);
+    l -= sizeof(v);
+    return true;
+}
+
+// snapshots before version 2, (reference, price, shares) in the iteration order of the store
+template <typename OrderStore>
+inline bool deserialize_order_map(const std::uint8_t *& p, size_t & l, OrderStore & orders)
+{
+    std::uint64_t s;
+    if (!deserialize_integer(p, l, s)) return false;
+
+    orders.clear();
+    orders.reserve(s);
+
+    for (std::uint64_t i = 0; i < s; ++i)
+    {
+        std::uint64_t reference;
+        if (!deserialize_integer(p, l, reference)) return false;
+
+        order o;
+        if (!deserialize_integer(p, l, o.price)) return false;
+
+        if (!deserialize_integer(p, l, o.shares)) return false;
+
+        orders.emplace(reference, o);
+    }
+
+    return true;
+}
+
+inline void serialize_varint(std::vector<std::uint8_t> & out, std::uint64_t v)
+{
+    for (; v >= 0x80u; v >>= 7u)
+    {
+        out.push_back(static_cast<std::uint8_t>(v | 0x80u));
+    }
+
+    out.push_back(static_cast<std::uint8_t>(v));
+}
+
+inline bool deserialize_varint(const std::uint8_t *& p, size_t & l, std::uint64_t & v) noexcept
+{
+    v = 0;
+
+    for (unsigned shift = 0; shift < 64u; shift += 7u)
+    {
+        if (!l) return false;
+
+        const std::uint8_t b = *p++;
+        --l;
+
+        v |= static_cast<std::uint64_t>(b & 0x7fu) << shift;
+        if (!(b & 0x80u)) return true;
+    }
+
+    return false;
+}
+
+// number of bits needed to represent v
+inline std::uint8_t bit_width(std::uint64_t v) noexcept
+{
+    std::uint8_t res = 0;
+    for (; v; v >>= 1u)
+    {
+        ++res;
+    }
+    return res;
+}
+
+// Values of at most 32 bits packed with a fixed width, little endian.
+// The packed area is padded with a word so that every value can be extracted with a single unaligned 64-bit load,
+// unpacking is then a branchless loop over independent values the compiler can vectorize.
+inline size_t packed_size(size_t count, std::uint8_t width) noexcept
+{
+    return (count * width + 7u) / 8u + sizeof(std::uint64_t);
+}
+
+inline void pack_bits(std::vector<std::uint8_t> & out, const std::vector<std::uint32_t> & values, std::uint8_t width)
+{
+    const size_t offset = out.size();
+    out.resize(offset + packed_size(values.size(), width), 0);
+
+    if (!width) return;
+
+    std::uint8_t * p = out.data() + offset;
+
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        const size_t bit = i * width;
+
+        std::uint64_t w;
+        std::memcpy(&w, p + bit / 8u, sizeof(w));
+        w = boost::endian::little_to_native(w);
+        w |= static_cast<std::uint64_t>(values[i]) << (bit % 8u);
+        w = boost::endian::native_to_little(w);
+        std::memcpy(p + bit / 8u, &w, sizeof(w));
+    }
+}
+
+inline bool unpack_bits(const std::uint8_t *& p, size_t & l, std::vector<std::uint32_t> & values, size_t count, std::uint8_t width)
+{
+    if (width > 32u) return false;
+
+    const size_t s = packed_size(count, width);
+    if (l < s) return false;
+
+    values.resize(count);
+
+    const std::uint64_t mask = (std::uint64_t{1} << width) - 1u;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t bit = i * width;
+
+        std::uint64_t w;
+        std::memcpy(&w, p + bit / 8u, sizeof(w));
+        values[i] = static_cast<std::uint32_t>((boost::endian::little_to_native(w) >> (bit % 8u)) & mask);
+    }
+
+    p += s;
+    l -= s;
+
+    return true;
+}
+
+// sorted references, the first one and then the gaps between them
+inline void serialize_references(std::vector<std::uint8_t> & out, std::vector<std::uint64_t> & references)
+{
+    std::sort(references.begin(), references.end());
+
+    serialize_varint(out, references.size());
+
+    std::uint64_t previous = 0;
+    for (const auto r : references)
+    {
+        serialize_varint(out, r - previous);
+        previous = r;
+    }
+}
+
+inline bool deserialize_references(const std::uint8_t *& p, size_t & l, std::vector<std::uint64_t> & references)
+{
+    std::uint64_t count;
+    if (!deserialize_varint(p, l, count)) return false;
+
+    // every reference takes at least one byte
+    if (count > l) return false;
+
+    references.resize(static_cast<size_t>(count));
+
+    std::uint64_t previous = 0;
+    for (auto & r : references)
+    {
+        std::uint64_t gap;
+        if (!deserialize_varint(p, l, gap)) return false;
+
+        r        = previous + gap;
+        previous = r;
+    }
+
+    return true;
+}
+
+// Compact encoding of a set of orders, from version 2:
+//
+//  - the references, sorted and delta encoded
+//  - the dictionary of the distinct prices, sorted and delta encoded, there are far fewer levels than orders
+//  - for each order the index of its price in the dictionary, bit packed
+//  - for each order its shares, bit packed
+//
+// the entries are sorted by reference
+inline void serialize_orders(std::vector<std::uint8_t> & out, order_entries & entries)
+{
+    std::sort(entries.begin(), entries.end(), [](const auto & left, const auto & right) { return left.first < right.first; });
+
+    std::vector<std::uint64_t> references(entries.size());
+    std::vector<std::uint32_t> prices(entries.size());
+    std::vector<std::uint32_t> shares(entries.size());
+
+    std::uint32_t max_shares = 0;
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        references[i] = entries[i].first;
+        prices[i]     = entries[i].second.price;
+        shares[i]     = entries[i].second.shares;
+        max_shares    = std::max(max_shares, shares[i]);
+    }
+
+    serialize_references(out, references);
+
+    std::vector<std::uint32_t> levels = prices;
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+    serialize_varint(out, levels.size());
+
+    std::uint32_t previous = 0;
+    for (const auto price : levels)
+    {
+        serialize_varint(out, price - previous);
+        previous = price;
+    }
+
+    // prices become indexes in the dictionary
+    for (auto & price : prices)
+    {
+        price = static_cast<std::uint32_t>(std::lower_bound(levels.cbegin(), levels.cend(), price) - levels.cbegin());
+    }
+
+    const std::uint8_t index_width = bit_width(levels.empty() ? 0u : levels.size() - 1u);
+    out.push_back(index_width);
+    pack_bits(out, prices, index_width);
+
+    const std::uint8_t shares_width = bit_width(max_shares);
+    out.push_back(shares_width);
+    pack_bits(out, shares, shares_width);
+}
+
+// calls f(reference, const order &) for every order, by increasing reference
+template <typename Function>
+inline bool deserialize_orders(const std::uint8_t *& p, size_t & l, Function && f)
+{
+    std::vector<std::uint64_t> references;
+    if (!deserialize_references(p, l, references)) return false;
+
+    std::uint64_t levels_count;
+    if (!deserialize_varint(p, l, levels_count) || (levels_count > l)) return false;
+
+    std::vector<std::uint32_t> levels(static_cast<size_t>(levels_count));
+
+    std::uint64_t price = 0;
+    for (auto & level : levels)
+    {
+        std::uint64_t gap;
+        if (!deserialize_varint(p, l, gap)) return false;
+
+        price += gap;
+        level = static_cast<std::uint32_t>(price);
+    }
+
+    std::uint8_t index_width;
+    std::vector<std::uint32_t> indexes;
+    if (!deserialize_integer(p, l, index_width) || !unpack_bits(p, l, indexes, references.size(), index_width)) return false;
+
+    std::uint8_t shares_width;
+    std::vector<std::uint32_t> shares;
+    if (!deserialize_integer(p, l, shares_width) || !unpack_bits(p, l, shares, references.size(), shares_width)) return false;
+
+    for (size_t i = 0; i < references.size(); ++i)
+    {
+        if (indexes[i] >= levels.size()) return false;
+        f(references[i], order{levels[indexes[i]], shares[i]});
+    }
+
+    return true;
+}
+
+template <typename OrderStore>
+inline void serialize_order_store(std::vector<std::uint8_t> & out, const OrderStore & orders)
+{
+    order_entries entries;
+    entries.reserve(orders.size());
+
+    orders.for_each([&entries](std::uint64_t reference, const order & o) { entries.emplace_back(reference, o); });
+
+    serialize_orders(out, entries);
+}
+
+// the orders come sorted by reference, they are loaded in bulk
+template <typename OrderStore>
+inline bool deserialize_order_store(const std::uint8_t *& p, size_t & l, OrderStore & orders)
+{
+    order_entries entries;
+
+    const bool res = deserialize_orders(p, l, [&entries](std::uint64_t reference, const order & o) { entries.emplace_back(reference, o); });
+
+    orders.assign(entries);
+    return res;
+}
+
+template <typename OrderStore, typename = void>
+struct has_page_image : std::false_type
+{};
+
+template <typename OrderStore>
+struct has_page_image<OrderStore,
+    std::void_t<decltype(std::declval<OrderStore &>().adopt_page(size_t{}, static_cast<const std::uint8_t *>(nullptr), size_t{}))>>
+    : std::true_type
+{};
+
+template <typename OrderStore>
+static constexpr bool has_page_image_v = has_page_image<OrderStore>::value;
+
+// Image of the pages of a direct store, from version 3 with snapshot_layout::image:
+//
+//  - the number of bits of a page index and the number of pages
+//  - for each page, its index, the number of orders it contains and all its slots as (price, shares), empty slots included
+//
+// on a little endian machine the store with the same page size copies the slots of each page as is,
+// much larger than the compact encoding for thin stocks, restores in a memcpy per page
+template <typename OrderStore>
+inline void serialize_order_image(std::vector<std::uint8_t> & out, const OrderStore & orders)
+{
+    static constexpr size_t page_bytes = OrderStore::page_size * 2 * sizeof(std::uint32_t);
+    static constexpr size_t page_entry = sizeof(std::uint64_t) + sizeof(std::uint32_t) + page_bytes;
+
+    std::uint64_t pages = 0;
+    orders.for_each_page([&pages](size_t, const order *, size_t) { ++pages; });
+
+    const size_t offset = out.size();
+    out.resize(offset + sizeof(std::uint8_t) + sizeof(std::uint64_t) + pages * page_entry);
+
+    auto * p = out.data() + offset;
+    size_t l = out.size() - offset;
+
+    serialize_integer(p, l, static_cast<std::uint8_t>(OrderStore::page_bits));
+    serialize_integer(p, l, pages);
+
+    orders.for_each_page([&p, &l](size_t index, const order * slots, size_t count) {
+        serialize_integer(p, l, static_cast<std::uint64_t>(index));
+        serialize_integer(p, l, static_cast<std::uint32_t>(count));
+
+        for (size_t i = 0; i < OrderStore::page_size; ++i)
+        {
+            serialize_integer(p, l, slots[i].price);
+            serialize_integer(p, l, slots[i].shares);
+        }
+    });
+}
+
+template <typename OrderStore>
+inline bool deserialize_order_image(const std::uint8_t *& p, size_t & l, OrderStore & orders)
+{
+    std::uint8_t page_bits;
+    std::uint64_t pages;
+
+    if (!deserialize_integer(p, l, page_bits) || (page_bits > 32u)) return false;
+    if (!deserialize_integer(p, l, pages)) return false;
+
+    const size_t page_size  = size_t{1} << page_bits;
+    const size_t page_bytes = page_size * 2 * sizeof(std::uint32_t);
+
+    if (pages > l / (sizeof(std::uint64_t) + sizeof(std::uint32_t) + page_bytes)) return false;
+
+    orders.clear();
+
+    if constexpr (has_page_image_v<OrderStore>)
+    {
+        if ((boost::endian::order::native == boost::endian::order::little) && (page_bits == OrderStore::page_bits))
+        {
+            for (std::uint64_t i = 0; i < pages; ++i)
+            {
+                std::uint64_t index;
+                std::uint32_t count;
+
+                if (!deserialize_integer(p, l, index) || !deserialize_integer(p, l, count) || (count > page_size)) return false;
+
+                orders.adopt_page(static_cast<size_t>(index), p, count);
+
+                p += page_bytes;
+                l -= page_bytes;
+            }
+
+            return true;
+        }
+    }
+
+    // any other store, or another page size, gets the orders
+    order_entries entries;
+
+    for (std::uint64_t i = 0; i < pages; ++i)
+    {
+        std::uint64_t index;
+        std::uint32_t count;
+
+        if (!deserialize_integer(p, l, index) || !deserialize_integer(p, l, count)) return false;
+
+        for (size_t j = 0; j < page_size; ++j)
+        {
+            order o{};
+
+            if (!deserialize_integer(p, l, o.price) || !deserialize_integer(p, l, o.shares)) return false;
+
+            if (o.shares) entries.emplace_back((index << page_bits) | j, o);
+        }
+    }
+
+    orders.assign(entries);
+    return true;
+}
+
+enum class snapshot_kind : std::uint8_t
+{
+    // the whole state of the book
+    full = 0,
+    // the orders added, modified or removed since the base snapshot
+    delta = 1,
+};
+
+// how the orders of a full snapshot are written, deltas are always compact
+enum class snapshot_layout : std::uint8_t
+{
+    // see serialize_orders
+    compact = 0,
+    // see serialize_order_image, only for the stores that have pages
+    image = 1,
+};
+
+// Snapshots written before the header existed start directly with the buy orders map, they are read as version 0 full snapshots.
+// The magic number cannot be mistaken for the low bits of an order count.
+//
+//  - version 1: raw orders
+//  - version 2: compact orders (see serialize_orders), the size and CRC-32C of the body follow the header
+//  - version 3: the layout of the orders follows the checksum
+struct snapshot_header
+{
+    static constexpr std::uint32_t magic          = 0x50414e53; // "SNAP"
+    static constexpr std::uint8_t legacy_version  = 0;
+    static constexpr std::uint8_t current_version = 3;
+
+    std::uint8_t version{current_version};
+    snapshot_kind kind{snapshot_kind::full};
+
+    // number of deltas since the last full snapshot, 0 for a full snapshot
+    std::uint16_t chain{0};
+
+    // for a delta, the timestamp of the snapshot it applies to
+    utils::timespec base;
+
+    // from version 2
+    std::uint64_t body_size{0};
+    std::uint32_t checksum{0};
+
+    // from version 3
+    snapshot_layout layout{snapshot_layout::compact};
+
+    static constexpr size_t serialized_size(std::uint8_t version) noexcept
+    {
+        return sizeof(std::uint32_t) + 2 * sizeof(std::uint8_t) + sizeof(std::uint16_t) + 2 * sizeof(std::int64_t)
+               + ((version >= 2u) ? (sizeof(std::uint64_t) + sizeof(std::uint32_t)) : 0u) + ((version >= 3u) ? sizeof(std::uint8_t) : 0u);
+    }
+};
+
+inline void serialize_snapshot_header(std::uint8_t *& p, size_t & l, const snapshot_header & h) noexcept
+{
+    serialize_integer(p, l, snapshot_header::magic);
+    serialize_integer(p, l, h.version);
+    serialize_integer(p, l, static_cast<std::uint8_t>(h.kind));
+    serialize_integer(p, l, h.chain);
+    serialize_integer(p, l, static_cast<std::int64_t>(h.base.sec.count()));
+    serialize_integer(p, l, static_cast<std::int64_t>(h.base.nsec.count()));
+
+    if (h.version >= 2u)
+    {
+        serialize_integer(p, l, h.body_size);
+        serialize_integer(p, l, h.checksum);
+    }
+
+    if (h.version >= 3u)
+    {
+        serialize_integer(p, l, static_cast<std::uint8_t>(h.layout));
+    }
+}
+
+// returns false if there is no header, in which case nothing is consumed and the header describes a legacy snapshot
+inline bool deserialize_snapshot_header(const std::uint8_t *& p, size_t & l, snapshot_header & h) noexcept
+{
+    h         = snapshot_header{};
+    h.version = snapshot_header::legacy_version;
+
+    const std::uint8_t * local_p = p;
+    size_t local_l               = l;
+
+    std::uint32_t magic;
+    if (!deserialize_integer(local_p, local_l, magic) || (magic != snapshot_header::magic)) return false;
+
+    std::uint8_t version;
+    std::uint8_t kind;
+    std::int64_t sec;
+    std::int64_t nsec;
+
+    if (!deserialize_integer(local_p, local_l, version)) return false;
+    if (!deserialize_integer(local_p, local_l, kind)) return false;
+    if (!deserialize_integer(local_p, local_l, h.chain)) return false;
+    if (!deserialize_integer(local_p, local_l, sec)) return false;
+    if (!deserialize_integer(local_p, local_l, nsec)) return false;
+
+    if (!version || (version > snapshot_header::current_version)) return false;
+    if (kind > static_cast<std::uint8_t>(snapshot_kind::delta)) return false;
+
+    if (version >= 2u)
+    {
+        if (!deserialize_integer(local_p, local_l, h.body_size)) return false;
+        if (!deserialize_integer(local_p, local_l, h.checksum)) return false;
+    }
+
+    if (version >= 3u)
+    {
+        std::uint8_t layout;
+        if (!deserialize_integer(local_p, local_l, layout) || (layout > static_cast<std::uint8_t>(snapshot_layout::image))) return false;
+
+        h.layout = static_cast<snapshot_layout>(layout);
+    }
+
+    h.version = version;
+    h.kind    = static_cast<snapshot_kind>(kind);
+    h.base    = utils::timespec{utils::seconds{sec}, utils::nanoseconds{nsec}};
+
+    p = local_p;
+    l = local_l;
+
+    return true;
+}
+
+// checks the body that follows the header is complete and intact, versions without a checksum are trusted
+inline bool verify_snapshot(const snapshot_header & h, const std::uint8_t * p, size_t l) noexcept
+{
+    if (h.version < 2u) return true;
+    return (l == h.body_size) && (utils::crc32c(p, l) == h.checksum);
+}
+
+// full or delta snapshot of the engine, ready to be stored
+template <typename Engine>
+std::vector<std::uint8_t> make_snapshot(const Engine & engine, snapshot_header h)
+{
+    h.version = snapshot_header::current_version;
+
+    const size_t header_size = snapshot_header::serialized_size(h.version);
+
+    std::vector<std::uint8_t> res(header_size);
+
+    if (h.kind == snapshot_kind::full)
+    {
+        // the engine falls back to the compact layout if its store has no image
+        h.layout = engine.serialize_state(res, h.layout);
+    }
+    else
+    {
+        h.layout = snapshot_layout::compact;
+        engine.serialize_changes(res);
+    }
+
+    h.body_size = res.size() - header_size;
+    h.checksum  = utils::crc32c(res.data() + header_size, res.size() - header_size);
+
+    auto * p = res.data();
+    size_t l = header_size;
+
+    serialize_snapshot_header(p, l, h);
+
+    return res;
+}
+
+// a stored snapshot, checksum is the CRC-32C of the whole blob
+struct snapshot_entry
+{
+    utils::timespec timestamp;
+    std::uint64_t size{0};
+    std::uint32_t checksum{0};
+};
+
+// The snapshots of one stock for one day, sorted by timestamp.
+// Snapshots can be anywhere in the day, e.g. every N messages, this is how a query finds the closest one
+// with one small get and a binary search.
+class snapshot_directory
+{
+public:
+    static constexpr std::uint32_t magic          = 0x52494453; // "SDIR"
+    static constexpr std::uint8_t current_version = 1;
+
+private:
+    static constexpr size_t entry_size = 2 * sizeof(std::int64_t) + sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+    std::vector<snapshot_entry>::iterator lower_bound(const utils::timespec & timestamp)
+    {
+        return std::lower_bound(_entries.begin(), _entries.end(), timestamp,
+            [](const snapshot_entry & e, const utils::timespec & t) { return e.timestamp < t; });
+    }
+
+public:
+    // replaces the entry with the same timestamp
+    void insert(const snapshot_entry & entry)
+    {
+        auto it = lower_bound(entry.timestamp);
+
+        if ((it != _entries.end()) && (it->timestamp == entry.timestamp))
+        {
+            *it = entry;
+            return;
+        }
+
+        _entries.insert(it, entry);
+    }
+
+    // the latest snapshot at or before when, nullptr if there is none
+    const snapshot_entry * find(const utils::timespec & when) const
+    {
+        auto it = std::upper_bound(_entries.cbegin(), _entries.cend(), when,
+            [](const utils::timespec & t, const snapshot_entry & e) { return t < e.timestamp; });
+
+        return (it == _entries.cbegin()) ? nullptr : &*std::prev(it);
+    }
+
+    const std::vector<snapshot_entry> & entries() const noexcept
+    {
+        return _entries;
+    }
+
+    bool empty() const noexcept
+    {
+        return _entries.empty();
+    }
+
+    size_t size() const noexcept
+    {
+        return _entries.size();
+    }
+
+    std::vector<std::uint8_t> serialize() const
+    {
+        std::vector<std::uint8_t> res(sizeof(std::uint32_t) + sizeof(std::uint8_t) + sizeof(std::uint64_t) + _entries.size() * entry_size);
+
+        auto * p = res.data();
+        size_t l = res.size();
+
+        serialize_integer(p, l, magic);
+        serialize_integer(p, l, current_version);
+        serialize_integer(p, l, static_cast<std::uint64_t>(_entries.size()));
+
+        for (const auto & e : _entries)
+        {
+            serialize_integer(p, l, static_cast<std::int64_t>(e.timestamp.sec.count()));
+            serialize_integer(p, l, static_cast<std::int64_t>(e.timestamp.nsec.count()));
+            serialize_integer(p, l, e.size);
+            serialize_integer(p, l, e.checksum);
+        }
+
+        return res;
+    }
+
+    bool deserialize(const std::uint8_t * p, size_t l)
+    {
+        _entries.clear();
+
+        std::uint32_t m;
+        std::uint8_t version;
+        std::uint64_t count;
+
+        if (!deserialize_integer(p, l, m) || (m != magic)) return false;
+        if (!deserialize_integer(p, l, version) || (version != current_version)) return false;
+        if (!deserialize_integer(p, l, count) || (count != l / entry_size)) return false;
+
+        _entries.resize(static_cast<size_t>(count));
+
+        for (auto & e : _entries)
+        {
+            std::int64_t sec  = 0;
+            std::int64_t nsec = 0;
+
+            if (!deserialize_integer(p, l, sec) || !deserialize_integer(p, l, nsec)) return false;
+            if (!deserialize_integer(p, l, e.size) || !deserialize_integer(p, l, e.checksum)) return false;
+
+            e.timestamp = utils::timespec{utils::seconds{sec}, utils::nanoseconds{nsec}};
+        }
+
+        // written sorted, but we don't binary search something we haven't checked
+        return std::is_sorted(_entries.cbegin(), _entries.cend(),
+            [](const snapshot_entry & left, const snapshot_entry & right) { return left.timestamp < right.timestamp; });
+    }
+
+private:
+    std::vector<snapshot_entry> _entries;
+};
+
+} // namespace itch
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "itch_snapshot.hpp"
+#include <utils/crc32c.hpp>
+#include <utils/file_mapping.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace itch
+{
+
+// Local copies of the snapshot blobs, one file per snapshot key.
+//
+// A query is a process of its own, which is why the recency of the entries is the modification time of the files,
+// a hit touches its file. Entries are validated with the size and the checksum of the directory before being used,
+// a file that doesn't match is removed.
+class snapshot_cache
+{
+public:
+    snapshot_cache(boost::filesystem::path directory, std::uint64_t max_bytes)
+        : _directory{std::move(directory)}
+        , _max_bytes{max_bytes}
+    {
+        boost::filesystem::create_directories(_directory);
+    }
+
+private:
+    boost::filesystem::path file_path(const std::string & key) const
+    {
+        // the keys contain ISO timestamps, colons are not welcome everywhere
+        std::string file_name = key;
+        std::replace(file_name.begin(), file_name.end(), ':', '-');
+
+        return _directory / (file_name + ".snap");
+    }
+
+public:
+    // the mapped blob, nullptr if the snapshot isn't cached or the cached copy isn't the expected one
+    std::shared_ptr<const utils::file_mapping> get(const std::string & key, const snapshot_entry & expected)
+    {
+        const auto p = file_path(key);
+
+        boost::system::error_code ec;
+        if (boost::filesystem::file_size(p, ec) != expected.size)
+        {
+            if (!ec) boost::filesystem::remove(p, ec);
+            return nullptr;
+        }
+
+        std::shared_ptr<const utils::file_mapping> mapping;
+
+        try
+        {
+            mapping = std::make_shared<const utils::file_mapping>(p);
+        }
+        catch (const std::error_code &)
+        {
+            return nullptr;
+        }
+
+        const auto v = mapping->view();
+        if (utils::crc32c(v.first, v.second) != expected.checksum)
+        {
+            mapping.reset();
+            boost::filesystem::remove(p, ec);
+            return nullptr;
+        }
+
+        boost::filesystem::last_write_time(p, std::time(nullptr), ec);
+
+        ++_hits;
+        return mapping;
+    }
+
+    // the blob is written to a temporary file which is then renamed, a concurrent query never sees a partial file
+    void put(const std::string & key, const std::uint8_t * p, size_t size)
+    {
+        if (size > _max_bytes) return;
+
+        const auto final_path = file_path(key);
+        const auto temp_path  = boost::filesystem::unique_path(final_path.string() + ".%%%%%%%%");
+
+        {
+            std::ofstream out{temp_path.string(), std::ios::binary | std::ios::trunc};
+            out.write(reinterpret_cast<const char *>(p), static_cast<std::streamsize>(size));
+            if (!out) return;
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::rename(temp_path, final_path, ec);
+        if (ec)
+        {
+            boost::filesystem::remove(temp_path, ec);
+            return;
+        }
+
+        ++_stores;
+        evict();
+    }
+
+    // removes the least recently used entries until the cache fits in its budget
+    void evict()
+    {
+        struct file
+        {
+            boost::filesystem::path path;
+            std::uint64_t size;
+            std::time_t last_use;
+        };
+
+        std::vector<file> files;
+        std::uint64_t total = 0;
+
+        boost::system::error_code ec;
+
+        for (boost::filesystem::directory_iterator it{_directory, ec}, end; !ec && (it != end); it.increment(ec))
+        {
+            if (it->path().extension() != ".snap") continue;
+
+            boost::system::error_code file_ec;
+
+            file f{it->path(), boost::filesystem::file_size(it->path(), file_ec), boost::filesystem::last_write_time(it->path(), file_ec)};
+            if (file_ec) continue;
+
+            total += f.size;
+            files.push_back(std::move(f));
+        }
+
+        if (total <= _max_bytes) return;
+
+        std::sort(files.begin(), files.end(), [](const file & left, const file & right) { return left.last_use < right.last_use; });
+
+        for (const auto & f : files)
+        {
+            if (total <= _max_bytes) break;
+
+            // mapped files stay valid until unmapped
+            if (boost::filesystem::remove(f.path, ec))
+            {
+                total -= f.size;
+                ++_evictions;
+            }
+        }
+    }
+
+    std::uint64_t hits() const noexcept
+    {
+        return _hits;
+    }
+
+    std::uint64_t stores() const noexcept
+    {
+        return _stores;
+    }
+
+    std::uint64_t evictions() const noexcept
+    {
+        return _evictions;
+    }
+
+private:
+    boost::filesystem::path _directory;
+    std::uint64_t _max_bytes;
+
+    std::uint64_t _hits{0};
+    std::uint64_t _stores{0};
+    std::uint64_t _evictions{0};
+};
+
+} // namespace itch
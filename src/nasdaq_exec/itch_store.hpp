@@ -0,0 +1,552 @@
+#pragma once
+
+// robin_hood.h uses std::numeric_limits without including <limits>
+#include <limits>
+#include <rh/robin_hood.h>
+#include <tbb/concurrent_hash_map.h>
+#include <tbb/scalable_allocator.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace itch
+{
+
+// an order at instant X, can be buy or sell
+struct order
+{
+    order() = default;
+    order(std::uint32_t p, std::uint32_t s)
+        : price{p}
+        , shares{s}
+    {}
+
+    std::uint32_t price; // fixed point, 4 decimal precision on Nasdaq
+    std::uint32_t shares;
+
+    bool operator==(const order & other) const noexcept
+    {
+        return (shares == other.shares) && (price == other.price);
+    }
+
+    bool operator!=(const order & other) const noexcept
+    {
+        return !(*this == other);
+    }
+
+    bool operator<(const order & other) const noexcept
+    {
+        return (price < other.price) || ((price == other.price) && (shares < other.shares));
+    }
+};
+
+// orders with their reference, sorted by reference when used for bulk loading
+using order_entries = std::vector<std::pair<std::uint64_t, order>>;
+
+// allocator policies, select where the order stores take their memory from
+struct std_allocator_policy
+{
+    template <typename T>
+    using allocator = std::allocator<T>;
+
+    static const char * name() noexcept
+    {
+        return "std";
+    }
+};
+
+struct scalable_allocator_policy
+{
+    template <typename T>
+    using allocator = tbb::scalable_allocator<T>;
+
+    static const char * name() noexcept
+    {
+        return "scalable";
+    }
+};
+
+// All order stores share the same interface:
+//
+//  - emplace(reference, order) adds a new order
+//  - find(reference) returns something that tests false when the order doesn't exist and dereferences to the order
+//    otherwise, a pointer valid until the store is modified or, for the concurrent store, a copy
+//  - update(reference, f) calls f(order &) on the order if it exists, f returns true to erase the order
+//  - for_each(f) calls f(reference, const order &) on every order
+//  - assign(entries) replaces the content of the store with orders sorted by reference, in bulk
+//  - size(), reserve(n), clear()
+//
+// this is all the execution engine needs and what makes the stores interchangeable
+//
+// a store whose memory can be written and read back as is (see snapshot_layout::image) also has:
+//
+//  - for_each_page(f) calls f(page index, const order * slots, count) on every non empty page
+//  - adopt_page(index, raw, count) copies a page image, raw being page_size slots in the native byte order
+
+// robin hood open addressing, the orders are stored in the table
+// robin hood does its own allocation, the allocator policy is ignored
+template <bool Flat>
+class robin_hood_order_store
+{
+    using map_type = std::conditional_t<Flat,
+        robin_hood::unordered_flat_map<std::uint64_t, order>,
+        robin_hood::unordered_node_map<std::uint64_t, order>>;
+
+public:
+    void emplace(std::uint64_t reference, const order & o)
+    {
+        _orders.emplace(reference, o);
+    }
+
+    const order * find(std::uint64_t reference) const
+    {
+        auto it = _orders.find(reference);
+        return (it != _orders.end()) ? &it->second : nullptr;
+    }
+
+    template <typename Function>
+    bool update(std::uint64_t reference, Function && f)
+    {
+        auto it = _orders.find(reference);
+        if (it == _orders.end()) return false;
+
+        if (f(it->second))
+        {
+            _orders.erase(it);
+        }
+
+        return true;
+    }
+
+    template <typename Function>
+    void for_each(Function && f) const
+    {
+        for (const auto & e : _orders)
+        {
+            f(e.first, e.second);
+        }
+    }
+
+    size_t size() const noexcept
+    {
+        return _orders.size();
+    }
+
+    void reserve(size_t s)
+    {
+        _orders.reserve(s);
+    }
+
+    void clear()
+    {
+        _orders.clear();
+    }
+
+    void assign(const order_entries & entries)
+    {
+        clear();
+        reserve(entries.size());
+
+        for (const auto & e : entries)
+        {
+            _orders.emplace(e.first, e.second);
+        }
+    }
+
+private:
+    map_type _orders;
+};
+
+// Order reference numbers are day unique and allocated in increasing order, which means they can be used as
+// an index. Because references are shared by all the stocks of the market, the references of one stock are
+// sparse, we therefore index pages of orders that are allocated on demand and freed once empty.
+// An empty slot is an order without shares, the engine never keeps such an order.
+// This works best for the stocks that take a large share of the feed, thin stocks are better served by a hash map.
+template <typename AllocatorPolicy>
+class direct_order_store
+{
+public:
+    static constexpr size_t page_bits = 10;
+    static constexpr size_t page_size = size_t{1} << page_bits;
+
+private:
+    static constexpr size_t page_mask = page_size - 1u;
+
+    struct page
+    {
+        page() noexcept
+        {
+            std::fill(orders.begin(), orders.end(), order{0, 0});
+        }
+
+        std::array<order, page_size> orders;
+        size_t count{0};
+    };
+
+    using page_allocator = typename AllocatorPolicy::template allocator<page>;
+    using page_table     = std::vector<page *, typename AllocatorPolicy::template allocator<page *>>;
+
+private:
+    page * allocate_page()
+    {
+        page * p = std::allocator_traits<page_allocator>::allocate(_allocator, 1u);
+        return new (p) page{};
+    }
+
+    void free_page(page * p) noexcept
+    {
+        p->~page();
+        std::allocator_traits<page_allocator>::deallocate(_allocator, p, 1u);
+    }
+
+    order * find_slot(std::uint64_t reference) const noexcept
+    {
+        const auto page_index = static_cast<size_t>(reference >> page_bits);
+        if (page_index >= _pages.size()) return nullptr;
+
+        page * p = _pages[page_index];
+        if (!p) return nullptr;
+
+        order * o = &p->orders[reference & page_mask];
+        return o->shares ? o : nullptr;
+    }
+
+public:
+    direct_order_store() = default;
+
+    direct_order_store(const direct_order_store &) = delete;
+    direct_order_store & operator=(const direct_order_store &) = delete;
+
+    direct_order_store(direct_order_store && other) noexcept
+        : _allocator{other._allocator}
+        , _pages{std::move(other._pages)}
+        , _size{other._size}
+    {
+        other._pages.clear();
+        other._size = 0;
+    }
+
+    direct_order_store & operator=(direct_order_store && other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            _allocator = other._allocator;
+            _pages     = std::move(other._pages);
+            _size      = other._size;
+
+            other._pages.clear();
+            other._size = 0;
+        }
+
+        return *this;
+    }
+
+    ~direct_order_store()
+    {
+        clear();
+    }
+
+public:
+    void emplace(std::uint64_t reference, const order & o)
+    {
+        // we can't tell an order without shares from an empty slot
+        if (!o.shares) return;
+
+        const auto page_index = static_cast<size_t>(reference >> page_bits);
+
+        if (page_index >= _pages.size())
+        {
+            _pages.resize(page_index + 1u, nullptr);
+        }
+
+        page *& p = _pages[page_index];
+        if (!p) p = allocate_page();
+
+        order & slot = p->orders[reference & page_mask];
+
+        // references are unique, emplace doesn't replace an existing order
+        if (slot.shares) return;
+
+        slot = o;
+        ++p->count;
+        ++_size;
+    }
+
+    const order * find(std::uint64_t reference) const noexcept
+    {
+        return find_slot(reference);
+    }
+
+    template <typename Function>
+    bool update(std::uint64_t reference, Function && f)
+    {
+        order * o = find_slot(reference);
+        if (!o) return false;
+
+        if (f(*o))
+        {
+            *o = order{0, 0};
+            --_size;
+
+            page *& p = _pages[static_cast<size_t>(reference >> page_bits)];
+            if (!--p->count)
+            {
+                free_page(p);
+                p = nullptr;
+            }
+        }
+
+        return true;
+    }
+
+    template <typename Function>
+    void for_each(Function && f) const
+    {
+        for (size_t i = 0; i < _pages.size(); ++i)
+        {
+            const page * p = _pages[i];
+            if (!p) continue;
+
+            const std::uint64_t first_reference = static_cast<std::uint64_t>(i) << page_bits;
+
+            for (size_t j = 0; j < page_size; ++j)
+            {
+                if (p->orders[j].shares) f(first_reference + j, p->orders[j]);
+            }
+        }
+    }
+
+    size_t size() const noexcept
+    {
+        return _size;
+    }
+
+    void reserve(size_t /*s*/)
+    {
+        // pages are allocated on demand, we cannot know in advance which ones will be needed
+    }
+
+    void clear()
+    {
+        for (page * p : _pages)
+        {
+            if (p) free_page(p);
+        }
+
+        _pages.clear();
+        _size = 0;
+    }
+
+    // the entries being sorted, the page table is sized once and every page is filled in one go
+    void assign(const order_entries & entries)
+    {
+        clear();
+
+        if (entries.empty()) return;
+
+        _pages.resize(static_cast<size_t>(entries.back().first >> page_bits) + 1u, nullptr);
+
+        page * p                  = nullptr;
+        size_t current_page_index = _pages.size();
+
+        for (const auto & e : entries)
+        {
+            if (!e.second.shares) continue;
+
+            const auto page_index = static_cast<size_t>(e.first >> page_bits);
+            if (page_index != current_page_index)
+            {
+                current_page_index = page_index;
+
+                p = _pages[page_index];
+                if (!p) p = _pages[page_index] = allocate_page();
+            }
+
+            order & slot = p->orders[e.first & page_mask];
+            if (slot.shares) continue;
+
+            slot = e.second;
+            ++p->count;
+            ++_size;
+        }
+    }
+
+    template <typename Function>
+    void for_each_page(Function && f) const
+    {
+        for (size_t i = 0; i < _pages.size(); ++i)
+        {
+            if (_pages[i]) f(i, _pages[i]->orders.data(), _pages[i]->count);
+        }
+    }
+
+    // count is the number of orders in the page, trusted, the image must be in the native byte order
+    void adopt_page(size_t page_index, const std::uint8_t * raw, size_t count)
+    {
+        static_assert(sizeof(order) == 2 * sizeof(std::uint32_t), "a page image is an array of (price, shares)");
+
+        // pages are never empty
+        if (!count) return;
+
+        if (page_index >= _pages.size())
+        {
+            _pages.resize(page_index + 1u, nullptr);
+        }
+
+        page *& p = _pages[page_index];
+        if (!p) p = allocate_page();
+
+        _size -= p->count;
+
+        std::memcpy(p->orders.data(), raw, sizeof(order) * page_size);
+        p->count = count;
+
+        _size += count;
+    }
+
+private:
+    page_allocator _allocator;
+    page_table _pages;
+    size_t _size{0};
+};
+
+// tbb concurrent hash map, every operation takes a lock on the bucket of the order
+// the store alone is safe: emplace, find, update and erase may run from several threads, for_each must not run concurrently
+// with modifications. The engine built on top of it isn't, its levels, depth and counters are not synchronised.
+template <typename AllocatorPolicy>
+class concurrent_order_store
+{
+    using map_type = tbb::concurrent_hash_map<std::uint64_t,
+        order,
+        tbb::tbb_hash_compare<std::uint64_t>,
+        typename AllocatorPolicy::template allocator<std::pair<const std::uint64_t, order>>>;
+
+public:
+    void emplace(std::uint64_t reference, const order & o)
+    {
+        _orders.emplace(reference, o);
+    }
+
+    // a copy taken under the lock of the bucket, the order may be gone as soon as the lock is released
+    std::optional<order> find(std::uint64_t reference) const
+    {
+        typename map_type::const_accessor a;
+        if (!_orders.find(a, reference)) return std::nullopt;
+        return a->second;
+    }
+
+    template <typename Function>
+    bool update(std::uint64_t reference, Function && f)
+    {
+        typename map_type::accessor a;
+        if (!_orders.find(a, reference)) return false;
+
+        if (f(a->second))
+        {
+            _orders.erase(a);
+        }
+
+        return true;
+    }
+
+    template <typename Function>
+    void for_each(Function && f) const
+    {
+        for (const auto & e : _orders)
+        {
+            f(e.first, e.second);
+        }
+    }
+
+    size_t size() const noexcept
+    {
+        return _orders.size();
+    }
+
+    void reserve(size_t s)
+    {
+        _orders.rehash(s);
+    }
+
+    void clear()
+    {
+        _orders.clear();
+    }
+
+    void assign(const order_entries & entries)
+    {
+        clear();
+        reserve(entries.size());
+
+        for (const auto & e : entries)
+        {
+            _orders.emplace(e.first, e.second);
+        }
+    }
+
+private:
+    map_type _orders;
+};
+
+// order store policies, give the store type for an allocator policy
+// uses_allocator is false when the store ignores the allocator policy
+struct flat_store_policy
+{
+    template <typename AllocatorPolicy>
+    using store_type = robin_hood_order_store<true>;
+
+    static constexpr bool uses_allocator = false;
+
+    static const char * name() noexcept
+    {
+        return "flat";
+    }
+};
+
+struct node_store_policy
+{
+    template <typename AllocatorPolicy>
+    using store_type = robin_hood_order_store<false>;
+
+    static constexpr bool uses_allocator = false;
+
+    static const char * name() noexcept
+    {
+        return "node";
+    }
+};
+
+struct direct_store_policy
+{
+    template <typename AllocatorPolicy>
+    using store_type = direct_order_store<AllocatorPolicy>;
+
+    static constexpr bool uses_allocator = true;
+
+    static const char * name() noexcept
+    {
+        return "direct";
+    }
+};
+
+struct concurrent_store_policy
+{
+    template <typename AllocatorPolicy>
+    using store_type = concurrent_order_store<AllocatorPolicy>;
+
+    static constexpr bool uses_allocator = true;
+
+    static const char * name() noexcept
+    {
+        return "concurrent";
+    }
+};
+
+} // namespace itch
@@ -1,61 +1,70 @@
+#include "exec_bars.hpp"
+#include "exec_bbo.hpp"
+#include "exec_book_series.hpp"
+#include "exec_config.hpp"
+#include "exec_conversion.hpp"
+#include "exec_flow.hpp"
+#include "exec_level_deltas.hpp"
+#include "exec_point_in_time.hpp"
+#include "exec_service.hpp"
+#include "exec_snapshot_builder.hpp"
+#include "exec_sweep.hpp"
+#include "exec_viewer.hpp"
 #include "itch_exec.hpp"
 #include <qdb/client.hpp>
-#include <qdb/integer.h>
-#include <qdb/query.h>
-#include <qdb/tag.h>
-#include <qdb/ts.h>
-#include <boost/container/flat_map.hpp>
-#include <boost/predef.h>
 #include <boost/program_options.hpp>
-#include <fmt/chrono.h>
 #include <fmt/color.h>
 #include <fmt/format.h>
-#include <fmt/locale.h>
-#include <utils/gregorian.hpp>
-#include <utils/stringify.hpp>
 #include <clocale>
-
-struct config
-{
-    bool collapsed;
-    bool point_in_time;
-    std::string qdb_url;
-    std::string stock;
-    std::string when;
-};
-
-static void throw_on_failure(qdb_error_t err, const char * msg)
-{
-    if (QDB_FAILURE(err))
-    {
-        fmt::print(fmt::fg(fmt::color::red), "Error: {} ({})\n", qdb_error(err), err);
-        throw std::runtime_error(msg);
-    }
-}
-
-static std::pair<utils::timespec, utils::timespec> get_time_range(const std::string & when)
-{
-    const auto time_point = utils::from_iso_extended_string_utc(when);
-    if (time_point == std::chrono::system_clock::time_point{}) throw std::runtime_error("invalid time");
-
-    const auto time_point_ts = utils::timespec{std::chrono::duration_cast<std::chrono::seconds>(time_point.time_since_epoch())};
-    const auto requested_day = utils::extract_date(time_point_ts);
-
-    return std::make_pair(utils::make_timespec(requested_day), time_point_ts);
-}
+#include <cstdlib>
+#include <iostream>
+#include <locale>
 
 static config parse_config(int argc, char ** argv)
 {
     config cfg;
 
     boost::program_options::options_description desc{"Allowed options"};
-    desc.add_options()                                                                                           //
-        ("help,h", "show help message")                                                                          //
-        ("url", boost::program_options::value<std::string>(&cfg.qdb_url)->default_value("qdb://127.0.0.1:2836")) //
-        ("stock", boost::program_options::value<std::string>(&cfg.stock))                                        //
-        ("when", boost::program_options::value<std::string>(&cfg.when))                                          //
-        ("collapsed", boost::program_options::value<bool>(&cfg.collapsed)->default_value(false))                 //
-        ("point-in-time", boost::program_options::value<bool>(&cfg.point_in_time)->default_value(true))          //
+    desc.add_options()                                                                                                     //
+        ("help,h", "show help message")                                                                                    //
+        ("url", boost::program_options::value<std::string>(&cfg.qdb_url)->default_value("qdb://127.0.0.1:2836"))           //
+        ("stock", boost::program_options::value<std::string>(&cfg.stock))                                                  //
+        ("when", boost::program_options::value<std::string>(&cfg.when))                                                    //
+        ("until", boost::program_options::value<std::string>(&cfg.until))                                                  //
+        ("every-seconds", boost::program_options::value<std::uint32_t>(&cfg.every_seconds)->default_value(60))             //
+        ("collapsed", boost::program_options::value<bool>(&cfg.collapsed)->default_value(false))                           //
+        ("format", boost::program_options::value<std::string>(&cfg.output_format)->default_value("text"))                  //
+        ("output", boost::program_options::value<std::string>(&cfg.output))                                                //
+        ("bbo", boost::program_options::value<bool>(&cfg.bbo)->default_value(false))                                       //
+        ("bars", boost::program_options::value<std::string>(&cfg.bars))                                                    //
+        ("flow", boost::program_options::value<bool>(&cfg.flow)->default_value(false))                                     //
+        ("flow-depths", boost::program_options::value<std::string>(&cfg.flow_depths)->default_value("1,5,10"))             //
+        ("level-deltas", boost::program_options::value<bool>(&cfg.level_deltas)->default_value(false))                     //
+        ("attribution", boost::program_options::value<bool>(&cfg.attribution)->default_value(false))                       //
+        ("book-series", boost::program_options::value<bool>(&cfg.book_series)->default_value(false))                       //
+        ("sample-ms", boost::program_options::value<std::uint32_t>(&cfg.sample_ms)->default_value(1000))                   //
+        ("point-in-time", boost::program_options::value<bool>(&cfg.point_in_time)->default_value(true))                    //
+        ("depth", boost::program_options::value<size_t>(&cfg.depth)->default_value(0))                                     //
+        ("full-snapshot-every", boost::program_options::value<std::uint16_t>(&cfg.snapshots.full_every)->default_value(8)) //
+        ("snapshot-minutes", boost::program_options::value<std::uint32_t>(&cfg.snapshots.minutes)->default_value(15))      //
+        ("snapshot-messages", boost::program_options::value<std::uint64_t>(&cfg.snapshots.messages)->default_value(0))     //
+        ("snapshot-cache", boost::program_options::value<std::string>(&cfg.snapshots.cache))                               //
+        ("snapshot-cache-mb", boost::program_options::value<std::uint64_t>(&cfg.snapshots.cache_mb)->default_value(1024))  //
+        ("snapshot-layout", boost::program_options::value<std::string>(&cfg.snapshots.layout)->default_value("compact"))   //
+        ("snapshot-builder", boost::program_options::value<bool>(&cfg.snapshot_builder)->default_value(false))             //
+        ("stream-minutes", boost::program_options::value<std::uint32_t>(&cfg.stream_minutes)->default_value(0))            //
+        ("orders-schema", boost::program_options::value<std::string>(&cfg.orders_schema)->default_value("legacy"))         //
+        ("convert-orders", boost::program_options::value<bool>(&cfg.convert_orders)->default_value(false))                 //
+        ("serve", boost::program_options::value<std::string>(&cfg.service.socket))                                         //
+        ("warm-engines", boost::program_options::value<size_t>(&cfg.service.warm_engines)->default_value(16))              //
+        ("view", boost::program_options::value<bool>(&cfg.view)->default_value(false))                                     //
+        ("speed", boost::program_options::value<std::uint32_t>(&cfg.viewer.speed)->default_value(1))                       //
+        ("fps", boost::program_options::value<std::uint32_t>(&cfg.viewer.fps)->default_value(10))                          //
+        ("store", boost::program_options::value<std::string>(&cfg.store)->default_value("flat"))                           //
+        ("scalable-allocator", boost::program_options::value<bool>(&cfg.scalable_allocator)->default_value(false))         //
+        ("readers", boost::program_options::value<size_t>(&cfg.publishing.readers)->default_value(0))                      //
+        ("publish-messages", boost::program_options::value<std::uint64_t>(&cfg.publishing.messages)->default_value(0))     //
+        ("publish-us", boost::program_options::value<std::uint64_t>(&cfg.publishing.us)->default_value(0))                 //
         ;
 
     boost::program_options::variables_map vm;
@@ -68,266 +77,119 @@ static config parse_config(int argc, char ** argv)
         std::exit(0);
     }
 
-    if (cfg.stock.empty())
+    // the service gets the stock and the time from its queries
+    if (cfg.stock.empty() && cfg.service.socket.empty())
     {
         throw std::runtime_error("please specify a stock");
     }
 
-    if (cfg.when.empty())
+    if (cfg.when.empty() && cfg.service.socket.empty())
     {
         throw std::runtime_error("please specify a point in time");
     }
 
-    return cfg;
-}
-
-struct ts_int64
-{
-    qdb_ts_int64_point * points;
-    size_t count;
-};
-
-struct ts_double
-{
-    qdb_ts_double_point * points;
-    size_t count;
-};
-
-ts_int64 get_ranges_int64(qdb_handle_t h, const std::string & table_name, const std::string & column, const qdb_ts_range_t & ranges)
-{
-    ts_int64 res;
-
-    auto err = qdb_ts_int64_get_ranges(h, table_name.c_str(), column.c_str(), &ranges, 1u, &res.points, &res.count);
-    throw_on_failure(err, "int64 get range");
-
-    return res;
-}
-
-ts_double get_ranges_double(qdb_handle_t h, const std::string & table_name, const std::string & column, const qdb_ts_range_t & ranges)
-{
-    ts_double res;
-
-    auto err = qdb_ts_double_get_ranges(h, table_name.c_str(), column.c_str(), &ranges, 1u, &res.points, &res.count);
-    throw_on_failure(err, "int64 get range");
-
-    return res;
-}
-
-static itch::order_records get_orders_records(qdb_handle_t h, const std::string & table_name, utils::timespec first, utils::timespec last)
-{
-    qdb_ts_range_t r;
-
-    r.begin = first.as_timespec();
-    r.end   = last.as_timespec();
-
-    ts_int64 order_type               = get_ranges_int64(h, table_name, "type", r);
-    ts_int64 order_reference          = get_ranges_int64(h, table_name, "reference", r);
-    ts_int64 order_original_reference = get_ranges_int64(h, table_name, "original_reference", r);
-    ts_int64 order_new_reference      = get_ranges_int64(h, table_name, "new_reference", r);
-    ts_int64 order_is_buy             = get_ranges_int64(h, table_name, "is_buy", r);
-    ts_int64 order_shares             = get_ranges_int64(h, table_name, "shares", r);
-    ts_double order_price             = get_ranges_double(h, table_name, "price", r);
-
-    itch::order_records result;
-
-    result.reserve(order_type.count);
-
-    // TODO: check all columns
-    if (order_type.count != order_reference.count) throw std::runtime_error("incoherence column count");
-
-    for (size_t i = 0; i < order_type.count; ++i)
+    if (!cfg.sample_ms)
     {
-        auto it = result.emplace_hint(result.end(), utils::timespec{order_type.points[i].timestamp}, itch::order_record{});
-
-        itch::order_record & new_rec = it->second;
-
-        // type
-        new_rec.order_type = static_cast<char>(order_type.points[i].value);
-
-        // reference
-        new_rec.reference = static_cast<std::uint64_t>(order_reference.points[i].value);
-
-        // original reference
-        if (order_original_reference.points[i].value != qdb_int64_undefined)
-        {
-            assert(new_rec.reference == qdb_int64_undefined);
-            new_rec.reference = static_cast<std::uint64_t>(order_original_reference.points[i].value);
-        }
-
-        // new reference
-        new_rec.new_reference = static_cast<std::uint64_t>(order_new_reference.points[i].value);
-
-        // is buy
-        new_rec.is_buy = static_cast<bool>(order_is_buy.points[i].value);
-
-        // shares
-        new_rec.shares = static_cast<std::uint32_t>(order_shares.points[i].value);
-
-        // price
-        new_rec.price = order_price.points[i].value;
+        throw std::runtime_error("the sampling interval can't be zero");
     }
 
-    qdb_release(h, order_type.points);
-    qdb_release(h, order_reference.points);
-    qdb_release(h, order_original_reference.points);
-    qdb_release(h, order_new_reference.points);
-    qdb_release(h, order_is_buy.points);
-    qdb_release(h, order_shares.points);
-    qdb_release(h, order_price.points);
-
-    return result;
-}
-
-static std::string build_bar(std::string::size_type max_length, std::uint32_t current_value, std::uint32_t max_value)
-{
-    if (current_value >= max_value)
+    if (!cfg.every_seconds)
     {
-        return std::string(max_length, '#');
+        throw std::runtime_error("the interval between instants can't be zero");
     }
 
-    auto l = static_cast<std::string::size_type>(
-        static_cast<double>(max_length) * static_cast<double>(current_value) / static_cast<double>(max_value));
-    return std::string(l, '#');
-}
-
-static utils::timespec get_snapshot_timestamp(utils::timespec when) noexcept
-{
-    when.sec  = when.sec - (when.sec % std::chrono::minutes{15});
-    when.nsec = std::chrono::nanoseconds{};
-    return when;
-}
-
-static std::string make_snapshot_key(const std::string & stock, utils::timespec when)
-{
-    // modulo 15 mins, remove nsec, remove the 900 secs
-    when = get_snapshot_timestamp(when);
-
-    return fmt::format("{}_orders_snap_{}", stock, utils::to_iso_extended_string_utc(static_cast<std::time_t>(when.sec.count())));
-}
-
-static utils::timespec restore_snapshot(qdb_handle_t h, itch::execution_engine & engine, const std::string & stock, utils::timespec when)
-{
-    // we snapshot every 15 minutes, for the day, get all snapshots
-    const auto requested_day = utils::extract_date(when);
-
-    // build the prefix
-    const auto best_snap_key = make_snapshot_key(stock, when);
-    const auto prefix        = fmt::format("{}_orders_snap_{:04}-{:02}-{:02}T", stock, static_cast<int>(requested_day.year()),
-        static_cast<int>(requested_day.month()), static_cast<int>(requested_day.day()));
-
-    const char ** results = 0;
-    size_t results_count  = 0;
-
-    auto err = qdb_prefix_get(h, prefix.c_str(), 100, &results, &results_count);
-    if (err == qdb_e_alias_not_found) return utils::timespec{};
-    throw_on_failure(err, "cannot prefix get");
-
-    if (!results_count) return utils::timespec{};
-
-    const char * match = nullptr;
-
-    // get the first workable timestamp
-    // we could do a binary search
-    for (size_t i = 0; i < results_count; ++i)
+    if (!cfg.viewer.speed || (cfg.viewer.speed > 1000u))
     {
-        if (strcmp(results[i], best_snap_key.c_str()) > 0) break;
-        match = results[i];
+        throw std::runtime_error("the replay speed must be between 1 and 1000");
     }
 
-    const auto snap_key = std::string{match};
-    size_t idx          = snap_key.rfind('_');
-    if (idx == std::string::npos) return utils::timespec{};
-
-    qdb_release(h, results);
-    if (!match) return utils::timespec{};
+    if (!cfg.viewer.fps || (cfg.viewer.fps > 60u))
+    {
+        throw std::runtime_error("the frame rate must be between 1 and 60 frames per second");
+    }
 
-    const void * snap_data = nullptr;
-    qdb_size_t snap_size   = 0;
+    if (!cfg.service.warm_engines)
+    {
+        throw std::runtime_error("the service needs at least one warm engine");
+    }
 
-    err = qdb_blob_get(h, snap_key.c_str(), &snap_data, &snap_size);
-    throw_on_failure(err, "cannot get snapshot");
+    if (!cfg.snapshots.minutes || (cfg.snapshots.minutes > 24u * 60u))
+    {
+        throw std::runtime_error("the snapshot interval must be between 1 minute and 1 day");
+    }
 
-    const std::uint8_t * p = static_cast<const std::uint8_t *>(snap_data);
+    if ((cfg.snapshots.layout != "compact") && (cfg.snapshots.layout != "image"))
+    {
+        throw std::runtime_error("the snapshot layout must be compact or image");
+    }
 
-    auto deserialized = engine.deserialize_state(p, snap_size);
+    if ((cfg.output_format != "text") && (cfg.output_format != "csv") && (cfg.output_format != "jsonl")
+        && (cfg.output_format != "binary"))
+    {
+        throw std::runtime_error("the output format must be text, csv, jsonl or binary");
+    }
 
-    qdb_release(h, snap_data);
+    if ((cfg.orders_schema != "legacy") && (cfg.orders_schema != "compact"))
+    {
+        throw std::runtime_error("the orders schema must be legacy or compact");
+    }
 
-    if (!deserialized) return utils::timespec{};
+    // robin hood does its own allocation
+    if (cfg.scalable_allocator && ((cfg.store == itch::flat_store_policy::name()) || (cfg.store == itch::node_store_policy::name())))
+    {
+        throw std::runtime_error("the scalable allocator needs the direct or the concurrent store");
+    }
 
-    const auto tp = utils::from_iso_extended_string_utc(snap_key.substr(idx + 1u));
-    if (tp == std::chrono::system_clock::time_point{}) return utils::timespec{};
+    if (cfg.publishing.readers && !cfg.publishing.messages && !cfg.publishing.us)
+    {
+        cfg.publishing.messages = 1'000;
+    }
 
-    return utils::timespec{std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch())};
+    return cfg;
 }
 
-static void store_snapshot(qdb_handle_t h, const itch::execution_engine & engine, const std::string & stock, utils::timespec when)
-{
-    when                                      = get_snapshot_timestamp(when);
-    const auto snap_key                       = make_snapshot_key(stock, when);
-    std::vector<std::uint8_t> serialized_snap = engine.serialize_state();
-    auto err = qdb_blob_update(h, snap_key.data(), serialized_snap.data(), serialized_snap.size(), qdb_never_expires);
-    throw_on_failure(err, "cannot store snapshot");
+template <typename Engine>
+static void execute(qdb_handle_t h, const config & cfg)
+{
+    if (!cfg.service.socket.empty()) return run_service<Engine>(h, cfg);
+    if (cfg.view) return run_viewer<Engine>(h, cfg);
+    if (cfg.snapshot_builder) return run_snapshot_builder<Engine>(h, cfg);
+    if (cfg.book_series) return run_book_series<Engine>(h, cfg);
+    if (cfg.bbo) return run_bbo_series<Engine>(h, cfg);
+    if (!cfg.bars.empty()) return run_bars<Engine>(h, cfg);
+    if (cfg.flow) return run_flow_series<Engine>(h, cfg);
+    if (cfg.level_deltas) return run_level_deltas<Engine>(h, cfg);
+    if (is_sweep(cfg)) return run_sweep<Engine>(h, cfg);
+    run_point_in_time<Engine>(h, cfg);
 }
 
-static void print_books(const itch::order_book & buying_book, const itch::order_book & selling_book)
+template <typename OrderStorePolicy>
+static void run(qdb_handle_t h, const config & cfg)
 {
-    if (buying_book.empty() || selling_book.empty()) return;
-
-    fmt::print(fmt::fg(fmt::color::cyan), "\nDETAILED ORDER BOOK \n");
-
-    fmt::print(fmt::fg(fmt::color::orange), "\n *** Selling\n");
-
-    auto it_max_sell = std::max_element(selling_book.cbegin(), selling_book.cend(),
-        [](const auto & left, const auto & right) { return left.first.shares < right.first.shares; });
-    auto it_max_buy  = std::max_element(buying_book.cbegin(), buying_book.cend(),
-        [](const auto & left, const auto & right) { return left.first.shares < right.first.shares; });
-
-    const auto the_max = std::max(it_max_sell->first.shares, it_max_buy->first.shares);
-
-    for (auto it = selling_book.crbegin(); it != selling_book.crend(); ++it)
+    // parse_config rejects the scalable allocator for the stores that would ignore it
+    if constexpr (OrderStorePolicy::uses_allocator)
     {
-        fmt::print(fmt::fg(fmt::color::orange), " {:>9.2f} USD - {:>6L} shares - ref: {:>10L} | {}\n",
-            static_cast<double>(it->first.price) / 1000.0, it->first.shares, it->second, build_bar(20, it->first.shares, the_max));
+        if (cfg.scalable_allocator)
+        {
+            return execute<itch::basic_execution_engine<OrderStorePolicy, itch::scalable_allocator_policy>>(h, cfg);
+        }
     }
 
-    fmt::print(fmt::fg(fmt::color::green), "\n *** Buying\n");
-
-    for (auto it = buying_book.crbegin(); it != buying_book.crend(); ++it)
-    {
-        fmt::print(fmt::fg(fmt::color::green), " {:>9.2f} USD - {:>6L} shares - ref: {:>10L} | {}\n",
-            static_cast<double>(it->first.price) / 1000.0, it->first.shares, it->second, build_bar(20, it->first.shares, the_max));
-    }
+    execute<itch::basic_execution_engine<OrderStorePolicy, itch::std_allocator_policy>>(h, cfg);
 }
 
-static void print_collapsed_books(const itch::collapsed_book & buying_book, const itch::collapsed_book & selling_book)
+// the order store is selected at runtime, pick the one that suits the workload best
+static void run(qdb_handle_t h, const config & cfg)
 {
-    if (buying_book.empty() || selling_book.empty()) return;
-
-    fmt::print(fmt::fg(fmt::color::cyan), "\nCOLLAPSED ORDER BOOK \n");
+    // no engine involved
+    if (cfg.convert_orders) return run_orders_conversion(h, cfg);
 
-    fmt::print(fmt::fg(fmt::color::orange), "\n *** Selling\n");
+    if (cfg.store == itch::flat_store_policy::name()) return run<itch::flat_store_policy>(h, cfg);
+    if (cfg.store == itch::node_store_policy::name()) return run<itch::node_store_policy>(h, cfg);
+    if (cfg.store == itch::direct_store_policy::name()) return run<itch::direct_store_policy>(h, cfg);
+    if (cfg.store == itch::concurrent_store_policy::name()) return run<itch::concurrent_store_policy>(h, cfg);
 
-    auto it_max_sell = std::max_element(
-        selling_book.cbegin(), selling_book.cend(), [](const auto & left, const auto & right) { return left.second < right.second; });
-    auto it_max_buy = std::max_element(
-        buying_book.cbegin(), buying_book.cend(), [](const auto & left, const auto & right) { return left.second < right.second; });
-
-    const auto the_max = std::max(it_max_sell->second, it_max_buy->second);
-
-    for (auto it = selling_book.crbegin(); it != selling_book.crend(); ++it)
-    {
-        fmt::print(fmt::fg(fmt::color::orange), " {:>9.2f} USD - {:>6L} shares | {}\n", static_cast<double>(it->first) / 1000.0, it->second,
-            build_bar(20, it->second, the_max));
-    }
-
-    fmt::print(fmt::fg(fmt::color::green), "\n *** Buying\n");
-
-    for (auto it = buying_book.crbegin(); it != buying_book.crend(); ++it)
-    {
-        fmt::print(fmt::fg(fmt::color::green), " {:>9.2f} USD - {:>6L} shares | {}\n", static_cast<double>(it->first) / 1000.0, it->second,
-            build_bar(20, it->second, the_max));
-    }
+    throw std::runtime_error("unknown order store, expected flat, node, direct or concurrent");
 }
 
 int main(int argc, char ** argv)
@@ -338,109 +200,38 @@ int main(int argc, char ** argv)
         std::locale::global(std::locale("en_US.UTF-8"));
         std::setlocale(LC_ALL, "en_US.UTF-8");
 
-        fmt::print("Nasdaq orders executor\n");
-
         const config cfg = parse_config(argc, argv);
 
+        // only the books go to the output of csv, jsonl and binary
+        if (cfg.output_format != "text") report_file = stderr;
+
+        fmt::print(report_file, "Nasdaq orders executor\n");
+
         qdb::handle h;
 
         qdb_error_t err = h.connect(cfg.qdb_url.c_str());
         throw_on_failure(err, "connection error");
 
-        auto total_start_time = std::chrono::high_resolution_clock::now();
-
-        const auto [range_start_ts, range_end_ts] = get_time_range(cfg.when);
-
-        itch::order_records orders;
-        itch::execution_engine engine;
-
-        std::uint64_t missed_orders = 0;
-
-        itch::order_records::const_iterator it_orders_records;
-        utils::timespec snap_ts;
-
-        if (cfg.point_in_time)
-        {
-            // look for a snapshot
-            snap_ts = restore_snapshot(h, engine, cfg.stock, range_end_ts);
-        }
-
-        if (snap_ts != utils::timespec{})
-        {
-            fmt::print("Used snapshot {}\n", utils::to_iso_extended_string_utc(static_cast<std::time_t>(snap_ts.sec.count())));
-            orders            = get_orders_records(h, cfg.stock + "_orders", snap_ts, range_end_ts);
-            it_orders_records = orders.lower_bound(snap_ts);
-        }
-        else
-        {
-            orders            = get_orders_records(h, cfg.stock + "_orders", range_start_ts, range_end_ts);
-            it_orders_records = orders.cbegin();
-        }
-
-        auto get_end_time = std::chrono::high_resolution_clock::now();
-
-        for (; it_orders_records != orders.cend(); ++it_orders_records)
-        {
-            if (!engine.run_order(it_orders_records->second)) ++missed_orders;
-        }
-
-        if (cfg.point_in_time && !orders.empty() && (snap_ts < get_snapshot_timestamp(range_end_ts)))
-        {
-            store_snapshot(h, engine, cfg.stock, range_end_ts);
-        }
-
-        auto engine_end_time = std::chrono::high_resolution_clock::now();
-
-        const auto buying_book  = engine.buy_book();
-        const auto selling_book = engine.sell_book();
-
-        auto total_end_time = std::chrono::high_resolution_clock::now();
-
-        fmt::print(
-            "Order book for {} at {} \n", cfg.stock, utils::to_iso_extended_string_utc(static_cast<std::time_t>(range_end_ts.sec.count())));
-        fmt::print("Processed orders {:L} - missed orders {:L} - Point In Time: {}\n", orders.size(), missed_orders,
-            cfg.point_in_time ? "enabled" : "disabled");
-
-        if (cfg.collapsed)
-        {
-            const auto collapsed_buying_book  = engine.collapse_book(buying_book);
-            const auto collapsed_selling_book = engine.collapse_book(selling_book);
-
-            print_collapsed_books(collapsed_buying_book, collapsed_selling_book);
-        }
-        else
-        {
-            print_books(buying_book, selling_book);
-        }
-
-        const auto elapsed_get   = std::chrono::duration_cast<std::chrono::microseconds>(get_end_time - total_start_time);
-        const auto elapsed_run   = std::chrono::duration_cast<std::chrono::microseconds>(engine_end_time - get_end_time);
-        const auto build_book    = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - engine_end_time);
-        const auto total_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(total_end_time - total_start_time);
-
-        fmt::print(fmt::fg(fmt::color::cyan), "\n Total elapsed time: {:>9L} us\n", total_elapsed.count());
-        fmt::print(fmt::fg(fmt::color::cyan), "      Data transfer: {:>9L} us\n", elapsed_get.count());
-        fmt::print(fmt::fg(fmt::color::cyan), "   Engine execution: {:>9L} us\n", elapsed_run.count());
-        fmt::print(fmt::fg(fmt::color::cyan), "      Book building: {:>9L} us\n", build_book.count());
+        run(h, cfg);
 
         return EXIT_SUCCESS;
     }
 
     catch (const boost::program_options::validation_error & e)
     {
-        fmt::print(fmt::fg(fmt::color::red), "invalid option: {}", e.what());
+        fmt::print(report_file, fmt::fg(fmt::color::red), "invalid option: {}", e.what());
         return EXIT_FAILURE;
     }
 
     catch (const std::error_code & ec)
     {
-        fmt::print(fmt::fg(fmt::color::red), "error caught: {}", ec.message());
+        fmt::print(report_file, fmt::fg(fmt::color::red), "error caught: {}", ec.message());
         return EXIT_FAILURE;
     }
 
     catch (const std::exception & e)
     {
-        fmt::print(fmt::fg(fmt::color::red), "exception caught: {}", e.what());
+        fmt::print(report_file, fmt::fg(fmt::color::red), "exception caught: {}", e.what());
         return EXIT_FAILURE;
     }
 }
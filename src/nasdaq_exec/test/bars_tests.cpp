@@ -0,0 +1,173 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_bars.hpp>
+#include <nasdaq_exec/itch_executions.hpp>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+// the executions of a flow, computed from the records alone
+class naive_executions
+{
+public:
+    void add(std::int64_t timestamp, const itch::order_record & r)
+    {
+        switch (r.order_type)
+        {
+        case itch::messages::add_order_without_attribution::message_code:
+        case itch::messages::add_order_with_attribution::message_code:
+            _prices[r.reference] = itch::convert_to_fix(r.price);
+            break;
+
+        case itch::messages::order_replace::message_code:
+            _prices[r.new_reference] = itch::convert_to_fix(r.price);
+            break;
+
+        case itch::messages::order_executed::message_code:
+            executions.push_back(itch::execution{timestamp, r.reference, _prices[r.reference], r.shares, r.is_buy, true});
+            break;
+
+        case itch::messages::order_executed_with_price::message_code:
+            executions.push_back(itch::execution{timestamp, r.reference, itch::convert_to_fix(r.price), r.shares, r.is_buy, r.printable});
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    std::vector<itch::execution> executions;
+
+private:
+    std::unordered_map<std::uint64_t, std::uint32_t> _prices;
+};
+
+// the bars of one width, by start
+std::map<std::int64_t, itch::bar> naive_bars(const std::vector<itch::execution> & executions, std::int64_t width)
+{
+    std::map<std::int64_t, itch::bar> res;
+
+    for (const auto & e : executions)
+    {
+        if (!e.printable) continue;
+
+        const std::int64_t start = e.timestamp - e.timestamp % width;
+
+        const auto it = res.find(start);
+
+        if (it == res.end())
+        {
+            res.emplace(start, itch::bar{start, e.price, e.price, e.price, e.price, e.shares, std::uint64_t{e.price} * e.shares, 1u});
+            continue;
+        }
+
+        auto & b = it->second;
+
+        b.high  = std::max(b.high, e.price);
+        b.low   = std::min(b.low, e.price);
+        b.close = e.price;
+        b.volume += e.shares;
+        b.notional += std::uint64_t{e.price} * e.shares;
+        ++b.trades;
+    }
+
+    return res;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(bars)
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(executions_match_records, Engine, all_engines)
+{
+    Engine engine;
+    itch::execution_log log;
+
+    engine.set_execution_log(&log);
+
+    random_orders orders{47u};
+    naive_executions expected;
+
+    for (int i = 0; i < 20'000; ++i)
+    {
+        const std::int64_t ns = 1'600'000'000'000'000'000 + i * 1'000;
+        const auto r          = orders.next();
+
+        BOOST_REQUIRE(engine.run_order(utils::timespec{utils::nanoseconds{ns}}, r));
+        expected.add(ns, r);
+    }
+
+    BOOST_REQUIRE_EQUAL(log.size(), expected.executions.size());
+
+    for (size_t i = 0; i < log.size(); ++i)
+    {
+        const auto & e = expected.executions[i];
+
+        BOOST_TEST(log[i].timestamp == e.timestamp);
+        BOOST_TEST(log[i].reference == e.reference);
+        BOOST_TEST(log[i].price == e.price);
+        BOOST_TEST(log[i].shares == e.shares);
+        BOOST_TEST(log[i].is_buy == e.is_buy);
+        BOOST_TEST(log[i].printable == e.printable);
+    }
+}
+
+// the rings are small, they fill up and are drained as the executor does
+BOOST_AUTO_TEST_CASE(bars_match_naive_bars)
+{
+    random_orders orders{147u};
+    naive_executions flow;
+
+    // an order every 40 ms, the executions span a few minutes
+    for (int i = 0; i < 20'000; ++i)
+    {
+        flow.add(1'600'000'000'000'000'000 + static_cast<std::int64_t>(i) * 40'000'000, orders.next());
+    }
+
+    const std::vector<std::chrono::seconds> widths{std::chrono::seconds{1}, std::chrono::seconds{10}, std::chrono::seconds{60}};
+
+    itch::bar_builder builder{widths, 16u};
+    std::vector<std::vector<itch::bar>> bars(widths.size());
+
+    const auto drain = [&builder, &bars]() { builder.drain([&bars](size_t i, const itch::bar & b) { bars[i].push_back(b); }); };
+
+    for (const auto & e : flow.executions)
+    {
+        if (builder.add(e)) drain();
+    }
+
+    builder.close();
+    drain();
+
+    for (size_t i = 0; i < widths.size(); ++i)
+    {
+        const auto expected = naive_bars(flow.executions, std::chrono::nanoseconds{widths[i]}.count());
+
+        BOOST_REQUIRE_EQUAL(bars[i].size(), expected.size());
+
+        auto it = expected.begin();
+
+        for (const auto & b : bars[i])
+        {
+            const auto & e = (it++)->second;
+
+            BOOST_TEST(b.start == e.start);
+            BOOST_TEST(b.open == e.open);
+            BOOST_TEST(b.high == e.high);
+            BOOST_TEST(b.low == e.low);
+            BOOST_TEST(b.close == e.close);
+            BOOST_TEST(b.volume == e.volume);
+            BOOST_TEST(b.notional == e.notional);
+            BOOST_TEST(b.trades == e.trades);
+            BOOST_TEST(b.vwap() == static_cast<std::uint32_t>(e.notional / e.volume));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
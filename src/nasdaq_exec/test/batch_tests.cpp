@@ -0,0 +1,101 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_batch.hpp>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+
+// the records as the readers fill a batch, a timestamp every 10 us with a few orders sharing one
+itch::order_batch to_batch(const std::vector<itch::order_record> & records)
+{
+    itch::order_batch res;
+
+    res.resize(records.size());
+    res.mpids.resize(records.size());
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const auto & r = records[i];
+
+        res.timestamps[i]     = 1'600'000'000'000'000'000 + static_cast<std::int64_t>(i / 3u) * 10'000;
+        res.types[i]          = r.order_type;
+        res.references[i]     = r.reference;
+        res.new_references[i] = r.new_reference;
+        res.shares[i]         = r.shares;
+        res.prices[i]         = itch::convert_to_fix(r.price);
+        res.is_buy[i]         = static_cast<std::uint8_t>(r.is_buy);
+        res.printable[i]      = static_cast<std::uint8_t>(r.printable);
+        res.mpids[i]          = r.mpid;
+    }
+
+    return res;
+}
+
+template <typename Engine>
+void check_same_book(const Engine & engine, const Engine & expected)
+{
+    BOOST_TEST((engine.buy_book() == expected.buy_book()));
+    BOOST_TEST((engine.sell_book() == expected.sell_book()));
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(batch)
+
+// the slices of a batch run one after the other like a stream does
+BOOST_AUTO_TEST_CASE_TEMPLATE(batch_matches_records, Engine, all_engines)
+{
+    random_orders orders{40u};
+
+    std::vector<itch::order_record> records;
+
+    for (int i = 0; i < 20'000; ++i)
+    {
+        records.push_back(orders.next());
+    }
+
+    const auto batch = to_batch(records);
+
+    Engine expected;
+    Engine engine;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        BOOST_REQUIRE(expected.run_order(batch.timestamp(i), records[i]));
+    }
+
+    for (size_t first = 0; first < batch.size(); first += 1'000u)
+    {
+        BOOST_TEST(engine.run_orders(batch, first, std::min(first + 1'000u, batch.size())) == 0u);
+    }
+
+    check_same_book(engine, expected);
+}
+
+BOOST_AUTO_TEST_CASE(timestamps)
+{
+    itch::order_batch batch;
+
+    batch.resize(4u);
+    batch.timestamps = {1'000, 2'000, 2'000, 3'000};
+
+    BOOST_TEST(batch.printable == std::vector<std::uint8_t>(4u, 1u), boost::test_tools::per_element());
+    BOOST_TEST(batch.mpids.empty());
+
+    const utils::timespec ts{utils::nanoseconds{2'000}};
+
+    BOOST_TEST(batch.lower_bound(ts) == 1u);
+    BOOST_TEST(batch.upper_bound(ts) == 3u);
+    BOOST_TEST(itch::order_batch::to_nanoseconds(batch.timestamp(3u)) == 3'000);
+
+    batch.mpids.resize(4u);
+    batch.clear();
+
+    BOOST_TEST(batch.empty());
+    BOOST_TEST(batch.mpids.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
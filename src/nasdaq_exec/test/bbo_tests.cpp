@@ -0,0 +1,73 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_bbo.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(bbo)
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(best_bid_offer_matches_naive_book, Engine, all_engines)
+{
+    for (const bool bbo : {false, true})
+    {
+        Engine engine;
+        engine.track_bbo(bbo);
+
+        random_orders orders{1u};
+
+        for (int i = 0; i < 10'000; ++i)
+        {
+            BOOST_REQUIRE(engine.run_order(orders.next()));
+
+            // the slow path is one pass on all the orders
+            if (!bbo && (i % 13)) continue;
+
+            BOOST_TEST((engine.best_bid_offer() == orders.best_bid_offer()));
+        }
+    }
+}
+
+// one row per change, none when the order didn't touch the best levels
+BOOST_AUTO_TEST_CASE(timeline_has_every_change)
+{
+    itch::execution_engine engine;
+    itch::bbo_timeline timeline;
+
+    engine.set_bbo_timeline(&timeline);
+
+    random_orders orders{29u};
+
+    std::vector<utils::timespec> timestamps;
+    std::vector<itch::bbo> changes;
+
+    for (int i = 0; i < 10'000; ++i)
+    {
+        const utils::timespec timestamp{std::chrono::seconds{i}};
+
+        BOOST_REQUIRE(engine.run_order(timestamp, orders.next()));
+
+        const auto expected = orders.best_bid_offer();
+        if (!changes.empty() && (changes.back() == expected)) continue;
+
+        timestamps.push_back(timestamp);
+        changes.push_back(expected);
+    }
+
+    BOOST_REQUIRE_EQUAL(timeline.size(), changes.size());
+    BOOST_TEST(changes.size() < 10'000u);
+
+    for (size_t i = 0; i < changes.size(); ++i)
+    {
+        BOOST_TEST((timeline.timestamps[i] == timestamps[i]));
+        BOOST_TEST(timeline.bids[i] == changes[i].bid);
+        BOOST_TEST(timeline.bid_shares[i] == changes[i].bid_shares);
+        BOOST_TEST(timeline.bid_orders[i] == changes[i].bid_orders);
+        BOOST_TEST(timeline.asks[i] == changes[i].ask);
+        BOOST_TEST(timeline.ask_shares[i] == changes[i].ask_shares);
+        BOOST_TEST(timeline.ask_orders[i] == changes[i].ask_orders);
+    }
+
+    engine.set_bbo_timeline(nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,159 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_deltas.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+itch::collapsed_book collapse(const std::vector<itch::price_level> & levels)
+{
+    itch::collapsed_book res;
+
+    for (const auto & l : levels)
+    {
+        res.emplace(l.price, l.shares);
+    }
+
+    return res;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(deltas)
+
+// the feed read back and applied to empty books gives the naive book at every timestamp, without a change that changes nothing
+BOOST_AUTO_TEST_CASE_TEMPLATE(deltas_rebuild_naive_book, Engine, all_engines)
+{
+    Engine engine;
+    itch::level_delta_log log;
+
+    engine.set_level_delta_log(&log);
+
+    random_orders orders{49u};
+
+    // the naive books at the end of each timestamp
+    std::map<std::int64_t, std::pair<itch::collapsed_book, itch::collapsed_book>> expected;
+
+    std::vector<std::uint8_t> feed;
+
+    for (int i = 0; i < 20'000; ++i)
+    {
+        // a few orders share a timestamp
+        const std::int64_t ns = 1'600'000'000'000'000'000 + (i / 4) * 1'000;
+
+        BOOST_REQUIRE(engine.run_order(utils::timespec{utils::nanoseconds{ns}}, orders.next()));
+
+        expected[ns] = {collapse(orders.levels(true)), collapse(orders.levels(false))};
+
+        // the consumer reads what is closed now and then
+        if (i % 1'000) continue;
+
+        itch::serialize_level_deltas(log, feed);
+        log.clear();
+    }
+
+    log.close();
+    itch::serialize_level_deltas(log, feed);
+
+    itch::collapsed_book buy;
+    itch::collapsed_book sell;
+
+    const std::uint8_t * p = feed.data();
+    size_t l               = feed.size();
+
+    std::int64_t timestamp = 0;
+    std::int64_t previous  = 0;
+    size_t records         = 0;
+    std::vector<itch::level_delta> deltas;
+
+    while (itch::deserialize_level_deltas(p, l, timestamp, deltas))
+    {
+        BOOST_TEST(timestamp > previous);
+        BOOST_TEST(!deltas.empty());
+
+        for (const auto & d : deltas)
+        {
+            const auto & book = d.is_buy ? buy : sell;
+            const auto it     = book.find(d.price);
+
+            BOOST_TEST(d.shares != ((it != book.end()) ? it->second : 0u));
+        }
+
+        itch::apply_level_deltas(deltas, buy, sell);
+
+        const auto e = expected.find(timestamp);
+        BOOST_REQUIRE(e != expected.end());
+
+        BOOST_TEST((buy == e->second.first));
+        BOOST_TEST((sell == e->second.second));
+
+        previous = timestamp;
+        ++records;
+    }
+
+    BOOST_TEST(l == 0u);
+    BOOST_TEST(records > 1'000u);
+
+    BOOST_TEST((buy == collapse(orders.levels(true))));
+    BOOST_TEST((sell == collapse(orders.levels(false))));
+}
+
+BOOST_AUTO_TEST_CASE(coalesced_by_timestamp)
+{
+    itch::level_delta_log log;
+
+    // added and removed within the timestamp
+    log.update(1, true, 1'000u, 100u, 100);
+    log.update(1, true, 1'000u, 0u, -100);
+
+    // two changes of the same level, the last size is kept
+    log.update(1, false, 1'010u, 300u, 300);
+    log.update(1, false, 1'010u, 200u, -100);
+
+    log.update(2, true, 999u, 50u, 50);
+
+    BOOST_TEST(log.size() == 1u);
+    BOOST_REQUIRE_EQUAL(log.deltas.size(), 1u);
+    BOOST_TEST(log.deltas[0].price == 1'010u);
+    BOOST_TEST(log.deltas[0].shares == 200u);
+    BOOST_TEST(!log.deltas[0].is_buy);
+
+    // nothing changed at all, no record
+    log.update(3, true, 999u, 60u, 10);
+    log.update(3, true, 999u, 50u, -10);
+    log.close();
+
+    BOOST_TEST((log.timestamps == std::vector<std::int64_t>{1, 2}));
+    BOOST_TEST((log.ends == std::vector<size_t>{1u, 2u}));
+}
+
+BOOST_AUTO_TEST_CASE(truncated_feed)
+{
+    itch::level_delta_log log;
+
+    log.update(1, true, 1'000u, 100u, 100);
+    log.update(1, false, 1'010u, 200u, 200);
+    log.close();
+
+    std::vector<std::uint8_t> feed;
+    itch::serialize_level_deltas(log, feed);
+
+    BOOST_TEST(feed.size() == sizeof(std::int64_t) + sizeof(std::uint32_t) + 2u * itch::level_delta_size);
+
+    std::int64_t timestamp = 0;
+    std::vector<itch::level_delta> deltas;
+
+    for (size_t size = 0; size < feed.size(); ++size)
+    {
+        const std::uint8_t * p = feed.data();
+        size_t l               = size;
+
+        BOOST_TEST(!itch::deserialize_level_deltas(p, l, timestamp, deltas));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,132 @@
+#include "random_orders.hpp"
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace
+{
+
+std::vector<itch::price_level> top(std::vector<itch::price_level> levels, size_t depth)
+{
+    if (levels.size() > depth) levels.resize(depth);
+    return levels;
+}
+
+itch::collapsed_book collapse(const std::vector<itch::price_level> & levels)
+{
+    itch::collapsed_book res;
+
+    for (const auto & l : levels)
+    {
+        res.emplace(l.price, l.shares);
+    }
+
+    return res;
+}
+
+void check_levels(const std::vector<itch::price_level> & levels, const std::vector<itch::price_level> & expected)
+{
+    BOOST_REQUIRE_EQUAL(levels.size(), expected.size());
+
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        BOOST_TEST(levels[i].price == expected[i].price);
+        BOOST_TEST(levels[i].shares == expected[i].shares);
+        BOOST_TEST(levels[i].orders == expected[i].orders);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(depth)
+
+// a depth of 1 gets the top depleted all the time, a depth of 10 rarely
+BOOST_AUTO_TEST_CASE_TEMPLATE(levels_match_naive_book, Engine, all_engines)
+{
+    for (const size_t depth : {1u, 3u, 10u})
+    {
+        for (const bool bbo : {false, true})
+        {
+            Engine engine;
+
+            engine.set_depth(depth);
+            engine.track_bbo(bbo);
+
+            random_orders orders{static_cast<std::uint32_t>(depth)};
+
+            for (int i = 0; i < 10'000; ++i)
+            {
+                BOOST_REQUIRE(engine.run_order(orders.next()));
+
+                // the levels are refreshed when read, not reading them every time lets the top go stale in between
+                if (i % 7) continue;
+
+                check_levels(engine.buy_levels(), top(orders.levels(true), depth));
+                check_levels(engine.sell_levels(), top(orders.levels(false), depth));
+
+                if (i % 1'001) continue;
+
+                BOOST_TEST((Engine::collapse_book(engine.buy_book()) == collapse(orders.levels(true))));
+                BOOST_TEST((Engine::collapse_book(engine.sell_book()) == collapse(orders.levels(false))));
+                BOOST_TEST((Engine::collapse_book(engine.buy_book_top()) == collapse(top(orders.levels(true), depth))));
+                BOOST_TEST((Engine::collapse_book(engine.sell_book_top()) == collapse(top(orders.levels(false), depth))));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rebuild_matches_naive_book)
+{
+    random_orders orders{2u};
+
+    for (int i = 0; i < 5'000; ++i)
+    {
+        orders.next();
+
+        if (i % 97) continue;
+
+        for (const bool is_buy : {true, false})
+        {
+            itch::depth_book d{is_buy, 5u};
+            d.rebuild(naive_side{orders, is_buy});
+
+            BOOST_TEST(!d.stale());
+            check_levels(d.levels(), top(orders.levels(is_buy), 5u));
+
+            itch::level_ladder l{is_buy};
+            l.enable(true);
+            l.rebuild(naive_side{orders, is_buy});
+
+            check_levels(std::vector<itch::price_level>(l.begin(), l.end()), orders.levels(is_buy));
+        }
+    }
+}
+
+// a depth book fed with the updates only goes stale when a level it doesn't know of may have moved up
+BOOST_AUTO_TEST_CASE(depleted_top_goes_stale)
+{
+    itch::depth_book d{true, 2u};
+
+    d.update(1'000u, 100, 1);
+    d.update(999u, 100, 1);
+    d.update(998u, 100, 1);
+
+    BOOST_TEST(!d.stale());
+    BOOST_REQUIRE_EQUAL(d.levels().size(), 2u);
+
+    // 998 is unknown, it is now the second best
+    d.update(1'000u, -100, -1);
+    BOOST_TEST(d.stale());
+
+    itch::depth_book complete{true, 2u};
+
+    complete.update(1'000u, 100, 1);
+    complete.update(999u, 100, 1);
+    complete.update(1'000u, -100, -1);
+
+    BOOST_TEST(!complete.stale());
+    BOOST_REQUIRE_EQUAL(complete.levels().size(), 1u);
+    BOOST_TEST(complete.levels().front().price == 999u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
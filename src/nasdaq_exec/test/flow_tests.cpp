@@ -0,0 +1,159 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_flow.hpp>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+// the flows from the definition, the levels recomputed from the naive book after every order
+class naive_flow
+{
+public:
+    explicit naive_flow(const std::vector<size_t> & depths)
+        : _depths{depths}
+        , _flows(depths.size(), 0)
+    {}
+
+private:
+    static itch::price_level at(const std::vector<itch::price_level> & levels, size_t k)
+    {
+        return (k < levels.size()) ? levels[k] : itch::price_level{0, 0, 0};
+    }
+
+    // no ask is an infinite price
+    static std::uint64_t ask_price(const itch::price_level & l)
+    {
+        return l.shares ? l.price : std::numeric_limits<std::uint64_t>::max();
+    }
+
+public:
+    void update(const random_orders & orders)
+    {
+        const auto buys  = orders.levels(true);
+        const auto sells = orders.levels(false);
+
+        for (size_t i = 0; i < _depths.size(); ++i)
+        {
+            for (size_t k = 0; k < _depths[i]; ++k)
+            {
+                const auto b  = at(buys, k);
+                const auto pb = at(_buys, k);
+                const auto a  = at(sells, k);
+                const auto pa = at(_sells, k);
+
+                std::int64_t e = 0;
+
+                if (b.price >= pb.price) e += b.shares;
+                if (b.price <= pb.price) e -= pb.shares;
+                if (ask_price(a) <= ask_price(pa)) e -= a.shares;
+                if (ask_price(a) >= ask_price(pa)) e += pa.shares;
+
+                _flows[i] += e;
+            }
+        }
+
+        _buys  = buys;
+        _sells = sells;
+    }
+
+    std::int64_t flow(size_t i) const
+    {
+        return _flows[i];
+    }
+
+    void reset()
+    {
+        std::fill(_flows.begin(), _flows.end(), 0);
+    }
+
+    double imbalance(size_t i) const
+    {
+        double buy  = 0.0;
+        double sell = 0.0;
+
+        for (size_t k = 0; k < _depths[i]; ++k)
+        {
+            buy += at(_buys, k).shares;
+            sell += at(_sells, k).shares;
+        }
+
+        return (buy + sell > 0.0) ? (buy - sell) / (buy + sell) : 0.0;
+    }
+
+private:
+    std::vector<size_t> _depths;
+    std::vector<std::int64_t> _flows;
+
+    std::vector<itch::price_level> _buys;
+    std::vector<itch::price_level> _sells;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(flow)
+
+BOOST_AUTO_TEST_CASE(depths_are_sorted)
+{
+    itch::flow_metrics m{{5u, 1u, 0u, 3u, 5u}};
+
+    BOOST_TEST(m.depths() == (std::vector<size_t>{1u, 3u, 5u}), boost::test_tools::per_element());
+    BOOST_TEST(m.max_depth() == 5u);
+}
+
+// the metrics are attached to a book that already has orders, the flows start from it
+BOOST_AUTO_TEST_CASE_TEMPLATE(flows_match_naive_book, Engine, all_engines)
+{
+    const std::vector<size_t> depths{1u, 3u, 10u};
+
+    Engine engine;
+    random_orders orders{48u};
+    naive_flow expected{depths};
+
+    for (int i = 0; i < 2'000; ++i)
+    {
+        engine.run_order(orders.next());
+    }
+
+    expected.update(orders);
+    expected.reset();
+
+    itch::flow_metrics metrics{depths};
+    itch::flow_samples samples{depths.size()};
+
+    engine.set_flow_metrics(&metrics);
+
+    BOOST_TEST(engine.depth() >= 10u);
+
+    for (int i = 1; i <= 10'000; ++i)
+    {
+        const utils::timespec ts{utils::nanoseconds{1'600'000'000'000'000'000 + i * 1'000}};
+
+        BOOST_REQUIRE(engine.run_order(ts, orders.next()));
+        expected.update(orders);
+
+        if (i % 100) continue;
+
+        samples.append(ts, metrics);
+
+        for (size_t d = 0; d < depths.size(); ++d)
+        {
+            BOOST_TEST(samples.flows[d].back() == expected.flow(d));
+            BOOST_TEST(samples.imbalances[d].back() == expected.imbalance(d), boost::test_tools::tolerance(1e-12));
+        }
+
+        expected.reset();
+    }
+
+    BOOST_TEST(samples.size() == 100u);
+
+    for (size_t d = 0; d < depths.size(); ++d)
+    {
+        BOOST_TEST(metrics.flow(d) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
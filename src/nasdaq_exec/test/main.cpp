@@ -0,0 +1,2 @@
+#define BOOST_TEST_MODULE nasdaq_exec
+#include <boost/test/unit_test.hpp>
@@ -0,0 +1,181 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_participants.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+std::map<std::uint32_t, itch::participant_liquidity> by_mpid(const itch::participant_book & book)
+{
+    std::map<std::uint32_t, itch::participant_liquidity> res;
+
+    for (const auto & p : book.participants())
+    {
+        // every participant once
+        BOOST_TEST(res.emplace(p.mpid, p).second);
+    }
+
+    return res;
+}
+
+// the liquidity of every participant from the naive book, and the executions from the records
+class naive_participants
+{
+public:
+    void add(const itch::order_record & r)
+    {
+        switch (r.order_type)
+        {
+        case itch::messages::add_order_without_attribution::message_code:
+        case itch::messages::add_order_with_attribution::message_code:
+            _mpids[r.reference] = r.mpid;
+            break;
+
+        case itch::messages::order_replace::message_code:
+            _mpids[r.new_reference] = _mpids[r.reference];
+            break;
+
+        case itch::messages::order_executed::message_code:
+        case itch::messages::order_executed_with_price::message_code:
+            _executed[_mpids[r.reference]] += r.shares;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    std::map<std::uint32_t, itch::participant_liquidity> liquidity(const random_orders & orders) const
+    {
+        std::map<std::uint32_t, itch::participant_liquidity> res;
+
+        // the anonymous orders are always there
+        res[0].mpid = 0u;
+
+        for (const auto & [mpid, executed] : _executed)
+        {
+            res[mpid].mpid     = mpid;
+            res[mpid].executed = executed;
+        }
+
+        for (const auto & [reference, o] : orders.live())
+        {
+            auto & p = res[o.mpid];
+
+            p.mpid = o.mpid;
+            (o.is_buy ? p.buy_shares : p.sell_shares) += o.shares;
+        }
+
+        return res;
+    }
+
+private:
+    std::unordered_map<std::uint64_t, std::uint32_t> _mpids;
+    std::map<std::uint32_t, std::uint64_t> _executed;
+};
+
+void check_liquidity(
+    const std::map<std::uint32_t, itch::participant_liquidity> & l, const std::map<std::uint32_t, itch::participant_liquidity> & expected)
+{
+    BOOST_REQUIRE_EQUAL(l.size(), expected.size());
+
+    for (auto it = l.begin(), e = expected.begin(); it != l.end(); ++it, ++e)
+    {
+        BOOST_TEST(it->first == e->first);
+        BOOST_TEST(it->second.buy_shares == e->second.buy_shares);
+        BOOST_TEST(it->second.sell_shares == e->second.sell_shares);
+        BOOST_TEST(it->second.executed == e->second.executed);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(participants)
+
+// the book restored from its serialization carries on like the original
+BOOST_AUTO_TEST_CASE_TEMPLATE(liquidity_matches_naive_book, Engine, all_engines)
+{
+    Engine engine;
+    itch::participant_book book;
+
+    engine.set_participant_book(&book);
+
+    random_orders orders{50u};
+    naive_participants expected;
+
+    const auto run = [&](int count) {
+        for (int i = 0; i < count; ++i)
+        {
+            const auto r = orders.next();
+
+            BOOST_REQUIRE(engine.run_order(r));
+            expected.add(r);
+        }
+    };
+
+    run(10'000);
+
+    check_liquidity(by_mpid(book), expected.liquidity(orders));
+
+    // the totals are every resting share of the book
+    std::uint64_t shares = 0;
+
+    for (const auto & [reference, o] : orders.live())
+    {
+        shares += o.shares;
+    }
+
+    BOOST_TEST(book.total().buy_shares + book.total().sell_shares == shares);
+
+    itch::participant_book restored;
+
+    const auto blob = book.serialize();
+    BOOST_REQUIRE(restored.deserialize(blob.data(), blob.size()));
+
+    check_liquidity(by_mpid(restored), by_mpid(book));
+    BOOST_TEST((restored.serialize() == blob));
+
+    engine.set_participant_book(&restored);
+    run(10'000);
+
+    check_liquidity(by_mpid(restored), expected.liquidity(orders));
+}
+
+BOOST_AUTO_TEST_CASE(corruption_is_detected)
+{
+    itch::participant_book book;
+
+    book.add(true, 1u, 100u, itch::pack_mpid({'M', 'P', 'A', 'X'}));
+    book.add(false, 2u, 200u, 0u);
+    book.add(false, 3u, 300u, itch::pack_mpid({'M', 'P', 'B', 'X'}));
+    book.reduce(false, 3u, 50u, true, false);
+
+    const auto blob = book.serialize();
+
+    itch::participant_book read;
+
+    for (size_t l = 0; l < blob.size(); ++l)
+    {
+        BOOST_TEST(!read.deserialize(blob.data(), l));
+        BOOST_TEST(read.participants().size() == 1u);
+    }
+
+    for (size_t i = 0; i < blob.size(); ++i)
+    {
+        auto corrupted = blob;
+        corrupted[i] ^= 0x10u;
+
+        BOOST_TEST(!read.deserialize(corrupted.data(), corrupted.size()));
+    }
+
+    BOOST_REQUIRE(read.deserialize(blob.data(), blob.size()));
+    BOOST_TEST(read.participants().size() == 3u);
+    BOOST_TEST(read.total().sell_shares == 450u);
+    BOOST_TEST(read.total().executed == 50u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
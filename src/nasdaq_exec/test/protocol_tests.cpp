@@ -0,0 +1,154 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_protocol.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::vector<itch::price_level> top(std::vector<itch::price_level> levels, size_t depth)
+{
+    if (levels.size() > depth) levels.resize(depth);
+    return levels;
+}
+
+void check_levels(const std::vector<itch::price_level> & levels, const std::vector<itch::price_level> & expected)
+{
+    BOOST_REQUIRE_EQUAL(levels.size(), expected.size());
+
+    for (size_t i = 0; i < levels.size(); ++i)
+    {
+        BOOST_TEST(levels[i].price == expected[i].price);
+        BOOST_TEST(levels[i].shares == expected[i].shares);
+        BOOST_TEST(levels[i].orders == expected[i].orders);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(protocol)
+
+BOOST_AUTO_TEST_CASE(query_round_trip)
+{
+    itch::protocol::book_query q;
+
+    q.stock = "AAPL";
+    q.when  = utils::timespec{utils::seconds{1'577'973'600}, utils::nanoseconds{123'456'789}};
+    q.depth = 10u;
+
+    const auto message = itch::protocol::serialize_query(q);
+
+    // version, stock size, stock, time, depth
+    BOOST_TEST(message.size() == 2u + 4u + 16u + 2u);
+    BOOST_TEST(message.size() <= itch::protocol::max_query_size);
+
+    itch::protocol::book_query read;
+    BOOST_REQUIRE(itch::protocol::deserialize_query(message.data(), message.size(), read));
+
+    BOOST_TEST(read.stock == q.stock);
+    BOOST_TEST((read.when == q.when));
+    BOOST_TEST(read.depth == q.depth);
+
+    // every truncation is refused, so is a trailing byte
+    for (size_t l = 0; l < message.size(); ++l)
+    {
+        BOOST_TEST(!itch::protocol::deserialize_query(message.data(), l, read));
+    }
+
+    auto longer = message;
+    longer.push_back(0u);
+    BOOST_TEST(!itch::protocol::deserialize_query(longer.data(), longer.size(), read));
+}
+
+BOOST_AUTO_TEST_CASE(bad_queries)
+{
+    itch::protocol::book_query q;
+    q.stock = "MSFT";
+
+    auto message = itch::protocol::serialize_query(q);
+    itch::protocol::book_query read;
+
+    // another version
+    message[0] = itch::protocol::version + 1u;
+    BOOST_TEST(!itch::protocol::deserialize_query(message.data(), message.size(), read));
+
+    // no stock
+    q.stock.clear();
+    message = itch::protocol::serialize_query(q);
+    BOOST_TEST(!itch::protocol::deserialize_query(message.data(), message.size(), read));
+
+    // nanoseconds out of range, the fourth byte of the field is 0x80
+    q.stock = "MSFT";
+    message = itch::protocol::serialize_query(q);
+    message[2u + 4u + 8u + 3u] = 0x80u;
+    BOOST_TEST(!itch::protocol::deserialize_query(message.data(), message.size(), read));
+
+    q.stock = std::string(256u, 'A');
+    BOOST_CHECK_THROW(itch::protocol::serialize_query(q), std::length_error);
+}
+
+// the levels of a real book go through unchanged
+BOOST_AUTO_TEST_CASE(answer_round_trip)
+{
+    itch::execution_engine engine;
+    engine.set_depth(20u);
+
+    random_orders orders{42u};
+
+    for (int i = 0; i < 5'000; ++i)
+    {
+        engine.run_order(orders.next());
+    }
+
+    itch::protocol::book_answer a;
+
+    a.warm       = true;
+    a.time       = utils::timespec{utils::seconds{1'577'973'600}, utils::nanoseconds{5}};
+    a.replayed   = 5'000u;
+    a.elapsed_us = 1'234u;
+    a.buy        = engine.buy_levels();
+    a.sell       = engine.sell_levels();
+
+    BOOST_REQUIRE(!a.buy.empty());
+    BOOST_REQUIRE(!a.sell.empty());
+
+    const auto message = itch::protocol::serialize_answer(a);
+
+    itch::protocol::book_answer read;
+    BOOST_REQUIRE(itch::protocol::deserialize_answer(message.data(), message.size(), read));
+
+    BOOST_TEST((read.result == itch::protocol::status::ok));
+    BOOST_TEST(read.warm);
+    BOOST_TEST((read.time == a.time));
+    BOOST_TEST(read.replayed == a.replayed);
+    BOOST_TEST(read.elapsed_us == a.elapsed_us);
+    check_levels(read.buy, top(orders.levels(true), 20u));
+    check_levels(read.sell, top(orders.levels(false), 20u));
+
+    // the counts must match the size of the message
+    for (size_t l = 0; l < message.size(); ++l)
+    {
+        BOOST_TEST(!itch::protocol::deserialize_answer(message.data(), l, read));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(failed_answer)
+{
+    itch::protocol::book_answer a;
+    a.result = itch::protocol::status::bad_request;
+
+    const auto message = itch::protocol::serialize_answer(a);
+
+    itch::protocol::book_answer read;
+    read.buy.resize(3u);
+
+    BOOST_REQUIRE(itch::protocol::deserialize_answer(message.data(), message.size(), read));
+    BOOST_TEST((read.result == itch::protocol::status::bad_request));
+    BOOST_TEST(!read.warm);
+    BOOST_TEST(read.buy.empty());
+    BOOST_TEST(read.sell.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_publisher.hpp>
+#include <boost/test/unit_test.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// every word holds the same value, a torn copy mixes two of them
+struct stamped
+{
+    std::array<std::uint64_t, 512> words;
+};
+
+void check_image(const std::array<itch::price_level, itch::book_image::max_levels> & image,
+    std::uint32_t count,
+    const std::vector<itch::price_level> & levels)
+{
+    BOOST_REQUIRE_EQUAL(count, levels.size());
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        BOOST_TEST(image[i].price == levels[i].price);
+        BOOST_TEST(image[i].shares == levels[i].shares);
+        BOOST_TEST(image[i].orders == levels[i].orders);
+    }
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(publisher)
+
+BOOST_AUTO_TEST_CASE(readers_never_see_a_torn_value)
+{
+    itch::seqlock<stamped> lock;
+
+    stamped v;
+    v.words.fill(0u);
+    lock.store(v);
+
+    constexpr std::uint64_t writes = 200'000u;
+
+    std::atomic<bool> done{false};
+    std::atomic<std::uint64_t> torn{0};
+
+    std::vector<std::thread> readers;
+
+    for (int r = 0; r < 3; ++r)
+    {
+        readers.emplace_back([&lock, &done, &torn]() {
+            stamped copy;
+            std::uint64_t last = 0;
+
+            while (!done.load(std::memory_order_acquire))
+            {
+                lock.load(copy);
+
+                for (const auto w : copy.words)
+                {
+                    if (w != copy.words.front()) ++torn;
+                }
+
+                // the values only go forward
+                if (copy.words.front() < last) ++torn;
+                last = copy.words.front();
+            }
+        });
+    }
+
+    for (std::uint64_t i = 1; i <= writes; ++i)
+    {
+        v.words.fill(i);
+        lock.store(v);
+    }
+
+    done.store(true, std::memory_order_release);
+
+    for (auto & t : readers)
+    {
+        t.join();
+    }
+
+    BOOST_TEST(torn.load() == 0u);
+    BOOST_TEST(lock.epoch() == writes + 1u);
+}
+
+BOOST_AUTO_TEST_CASE(publishes_the_top_of_the_book)
+{
+    constexpr size_t levels = 5u;
+
+    itch::execution_engine engine;
+    engine.set_depth(levels);
+
+    itch::book_publisher publisher{levels, itch::publication_policy{100u, std::chrono::microseconds{0}}};
+
+    random_orders orders{28u};
+
+    itch::book_image image;
+    itch::read_metrics metrics;
+
+    for (int i = 1; i <= 10'000; ++i)
+    {
+        engine.run_order(orders.next());
+
+        const bool published = publisher.on_message(engine, utils::timespec{});
+        BOOST_TEST(published == ((i % 100) == 0));
+
+        if (!published) continue;
+
+        publisher.read(image, metrics);
+
+        BOOST_TEST(image.messages == static_cast<std::uint64_t>(i));
+        check_image(image.buy, image.buy_count, engine.buy_levels());
+        check_image(image.sell, image.sell_count, engine.sell_levels());
+    }
+
+    BOOST_TEST(publisher.published() == 100u);
+    BOOST_TEST(metrics.reads == 100u);
+    BOOST_TEST(metrics.retries == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(levels_are_capped)
+{
+    itch::book_publisher publisher{itch::book_image::max_levels + 10u, itch::publication_policy{}};
+
+    BOOST_TEST(publisher.levels() == itch::book_image::max_levels);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
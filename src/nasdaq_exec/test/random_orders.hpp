@@ -0,0 +1,226 @@
+#pragma once
+
+#include <nasdaq_exec/itch_exec.hpp>
+#include <nasdaq_exec/itch_schema.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+
+// an order resting in the naive book
+struct naive_order
+{
+    bool is_buy;
+    std::uint32_t price;
+    std::uint32_t shares;
+    std::uint32_t mpid;
+};
+
+// a random but valid flow of adds, executions, cancels, deletes and replaces around 100.00
+//
+// every message is applied to a plain map of the live orders as it is generated, the structures of the engine
+// are checked against what is computed from that map the slow way
+class random_orders
+{
+public:
+    explicit random_orders(std::uint32_t seed, size_t live_orders = 300u)
+        : _gen{seed}
+        , _live_orders{live_orders}
+    {}
+
+private:
+    std::uint32_t uniform(std::uint32_t count)
+    {
+        return std::uniform_int_distribution<std::uint32_t>{0u, count - 1u}(_gen);
+    }
+
+    // up to 30 ticks away from the spread, the two sides never cross
+    double random_price(bool is_buy)
+    {
+        const double ticks = static_cast<double>(uniform(30u)) * 0.01;
+        return is_buy ? (100.0 - ticks) : (100.01 + ticks);
+    }
+
+    itch::order_record add_order()
+    {
+        itch::order_record r{};
+
+        r.reference = _next_reference++;
+        r.is_buy    = uniform(2u) == 0u;
+        r.shares    = 1u + uniform(500u);
+        r.price     = random_price(r.is_buy);
+
+        // a quarter of the orders are attributed
+        if (uniform(4u) == 0u)
+        {
+            r.order_type = itch::messages::add_order_with_attribution::message_code;
+            r.mpid       = itch::pack_mpid({'M', 'P', static_cast<char>('A' + uniform(3u)), 'X'});
+        }
+        else
+        {
+            r.order_type = itch::messages::add_order_without_attribution::message_code;
+        }
+
+        _live.emplace(r.reference, naive_order{r.is_buy, itch::convert_to_fix(r.price), r.shares, r.mpid});
+        return r;
+    }
+
+public:
+    // the next message, already applied to the naive book
+    itch::order_record next()
+    {
+        if (_live.empty() || (uniform(100u) < ((_live.size() < _live_orders) ? 45u : 30u))) return add_order();
+
+        const auto it = std::next(_live.begin(), static_cast<std::ptrdiff_t>(uniform(static_cast<std::uint32_t>(_live.size()))));
+        auto & o      = it->second;
+
+        itch::order_record r{};
+
+        r.reference = it->first;
+        r.is_buy    = o.is_buy;
+
+        switch (uniform(5u))
+        {
+        case 0u:
+            r.order_type = itch::messages::order_executed::message_code;
+            r.shares     = 1u + uniform(o.shares);
+            break;
+
+        case 1u:
+            r.order_type = itch::messages::order_executed_with_price::message_code;
+            r.shares     = 1u + uniform(o.shares);
+            r.price      = random_price(o.is_buy);
+            r.printable  = uniform(4u) != 0u;
+            break;
+
+        case 2u:
+            r.order_type = itch::messages::order_cancel::message_code;
+            r.shares     = 1u + uniform(o.shares);
+            break;
+
+        case 3u:
+            r.order_type = itch::messages::order_delete::message_code;
+            _live.erase(it);
+            return r;
+
+        default:
+            r.order_type    = itch::messages::order_replace::message_code;
+            r.new_reference = _next_reference++;
+            r.shares        = 1u + uniform(500u);
+            r.price         = random_price(o.is_buy);
+
+            // the participant stays with the order
+            _live.emplace(r.new_reference, naive_order{o.is_buy, itch::convert_to_fix(r.price), r.shares, o.mpid});
+            _live.erase(it);
+            return r;
+        }
+
+        o.shares -= r.shares;
+        if (!o.shares) _live.erase(it);
+
+        return r;
+    }
+
+    const std::map<std::uint64_t, naive_order> & live() const noexcept
+    {
+        return _live;
+    }
+
+    // every level of one side, best first
+    std::vector<itch::price_level> levels(bool is_buy) const
+    {
+        std::map<std::uint32_t, itch::price_level> by_price;
+
+        for (const auto & [reference, o] : _live)
+        {
+            if (o.is_buy != is_buy) continue;
+
+            auto & level = by_price[o.price];
+            level.price  = o.price;
+            level.shares += o.shares;
+            ++level.orders;
+        }
+
+        std::vector<itch::price_level> res;
+        res.reserve(by_price.size());
+
+        for (const auto & [price, level] : by_price)
+        {
+            res.push_back(level);
+        }
+
+        if (is_buy) std::reverse(res.begin(), res.end());
+        return res;
+    }
+
+    itch::bbo best_bid_offer() const
+    {
+        itch::bbo res;
+
+        const auto buys  = levels(true);
+        const auto sells = levels(false);
+
+        if (!buys.empty())
+        {
+            res.bid        = buys.front().price;
+            res.bid_shares = buys.front().shares;
+            res.bid_orders = buys.front().orders;
+        }
+
+        if (!sells.empty())
+        {
+            res.ask        = sells.front().price;
+            res.ask_shares = sells.front().shares;
+            res.ask_orders = sells.front().orders;
+        }
+
+        return res;
+    }
+
+    // calls f(reference, order) for every order of one side, what the book structures rebuild from
+    template <typename F>
+    void for_each(bool is_buy, F f) const
+    {
+        for (const auto & [reference, o] : _live)
+        {
+            if (o.is_buy == is_buy) f(reference, itch::order{o.price, o.shares});
+        }
+    }
+
+private:
+    std::mt19937 _gen;
+    size_t _live_orders;
+
+    std::map<std::uint64_t, naive_order> _live;
+    std::uint64_t _next_reference{1};
+};
+
+// one side of the naive book as an order store, for the rebuild functions of the book structures
+class naive_side
+{
+public:
+    naive_side(const random_orders & orders, bool is_buy)
+        : _orders{orders}
+        , _is_buy{is_buy}
+    {}
+
+    template <typename F>
+    void for_each(F f) const
+    {
+        _orders.for_each(_is_buy, f);
+    }
+
+private:
+    const random_orders & _orders;
+    bool _is_buy;
+};
+
+// every engine there is, the same flow must give the same book whatever the store and the allocator
+using all_engines = std::tuple<itch::basic_execution_engine<itch::flat_store_policy>,
+    itch::basic_execution_engine<itch::node_store_policy>,
+    itch::basic_execution_engine<itch::direct_store_policy>,
+    itch::basic_execution_engine<itch::direct_store_policy, itch::scalable_allocator_policy>,
+    itch::basic_execution_engine<itch::concurrent_store_policy>>;
@@ -0,0 +1,70 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_samples.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(samples)
+
+// a row has the best levels of the naive book, zeros past the last level of a side
+BOOST_AUTO_TEST_CASE_TEMPLATE(rows_match_naive_book, Engine, all_engines)
+{
+    constexpr size_t levels = 5u;
+
+    Engine engine;
+    engine.set_depth(levels);
+    engine.track_bbo(true);
+
+    // few orders, a side often has fewer levels than the samples
+    random_orders orders{44u, 8u};
+
+    itch::book_samples samples{levels};
+    samples.reserve(100u);
+
+    std::vector<std::vector<itch::price_level>> expected_buy;
+    std::vector<std::vector<itch::price_level>> expected_sell;
+
+    for (int i = 1; i <= 10'000; ++i)
+    {
+        BOOST_REQUIRE(engine.run_order(orders.next()));
+
+        if (i % 100) continue;
+
+        samples.append(utils::timespec{utils::seconds{i}}, engine.buy_levels(), engine.sell_levels());
+
+        expected_buy.push_back(orders.levels(true));
+        expected_sell.push_back(orders.levels(false));
+    }
+
+    BOOST_REQUIRE_EQUAL(samples.size(), 100u);
+    BOOST_TEST(samples.buy.size() == 100u * levels);
+    BOOST_TEST(samples.sell.size() == 100u * levels);
+
+    bool short_side = false;
+
+    for (size_t row = 0; row < samples.size(); ++row)
+    {
+        BOOST_TEST((samples.timestamps[row] == utils::timespec{utils::seconds{static_cast<std::int64_t>(row + 1u) * 100}}));
+
+        for (size_t level = 0; level < levels; ++level)
+        {
+            for (const bool is_buy : {true, false})
+            {
+                const auto & expected = is_buy ? expected_buy[row] : expected_sell[row];
+                const auto & l        = is_buy ? samples.buy_level(row, level) : samples.sell_level(row, level);
+
+                const itch::price_level e = (level < expected.size()) ? expected[level] : itch::price_level{0, 0, 0};
+
+                short_side |= level >= expected.size();
+
+                BOOST_TEST(l.price == e.price);
+                BOOST_TEST(l.shares == e.shares);
+                BOOST_TEST(l.orders == e.orders);
+            }
+        }
+    }
+
+    BOOST_TEST(short_side);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,287 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_batch.hpp>
+#include <nasdaq_exec/itch_schema.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace
+{
+
+// qdb_int64_undefined
+constexpr std::int64_t undefined = std::numeric_limits<std::int64_t>::min();
+
+// the rows of the legacy table, as the feed loader writes them
+struct legacy_columns
+{
+    std::vector<std::int64_t> timestamps;
+    std::vector<std::int64_t> type;
+    std::vector<std::int64_t> reference;
+    std::vector<std::int64_t> original_reference;
+    std::vector<std::int64_t> new_reference;
+    std::vector<std::int64_t> is_buy;
+    std::vector<std::int64_t> shares;
+    std::vector<double> price;
+};
+
+// the rows of the events and of the replaces tables
+struct compact_columns
+{
+    std::vector<std::int64_t> timestamps;
+    std::vector<std::int64_t> event;
+    std::vector<std::int64_t> reference;
+    std::vector<std::int64_t> price4;
+
+    std::vector<std::int64_t> replace_timestamps;
+    std::vector<std::int64_t> new_reference;
+};
+
+std::int64_t timestamp(size_t i)
+{
+    return 1'600'000'000'000'000'000 + static_cast<std::int64_t>(i / 3u) * 10'000;
+}
+
+legacy_columns write_legacy(const std::vector<itch::order_record> & records)
+{
+    legacy_columns res;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const auto & r        = records[i];
+        const bool is_replace = r.order_type == itch::messages::order_replace::message_code;
+
+        res.timestamps.push_back(timestamp(i));
+        res.type.push_back(r.order_type);
+        res.reference.push_back(is_replace ? undefined : static_cast<std::int64_t>(r.reference));
+        res.original_reference.push_back(is_replace ? static_cast<std::int64_t>(r.reference) : undefined);
+        res.new_reference.push_back(is_replace ? static_cast<std::int64_t>(r.new_reference) : undefined);
+        res.is_buy.push_back(static_cast<std::int64_t>(r.is_buy) | (r.printable ? 0 : itch::legacy_non_printable));
+        res.shares.push_back(r.shares);
+        res.price.push_back(r.price);
+    }
+
+    return res;
+}
+
+// the fields of get_legacy_orders_records
+itch::order_batch read_legacy(const legacy_columns & columns)
+{
+    itch::order_batch res;
+
+    res.resize(columns.timestamps.size());
+
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        const std::int64_t original = columns.original_reference[i];
+
+        res.timestamps[i]     = columns.timestamps[i];
+        res.types[i]          = static_cast<char>(columns.type[i]);
+        res.references[i]     = static_cast<std::uint64_t>((original != undefined) ? original : columns.reference[i]);
+        res.new_references[i] = static_cast<std::uint64_t>(columns.new_reference[i]);
+        res.is_buy[i]         = static_cast<std::uint8_t>((columns.is_buy[i] & 1) != 0);
+        res.printable[i]      = static_cast<std::uint8_t>((columns.is_buy[i] & itch::legacy_non_printable) == 0);
+        res.shares[i]         = static_cast<std::uint32_t>(columns.shares[i]);
+        res.prices[i]         = itch::convert_to_fix(columns.price[i]);
+    }
+
+    return res;
+}
+
+// the prices as Nasdaq sends them, what the feed loader writes to a compact table
+compact_columns write_compact(const std::vector<itch::order_record> & records)
+{
+    compact_columns res;
+
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const auto & r = records[i];
+
+        res.timestamps.push_back(timestamp(i));
+        res.event.push_back(itch::pack_event(r.order_type, r.is_buy, r.shares, r.printable));
+        res.reference.push_back(static_cast<std::int64_t>(r.reference));
+        res.price4.push_back(std::llround(r.price * 10'000.0));
+
+        if (r.order_type != itch::messages::order_replace::message_code) continue;
+
+        res.replace_timestamps.push_back(timestamp(i));
+        res.new_reference.push_back(static_cast<std::int64_t>(r.new_reference));
+    }
+
+    return res;
+}
+
+// the rows convert_day_orders writes from a legacy batch
+compact_columns convert(const itch::order_batch & orders)
+{
+    compact_columns res;
+
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        res.timestamps.push_back(orders.timestamps[i]);
+        res.event.push_back(itch::pack_event(orders.types[i], orders.is_buy[i] != 0, orders.shares[i], orders.printable[i] != 0));
+        res.reference.push_back(static_cast<std::int64_t>(orders.references[i]));
+        res.price4.push_back(static_cast<std::int64_t>(orders.prices[i]) * 10);
+
+        if (orders.types[i] != itch::messages::order_replace::message_code) continue;
+
+        res.replace_timestamps.push_back(orders.timestamps[i]);
+        res.new_reference.push_back(static_cast<std::int64_t>(orders.new_references[i]));
+    }
+
+    return res;
+}
+
+// the fields and the join of get_compact_orders_records
+itch::order_batch read_compact(const compact_columns & columns)
+{
+    itch::order_batch res;
+
+    res.resize(columns.timestamps.size());
+
+    size_t j = 0;
+
+    for (size_t i = 0; i < res.size(); ++i)
+    {
+        const std::int64_t v = columns.event[i];
+
+        res.timestamps[i] = columns.timestamps[i];
+        res.types[i]      = itch::event_type(v);
+        res.is_buy[i]     = static_cast<std::uint8_t>(itch::event_is_buy(v));
+        res.printable[i]  = static_cast<std::uint8_t>(itch::event_printable(v));
+        res.shares[i]     = itch::event_shares(v);
+        res.references[i] = static_cast<std::uint64_t>(columns.reference[i]);
+        res.prices[i]     = itch::price4_to_fix(columns.price4[i]);
+
+        if (res.types[i] != itch::messages::order_replace::message_code) continue;
+
+        BOOST_REQUIRE(j < columns.new_reference.size());
+        BOOST_REQUIRE(columns.replace_timestamps[j] == res.timestamps[i]);
+
+        res.new_references[i] = static_cast<std::uint64_t>(columns.new_reference[j++]);
+    }
+
+    BOOST_TEST(j == columns.new_reference.size());
+
+    return res;
+}
+
+// the prices of the flow get a fourth decimal, a tenth of them are half a tick of the book
+std::vector<itch::order_record> make_records(std::uint32_t seed, int count)
+{
+    random_orders orders{seed};
+    std::mt19937 gen{seed};
+    std::uniform_int_distribution<int> decimals{0, 9};
+
+    std::vector<itch::order_record> res;
+
+    for (int i = 0; i < count; ++i)
+    {
+        auto r = orders.next();
+        if (r.price != 0.0) r.price += decimals(gen) * 0.0001;
+        res.push_back(r);
+    }
+
+    return res;
+}
+
+template <typename Engine>
+Engine run(const itch::order_batch & batch)
+{
+    Engine engine;
+
+    BOOST_TEST(engine.run_orders(batch, 0u, batch.size()) == 0u);
+
+    return engine;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(schema)
+
+BOOST_AUTO_TEST_CASE(event_round_trip)
+{
+    const std::uint32_t shares[] = {0u, 1u, 100u, 65'536u, std::numeric_limits<std::uint32_t>::max()};
+
+    for (const char type : {'A', 'F', 'E', 'C', 'X', 'D', 'U'})
+    {
+        for (const bool is_buy : {false, true})
+        {
+            for (const bool printable : {false, true})
+            {
+                for (const std::uint32_t s : shares)
+                {
+                    const std::int64_t event = itch::pack_event(type, is_buy, s, printable);
+
+                    BOOST_TEST(itch::event_type(event) == type);
+                    BOOST_TEST(itch::event_is_buy(event) == is_buy);
+                    BOOST_TEST(itch::event_printable(event) == printable);
+                    BOOST_TEST(itch::event_shares(event) == s);
+                }
+            }
+        }
+    }
+
+    // the events written before the printable flag
+    BOOST_TEST(itch::event_printable(itch::pack_event('C', true, 100u)));
+}
+
+BOOST_AUTO_TEST_CASE(prices_round_the_same_way)
+{
+    // half a tick of the fixed point rounds up with both layouts
+    BOOST_TEST(itch::convert_to_fix(100.0005) == 100'001u);
+    BOOST_TEST(itch::price4_to_fix(1'000'005) == 100'001u);
+    BOOST_TEST(itch::convert_to_fix(100.0004) == 100'000u);
+    BOOST_TEST(itch::price4_to_fix(1'000'004) == 100'000u);
+
+    for (std::int64_t price4 = 999'000; price4 < 1'001'000; ++price4)
+    {
+        BOOST_TEST(itch::convert_to_fix(static_cast<double>(price4) / 10'000.0) == itch::price4_to_fix(price4));
+    }
+}
+
+// the same orders read from a legacy table, from the compact table it is converted to and from a compact table
+// written by the feed loader give the same book
+BOOST_AUTO_TEST_CASE_TEMPLATE(legacy_and_compact_give_the_same_book, Engine, all_engines)
+{
+    const auto records = make_records(41u, 20'000);
+
+    const auto legacy    = read_legacy(write_legacy(records));
+    const auto converted = read_compact(convert(legacy));
+    const auto compact   = read_compact(write_compact(records));
+
+    BOOST_TEST(converted.prices == legacy.prices, boost::test_tools::per_element());
+    BOOST_TEST(compact.prices == legacy.prices, boost::test_tools::per_element());
+    BOOST_TEST(compact.references == legacy.references, boost::test_tools::per_element());
+
+    // the new reference of the other events is undefined in a legacy table, the compact tables have none
+    for (size_t i = 0; i < legacy.size(); ++i)
+    {
+        if (legacy.types[i] != itch::messages::order_replace::message_code) continue;
+        BOOST_TEST(compact.new_references[i] == legacy.new_references[i]);
+    }
+
+    const auto expected = run<Engine>(legacy);
+
+    for (const auto & batch : {converted, compact})
+    {
+        const auto engine = run<Engine>(batch);
+
+        BOOST_TEST((engine.buy_book() == expected.buy_book()));
+        BOOST_TEST((engine.sell_book() == expected.sell_book()));
+    }
+
+    // and the same book as the records run one at a time
+    Engine engine;
+
+    for (const auto & r : records)
+    {
+        BOOST_REQUIRE(engine.run_order(r));
+    }
+
+    BOOST_TEST((engine.buy_book() == expected.buy_book()));
+    BOOST_TEST((engine.sell_book() == expected.sell_book()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+#include <nasdaq_exec/itch_snapshot_cache.hpp>
+#include <utils/crc32c.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// a directory of its own, removed with everything in it
+class temp_directory
+{
+public:
+    temp_directory()
+        : _path{boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("nasdaq_exec_tests_%%%%%%%%")}
+    {}
+
+    ~temp_directory()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(_path, ec);
+    }
+
+    const boost::filesystem::path & path() const noexcept
+    {
+        return _path;
+    }
+
+private:
+    boost::filesystem::path _path;
+};
+
+std::vector<std::uint8_t> make_blob(size_t size, std::uint8_t seed)
+{
+    std::vector<std::uint8_t> res(size);
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        res[i] = static_cast<std::uint8_t>(seed + i * 7u);
+    }
+
+    return res;
+}
+
+itch::snapshot_entry make_entry(const std::vector<std::uint8_t> & blob)
+{
+    return itch::snapshot_entry{utils::timespec{}, blob.size(), utils::crc32c(blob.data(), blob.size())};
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(snapshot_cache)
+
+BOOST_AUTO_TEST_CASE(hit_and_miss)
+{
+    temp_directory dir;
+    itch::snapshot_cache cache{dir.path(), 1'024u * 1'024u};
+
+    const auto blob = make_blob(10'000u, 1u);
+
+    BOOST_TEST(!cache.get("AAPL_2020-01-02T10:00:00", make_entry(blob)));
+
+    cache.put("AAPL_2020-01-02T10:00:00", blob.data(), blob.size());
+    BOOST_TEST(cache.stores() == 1u);
+
+    const auto mapping = cache.get("AAPL_2020-01-02T10:00:00", make_entry(blob));
+    BOOST_REQUIRE(mapping);
+
+    const auto v = mapping->view();
+    BOOST_TEST((std::vector<std::uint8_t>(v.first, v.first + v.second) == blob));
+    BOOST_TEST(cache.hits() == 1u);
+
+    // the directory says the snapshot changed, the cached copy is dropped
+    auto expected = make_entry(blob);
+    expected.checksum ^= 1u;
+
+    BOOST_TEST(!cache.get("AAPL_2020-01-02T10:00:00", expected));
+    BOOST_TEST(!cache.get("AAPL_2020-01-02T10:00:00", make_entry(blob)));
+
+    // larger than the whole cache, not stored
+    const auto large = make_blob(2'000'000u, 2u);
+    cache.put("AAPL_2020-01-02T11:00:00", large.data(), large.size());
+
+    BOOST_TEST(cache.stores() == 1u);
+    BOOST_TEST(!cache.get("AAPL_2020-01-02T11:00:00", make_entry(large)));
+}
+
+BOOST_AUTO_TEST_CASE(least_recently_used_is_evicted)
+{
+    temp_directory dir;
+    itch::snapshot_cache cache{dir.path(), 25'000u};
+
+    const std::vector<std::string> keys{"first", "second", "third"};
+    std::vector<std::vector<std::uint8_t>> blobs;
+
+    const std::time_t now = std::time(nullptr);
+
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        blobs.push_back(make_blob(10'000u, static_cast<std::uint8_t>(i)));
+        cache.put(keys[i], blobs[i].data(), blobs[i].size());
+
+        // the file times have a resolution of a second, make the order of use explicit
+        boost::filesystem::last_write_time(dir.path() / (keys[i] + ".snap"), now - 100 + static_cast<std::time_t>(i));
+    }
+
+    // the third put went over budget
+    BOOST_TEST(cache.evictions() == 1u);
+
+    BOOST_TEST(!cache.get(keys[0], make_entry(blobs[0])));
+    BOOST_TEST(cache.get(keys[1], make_entry(blobs[1])));
+    BOOST_TEST(cache.get(keys[2], make_entry(blobs[2])));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
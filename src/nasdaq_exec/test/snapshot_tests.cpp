@@ -0,0 +1,435 @@
+#include "random_orders.hpp"
+#include <nasdaq_exec/itch_snapshot.hpp>
+#include <utils/crc32c.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+template <typename Engine>
+void run(Engine & engine, random_orders & orders, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        BOOST_REQUIRE(engine.run_order(orders.next()));
+    }
+}
+
+template <typename Left, typename Right>
+void check_same_book(const Left & left, const Right & right)
+{
+    BOOST_TEST((left.buy_book() == right.buy_book()));
+    BOOST_TEST((left.sell_book() == right.sell_book()));
+}
+
+// restores a whole snapshot, header included, the way the executor does
+template <typename Engine>
+bool restore(Engine & engine, const std::vector<std::uint8_t> & snapshot)
+{
+    const std::uint8_t * p = snapshot.data();
+    size_t l               = snapshot.size();
+
+    itch::snapshot_header h;
+    if (!itch::deserialize_snapshot_header(p, l, h) || !itch::verify_snapshot(h, p, l)) return false;
+
+    if (h.kind == itch::snapshot_kind::delta) return engine.apply_changes(p, l, h.version) && !l;
+    return engine.deserialize_state(p, l, h.version, h.layout) && !l;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(snapshot)
+
+BOOST_AUTO_TEST_CASE(crc32c_check_value)
+{
+    const char data[] = "123456789";
+
+    BOOST_TEST(utils::crc32c(data, 9u) == 0xe3069283u);
+
+    // the checksum can be computed in pieces
+    BOOST_TEST(utils::crc32c(data + 4, 5u, utils::crc32c(data, 4u)) == 0xe3069283u);
+}
+
+BOOST_AUTO_TEST_CASE(varint_round_trip)
+{
+    const std::vector<std::uint64_t> values{0u, 1u, 127u, 128u, 300u, 16'383u, 16'384u, std::uint64_t{1} << 35u,
+        std::numeric_limits<std::uint64_t>::max()};
+
+    std::vector<std::uint8_t> out;
+
+    for (const auto v : values)
+    {
+        itch::serialize_varint(out, v);
+    }
+
+    const std::uint8_t * p = out.data();
+    size_t l               = out.size();
+
+    for (const auto v : values)
+    {
+        std::uint64_t read = 0;
+        BOOST_REQUIRE(itch::deserialize_varint(p, l, read));
+        BOOST_TEST(read == v);
+    }
+
+    BOOST_TEST(l == 0u);
+
+    // a truncated varint is an error
+    out.clear();
+    itch::serialize_varint(out, values.back());
+
+    std::uint64_t read = 0;
+    p                  = out.data();
+    l                  = out.size() - 1u;
+
+    BOOST_TEST(!itch::deserialize_varint(p, l, read));
+}
+
+BOOST_AUTO_TEST_CASE(bits_round_trip)
+{
+    std::mt19937 gen{31u};
+
+    for (std::uint8_t width = 0; width <= 32u; ++width)
+    {
+        const std::uint64_t max = (std::uint64_t{1} << width) - 1u;
+
+        std::vector<std::uint32_t> values(1'000u);
+        for (auto & v : values)
+        {
+            v = static_cast<std::uint32_t>(std::uniform_int_distribution<std::uint64_t>{0u, max}(gen));
+        }
+
+        BOOST_TEST(itch::bit_width(max) == width);
+
+        std::vector<std::uint8_t> out;
+        itch::pack_bits(out, values, width);
+
+        BOOST_TEST(out.size() == itch::packed_size(values.size(), width));
+
+        const std::uint8_t * p = out.data();
+        size_t l               = out.size();
+
+        std::vector<std::uint32_t> read;
+        BOOST_REQUIRE(itch::unpack_bits(p, l, read, values.size(), width));
+
+        BOOST_TEST(read == values);
+        BOOST_TEST(l == 0u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(orders_round_trip)
+{
+    random_orders orders{31u, 5'000u};
+
+    for (int i = 0; i < 20'000; ++i)
+    {
+        orders.next();
+    }
+
+    itch::order_entries entries;
+    orders.for_each(true, [&entries](std::uint64_t reference, const itch::order & o) { entries.emplace_back(reference, o); });
+
+    std::vector<std::uint8_t> out;
+    itch::serialize_orders(out, entries);
+
+    const std::uint8_t * p = out.data();
+    size_t l               = out.size();
+
+    itch::order_entries read;
+    const auto append = [&read](std::uint64_t reference, const itch::order & o) { read.emplace_back(reference, o); };
+
+    BOOST_REQUIRE(itch::deserialize_orders(p, l, append));
+
+    BOOST_TEST(l == 0u);
+    BOOST_TEST((read == entries));
+
+    // every truncation is detected
+    for (size_t size = 0; size < out.size(); size += 7u)
+    {
+        p = out.data();
+        l = size;
+
+        BOOST_TEST(!itch::deserialize_orders(p, l, [](std::uint64_t, const itch::order &) {}));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(header_round_trip)
+{
+    for (std::uint8_t version = 1; version <= itch::snapshot_header::current_version; ++version)
+    {
+        itch::snapshot_header h;
+
+        h.version   = version;
+        h.kind      = itch::snapshot_kind::delta;
+        h.chain     = 7u;
+        h.base      = utils::timespec{utils::seconds{1'600'000'000}, utils::nanoseconds{123}};
+        h.body_size = 456u;
+        h.checksum  = 0xdeadbeefu;
+        h.layout    = itch::snapshot_layout::image;
+
+        std::vector<std::uint8_t> out(itch::snapshot_header::serialized_size(version));
+
+        std::uint8_t * w = out.data();
+        size_t wl        = out.size();
+
+        itch::serialize_snapshot_header(w, wl, h);
+        BOOST_TEST(wl == 0u);
+
+        const std::uint8_t * p = out.data();
+        size_t l               = out.size();
+
+        itch::snapshot_header read;
+        BOOST_REQUIRE(itch::deserialize_snapshot_header(p, l, read));
+
+        BOOST_TEST(l == 0u);
+        BOOST_TEST(read.version == version);
+        BOOST_TEST((read.kind == itch::snapshot_kind::delta));
+        BOOST_TEST(read.chain == 7u);
+        BOOST_TEST((read.base == h.base));
+        BOOST_TEST(read.body_size == ((version >= 2u) ? 456u : 0u));
+        BOOST_TEST(read.checksum == ((version >= 2u) ? 0xdeadbeefu : 0u));
+        BOOST_TEST((read.layout == ((version >= 3u) ? itch::snapshot_layout::image : itch::snapshot_layout::compact)));
+    }
+
+    // a snapshot without header starts with the order count of the buy orders, nothing is consumed
+    std::vector<std::uint8_t> legacy(64u, 0u);
+    legacy[0] = 12u;
+
+    const std::uint8_t * p = legacy.data();
+    size_t l               = legacy.size();
+
+    itch::snapshot_header read;
+
+    BOOST_TEST(!itch::deserialize_snapshot_header(p, l, read));
+    BOOST_TEST(read.version == itch::snapshot_header::legacy_version);
+    BOOST_TEST((p == legacy.data()));
+    BOOST_TEST(l == legacy.size());
+}
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(full_snapshot_round_trip, Engine, all_engines)
+{
+    Engine engine;
+    random_orders orders{36u, 2'000u};
+
+    run(engine, orders, 20'000);
+
+    const auto snapshot = itch::make_snapshot(engine, itch::snapshot_header{});
+
+    Engine restored;
+    restored.set_depth(5u);
+
+    BOOST_REQUIRE(restore(restored, snapshot));
+    check_same_book(restored, engine);
+
+    // the restored engine carries on like the original
+    random_orders copy = orders;
+
+    run(engine, orders, 1'000);
+    run(restored, copy, 1'000);
+
+    check_same_book(restored, engine);
+}
+
+// the base and every delta up to a point give the state at that point
+BOOST_AUTO_TEST_CASE_TEMPLATE(delta_chain_round_trip, Engine, all_engines)
+{
+    Engine engine;
+    engine.track_changes(true);
+
+    random_orders orders{30u};
+
+    run(engine, orders, 5'000);
+
+    std::vector<std::vector<std::uint8_t>> chain;
+
+    chain.push_back(itch::make_snapshot(engine, itch::snapshot_header{}));
+    engine.clear_changes();
+
+    for (std::uint16_t i = 1; i <= 8u; ++i)
+    {
+        run(engine, orders, 1'000);
+
+        itch::snapshot_header h;
+
+        h.kind  = itch::snapshot_kind::delta;
+        h.chain = i;
+
+        chain.push_back(itch::make_snapshot(engine, h));
+        engine.clear_changes();
+
+        Engine restored;
+
+        for (const auto & snapshot : chain)
+        {
+            BOOST_REQUIRE(restore(restored, snapshot));
+        }
+
+        check_same_book(restored, engine);
+    }
+
+    // nothing changed, nothing to write
+    itch::snapshot_header h;
+    h.kind = itch::snapshot_kind::delta;
+
+    const auto empty = itch::make_snapshot(engine, h);
+
+    Engine restored;
+
+    for (const auto & snapshot : chain)
+    {
+        BOOST_REQUIRE(restore(restored, snapshot));
+    }
+
+    BOOST_REQUIRE(restore(restored, empty));
+    check_same_book(restored, engine);
+    BOOST_TEST(engine.changes_count() == 0u);
+}
+
+// the pages of the direct store are copied as is, every other store gets the orders
+BOOST_AUTO_TEST_CASE_TEMPLATE(image_snapshot_round_trip, Engine, all_engines)
+{
+    itch::basic_execution_engine<itch::direct_store_policy> engine;
+    random_orders orders{36u, 2'000u};
+
+    run(engine, orders, 20'000);
+
+    itch::snapshot_header h;
+    h.layout = itch::snapshot_layout::image;
+
+    const auto snapshot = itch::make_snapshot(engine, h);
+
+    const std::uint8_t * p = snapshot.data();
+    size_t l               = snapshot.size();
+
+    itch::snapshot_header read;
+    BOOST_REQUIRE(itch::deserialize_snapshot_header(p, l, read));
+    BOOST_TEST((read.layout == itch::snapshot_layout::image));
+
+    Engine restored;
+
+    BOOST_REQUIRE(restore(restored, snapshot));
+    check_same_book(restored, engine);
+
+    // a store without pages writes the compact layout whatever is asked
+    const auto compact = itch::make_snapshot(restored, h);
+
+    p = compact.data();
+    l = compact.size();
+
+    BOOST_REQUIRE(itch::deserialize_snapshot_header(p, l, read));
+    BOOST_TEST((read.layout == (itch::has_page_image_v<typename Engine::store_type> ? itch::snapshot_layout::image
+                                                                                      : itch::snapshot_layout::compact)));
+}
+
+// the snapshots written before the header existed, the orders one by one in no particular order
+BOOST_AUTO_TEST_CASE_TEMPLATE(legacy_snapshot, Engine, all_engines)
+{
+    Engine engine;
+    random_orders orders{36u};
+
+    run(engine, orders, 5'000);
+
+    std::vector<std::uint8_t> snapshot;
+
+    for (const bool is_buy : {true, false})
+    {
+        itch::order_entries entries;
+        orders.for_each(is_buy, [&entries](std::uint64_t reference, const itch::order & o) { entries.emplace_back(reference, o); });
+
+        const size_t offset = snapshot.size();
+        snapshot.resize(offset + sizeof(std::uint64_t) + entries.size() * (sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t)));
+
+        std::uint8_t * w = snapshot.data() + offset;
+        size_t wl        = snapshot.size() - offset;
+
+        itch::serialize_integer(w, wl, static_cast<std::uint64_t>(entries.size()));
+
+        for (auto it = entries.rbegin(); it != entries.rend(); ++it)
+        {
+            itch::serialize_integer(w, wl, it->first);
+            itch::serialize_integer(w, wl, it->second.price);
+            itch::serialize_integer(w, wl, it->second.shares);
+        }
+    }
+
+    const std::uint8_t * p = snapshot.data();
+    size_t l               = snapshot.size();
+
+    itch::snapshot_header h;
+    BOOST_REQUIRE(!itch::deserialize_snapshot_header(p, l, h));
+
+    Engine restored;
+
+    BOOST_REQUIRE(restored.deserialize_state(p, l, h.version, h.layout));
+    BOOST_TEST(l == 0u);
+
+    check_same_book(restored, engine);
+}
+
+BOOST_AUTO_TEST_CASE(corruption_is_detected)
+{
+    itch::execution_engine engine;
+    random_orders orders{31u};
+
+    run(engine, orders, 5'000);
+
+    const auto snapshot = itch::make_snapshot(engine, itch::snapshot_header{});
+    const size_t header = itch::snapshot_header::serialized_size(itch::snapshot_header::current_version);
+
+    for (size_t i = header; i < snapshot.size(); i += 13u)
+    {
+        auto corrupted = snapshot;
+        corrupted[i] ^= 0x10u;
+
+        itch::execution_engine restored;
+        BOOST_TEST(!restore(restored, corrupted));
+    }
+
+    auto truncated = snapshot;
+    truncated.pop_back();
+
+    itch::execution_engine restored;
+    BOOST_TEST(!restore(restored, truncated));
+}
+
+BOOST_AUTO_TEST_CASE(directory_round_trip)
+{
+    const auto at = [](std::int64_t minutes) { return utils::timespec{utils::seconds{minutes * 60}, utils::nanoseconds{0}}; };
+
+    itch::snapshot_directory directory;
+
+    // inserted out of order, the same timestamp replaces the entry
+    directory.insert(itch::snapshot_entry{at(30), 300u, 3u});
+    directory.insert(itch::snapshot_entry{at(10), 100u, 1u});
+    directory.insert(itch::snapshot_entry{at(20), 200u, 2u});
+    directory.insert(itch::snapshot_entry{at(20), 250u, 5u});
+
+    BOOST_REQUIRE_EQUAL(directory.size(), 3u);
+
+    BOOST_TEST(!directory.find(at(9)));
+    BOOST_TEST(directory.find(at(10))->size == 100u);
+    BOOST_TEST(directory.find(at(29))->size == 250u);
+    BOOST_TEST(directory.find(at(1'000))->size == 300u);
+
+    const auto blob = directory.serialize();
+
+    itch::snapshot_directory read;
+    BOOST_REQUIRE(read.deserialize(blob.data(), blob.size()));
+    BOOST_REQUIRE_EQUAL(read.size(), directory.size());
+
+    for (size_t i = 0; i < read.size(); ++i)
+    {
+        BOOST_TEST((read.entries()[i].timestamp == directory.entries()[i].timestamp));
+        BOOST_TEST(read.entries()[i].size == directory.entries()[i].size);
+        BOOST_TEST(read.entries()[i].checksum == directory.entries()[i].checksum);
+    }
+
+    BOOST_TEST(!read.deserialize(blob.data(), blob.size() - 1u));
+    BOOST_TEST(!read.deserialize(blob.data() + 1, blob.size() - 1u));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,203 @@
+#include <nasdaq_exec/itch_store.hpp>
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+
+using all_stores = std::tuple<itch::robin_hood_order_store<true>,
+    itch::robin_hood_order_store<false>,
+    itch::direct_order_store<itch::std_allocator_policy>,
+    itch::direct_order_store<itch::scalable_allocator_policy>,
+    itch::concurrent_order_store<itch::std_allocator_policy>>;
+
+template <typename Store>
+std::map<std::uint64_t, itch::order> content(const Store & store)
+{
+    std::map<std::uint64_t, itch::order> res;
+
+    store.for_each([&res](std::uint64_t reference, const itch::order & o) {
+        // every order is visited once
+        BOOST_TEST(res.emplace(reference, o).second);
+    });
+
+    return res;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(store)
+
+// the references are sparse and spread over many pages of the direct store, pages get freed and allocated again
+BOOST_AUTO_TEST_CASE_TEMPLATE(matches_map, Store, all_stores)
+{
+    std::mt19937 gen{27u};
+    std::uniform_int_distribution<std::uint32_t> percent{0u, 99u};
+    std::uniform_int_distribution<std::uint32_t> prices{1'000u, 1'099u};
+    std::uniform_int_distribution<std::uint32_t> shares{1u, 500u};
+
+    Store store;
+    std::map<std::uint64_t, itch::order> expected;
+    std::vector<std::uint64_t> references;
+
+    std::uint64_t next_reference = 1;
+
+    for (int i = 0; i < 50'000; ++i)
+    {
+        if (references.empty() || (percent(gen) < 40u))
+        {
+            next_reference += 1u + gen() % 2'000u;
+
+            const itch::order o{prices(gen), shares(gen)};
+
+            store.emplace(next_reference, o);
+            expected.emplace(next_reference, o);
+            references.push_back(next_reference);
+            continue;
+        }
+
+        const size_t index            = gen() % references.size();
+        const std::uint64_t reference = references[index];
+        const std::uint32_t executed  = std::uniform_int_distribution<std::uint32_t>{1u, expected[reference].shares}(gen);
+
+        const bool found = store.update(reference, [executed](itch::order & o) {
+            o.shares -= executed;
+            return !o.shares;
+        });
+
+        BOOST_REQUIRE(found);
+
+        auto & e = expected[reference];
+        e.shares -= executed;
+
+        if (!e.shares)
+        {
+            expected.erase(reference);
+            references[index] = references.back();
+            references.pop_back();
+
+            BOOST_TEST(!store.find(reference));
+            BOOST_TEST(!store.update(reference, [](itch::order &) { return true; }));
+        }
+        else
+        {
+            const auto o = store.find(reference);
+            BOOST_REQUIRE(o);
+            BOOST_TEST((*o == e));
+        }
+    }
+
+    BOOST_TEST(store.size() == expected.size());
+    BOOST_TEST((content(store) == expected));
+
+    itch::order_entries entries{expected.begin(), expected.end()};
+
+    Store assigned;
+    assigned.assign(entries);
+
+    BOOST_TEST(assigned.size() == expected.size());
+    BOOST_TEST((content(assigned) == expected));
+
+    store.clear();
+
+    BOOST_TEST(store.size() == 0u);
+    BOOST_TEST(content(store).empty());
+}
+
+BOOST_AUTO_TEST_CASE(direct_store_pages)
+{
+    using store_type = itch::direct_order_store<itch::std_allocator_policy>;
+
+    store_type store;
+
+    const std::uint64_t first  = 3u * store_type::page_size + 7u;
+    const std::uint64_t second = 5u * store_type::page_size;
+
+    store.emplace(first, itch::order{1'000u, 100u});
+    store.emplace(second, itch::order{1'001u, 200u});
+
+    // references are unique, an existing order is not replaced, an order without shares isn't stored
+    store.emplace(first, itch::order{1'002u, 300u});
+    store.emplace(second + 1u, itch::order{1'002u, 0u});
+
+    BOOST_TEST(store.size() == 2u);
+    BOOST_TEST((*store.find(first) == itch::order{1'000u, 100u}));
+
+    std::vector<size_t> pages;
+    store.for_each_page([&pages](size_t index, const itch::order *, size_t count) {
+        BOOST_TEST(count == 1u);
+        pages.push_back(index);
+    });
+
+    BOOST_TEST((pages == std::vector<size_t>{3u, 5u}));
+
+    // the page image of one store adopted by another gives the same orders
+    store_type copy;
+    store.for_each_page([&copy](size_t index, const itch::order * slots, size_t count) {
+        copy.adopt_page(index, reinterpret_cast<const std::uint8_t *>(slots), count);
+    });
+
+    BOOST_TEST((content(copy) == content(store)));
+
+    // the page is freed with its last order
+    store.update(first, [](itch::order &) { return true; });
+
+    pages.clear();
+    store.for_each_page([&pages](size_t index, const itch::order *, size_t) { pages.push_back(index); });
+
+    BOOST_TEST((pages == std::vector<size_t>{5u}));
+
+    store_type moved{std::move(store)};
+
+    BOOST_TEST(moved.size() == 1u);
+    BOOST_TEST(store.size() == 0u);
+    BOOST_TEST(!store.find(second));
+}
+
+// the store alone is safe to modify from several threads
+BOOST_AUTO_TEST_CASE(concurrent_store_threads)
+{
+    itch::concurrent_order_store<itch::std_allocator_policy> store;
+
+    constexpr std::uint64_t thread_count = 4u;
+    constexpr std::uint64_t per_thread   = 10'000u;
+
+    std::vector<std::thread> threads;
+
+    for (std::uint64_t t = 0; t < thread_count; ++t)
+    {
+        threads.emplace_back([&store, t]() {
+            for (std::uint64_t i = 0; i < per_thread; ++i)
+            {
+                const std::uint64_t reference = i * thread_count + t;
+                store.emplace(reference, itch::order{static_cast<std::uint32_t>(t), 2u});
+
+                // one share executed, every other order deleted
+                store.update(reference, [i](itch::order & o) {
+                    --o.shares;
+                    return (i % 2u) == 0u;
+                });
+            }
+        });
+    }
+
+    for (auto & t : threads)
+    {
+        t.join();
+    }
+
+    BOOST_TEST(store.size() == thread_count * per_thread / 2u);
+
+    store.for_each([](std::uint64_t reference, const itch::order & o) {
+        BOOST_TEST(((reference / thread_count) % 2u) == 1u);
+        BOOST_TEST(o.price == reference % thread_count);
+        BOOST_TEST(o.shares == 1u);
+    });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __SSE4_2__
+#    include <nmmintrin.h>
+#endif
+
+namespace utils
+{
+
+namespace detail
+{
+
+// Castagnoli polynomial, reflected
+static constexpr std::uint32_t crc32c_polynomial = 0x82f63b78u;
+
+inline const std::array<std::uint32_t, 256> & crc32c_table() noexcept
+{
+    static const auto table = [] {
+        std::array<std::uint32_t, 256> t{};
+
+        for (std::uint32_t i = 0; i < 256u; ++i)
+        {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+            {
+                c = (c & 1u) ? ((c >> 1u) ^ crc32c_polynomial) : (c >> 1u);
+            }
+            t[i] = c;
+        }
+
+        return t;
+    }();
+
+    return table;
+}
+
+} // namespace detail
+
+// CRC-32C (Castagnoli), uses the SSE 4.2 instruction when the target has it
+// crc is the value returned by a previous call, to checksum data in several chunks
+inline std::uint32_t crc32c(const void * data, size_t size, std::uint32_t crc = 0) noexcept
+{
+    const auto * p = static_cast<const std::uint8_t *>(data);
+
+    crc = ~crc;
+
+#ifdef __SSE4_2__
+    std::uint64_t c64 = crc;
+
+    for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t), p += sizeof(std::uint64_t))
+    {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        c64 = _mm_crc32_u64(c64, v);
+    }
+
+    crc = static_cast<std::uint32_t>(c64);
+
+    for (; size; --size, ++p)
+    {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+#else
+    const auto & table = detail::crc32c_table();
+
+    for (; size; --size, ++p)
+    {
+        crc = table[(crc ^ *p) & 0xffu] ^ (crc >> 8u);
+    }
+#endif
+
+    return ~crc;
+}
+
+} // namespace utils
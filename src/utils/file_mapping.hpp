@@ -6,6 +6,12 @@
 
 #ifdef _WIN32
 #    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#    include <cerrno>
 #endif
 
 namespace utils
@@ -17,6 +23,7 @@ class file_mapping
 {
 
 private:
+#ifdef _WIN32
     static std::error_code get_last_error() noexcept
     {
         return std::error_code{static_cast<int>(::GetLastError()), std::system_category()};
@@ -53,6 +60,53 @@ private:
         _p = static_cast<const std::uint8_t *>(::MapViewOfFile(_file_mapping, FILE_MAP_READ, 0, 0, 0));
         if (!_p) throw get_last_error();
     }
+#else
+    static std::error_code get_last_error() noexcept
+    {
+        return std::error_code{errno, std::generic_category()};
+    }
+
+    void map_file(const boost::filesystem::path & p)
+    {
+        const auto str = p.generic_string();
+
+        const int fd = ::open(str.c_str(), O_RDONLY);
+        if (fd < 0) throw get_last_error();
+
+        struct stat st;
+        if (::fstat(fd, &st) < 0)
+        {
+            const auto ec = get_last_error();
+            ::close(fd);
+            throw ec;
+        }
+
+        _size = static_cast<size_t>(st.st_size);
+
+        // mmap refuses empty mappings
+        if (!_size)
+        {
+            ::close(fd);
+            return;
+        }
+
+        void * m = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+
+        // before close() can overwrite errno
+        const auto ec = (m == MAP_FAILED) ? get_last_error() : std::error_code{};
+
+        // the mapping keeps the file alive
+        ::close(fd);
+
+        if (m == MAP_FAILED)
+        {
+            _size = 0;
+            throw ec;
+        }
+
+        _p = static_cast<const std::uint8_t *>(m);
+    }
+#endif
 
 public:
     explicit file_mapping(const boost::filesystem::path & p)
@@ -60,6 +114,9 @@ public:
         map_file(p);
     }
 
+    file_mapping(const file_mapping &) = delete;
+    file_mapping & operator=(const file_mapping &) = delete;
+
     ~file_mapping()
     {
         close();
@@ -74,11 +131,10 @@ public:
 public:
     void close()
     {
+#ifdef _WIN32
         if (_p)
         {
             ::UnmapViewOfFile(_p);
-            _p    = nullptr;
-            _size = 0;
         }
 
         if (_file_mapping)
@@ -86,10 +142,21 @@ public:
             ::CloseHandle(_file_mapping);
             _file_mapping = nullptr;
         }
+#else
+        if (_p)
+        {
+            ::munmap(const_cast<std::uint8_t *>(_p), _size);
+        }
+#endif
+
+        _p    = nullptr;
+        _size = 0;
     }
 
 private:
+#ifdef _WIN32
     HANDLE _file_mapping{nullptr};
+#endif
     const std::uint8_t * _p{nullptr};
     size_t _size{0};
 };